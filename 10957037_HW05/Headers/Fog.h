@@ -20,6 +20,18 @@ enum Fog_DepthType {
 
 const float DENSITY = 0.15f;
 
+// std140 layout of the Fog struct in the FrameData uniform block.
+struct FogData {
+	glm::vec4 Color;
+	int Mode;
+	int DepthType;
+	float Density;
+	float F_start;
+	float F_end;
+	int Enable;
+	float Padding[2];
+};
+
 class Fog
 {
 public:
@@ -39,6 +51,20 @@ public:
 		Enable = enable;
 		Color = color;
 	}
+
+	FogData getData() const {
+		FogData data;
+		data.Color = Color;
+		data.Mode = Mode;
+		data.DepthType = DepthType;
+		data.Density = Density;
+		data.F_start = F_start;
+		data.F_end = F_end;
+		data.Enable = Enable;
+		data.Padding[0] = 0.0f;
+		data.Padding[1] = 0.0f;
+		return data;
+	}
 };
 
 #endif // !FOG_H
\ No newline at end of file
@@ -0,0 +1,451 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include "../Headers/hashing.h"
+#include "../Headers/logging.h"
+#include "../Headers/mappedfile.h"
+
+// The Win32 directory listing comes through the guarded <windows.h> of mappedfile.h
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Every file of Resources and Shaders in one file, built with "--build-pack".
+const std::string ASSET_PACK_PATH = "Assets.pak";
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint64_t ASSET_PACK_ALIGNMENT = 64;
+
+enum Asset_Flag {
+	ASSET_COMPRESSED = 1
+};
+
+// Layout: header, table of contents sorted by hash, the NUL terminated names, then every entry
+// starting on an ASSET_PACK_ALIGNMENT boundary.
+struct AssetPackHeader {
+	char Magic[4];				// "APAK"
+	uint32_t Version;
+	uint32_t Entries;
+	uint32_t NamesSize;
+};
+
+struct AssetPackEntry {
+	uint64_t Hash;				// of the normalized path
+	uint64_t Offset;			// from the start of the pack
+	uint64_t StoredSize;
+	uint64_t Size;				// once decompressed
+	int64_t ModifiedTime;		// of the source file when the pack was built
+	uint32_t NameOffset;		// into the names
+	uint32_t Flags;
+};
+
+// Content of one asset. Raw entries point straight into the mapping, compressed ones into Storage.
+struct AssetView {
+	const unsigned char* Data = NULL;
+	size_t Size = 0;
+	std::vector<unsigned char> Storage;
+
+	const unsigned char* data() const {
+		return Storage.empty() ? Data : Storage.data();
+	}
+};
+
+// Read-only pack mapped once for the whole run. Lookups are a binary search over the hashes,
+// and may run on any thread once open() has returned.
+class AssetPack {
+public:
+	static AssetPack& instance() {
+		static AssetPack pack;
+		return pack;
+	}
+
+	// False when there is no valid pack, the loose files are used then.
+	bool open(const std::string& path) {
+		close();
+		if (!file.open(path) || file.getSize() < sizeof(AssetPackHeader)) {
+			file.close();
+			return false;
+		}
+		const AssetPackHeader* header = (const AssetPackHeader*)file.getData();
+		uint64_t tocEnd = sizeof(AssetPackHeader) + (uint64_t)header->Entries * sizeof(AssetPackEntry);
+		if (memcmp(header->Magic, "APAK", 4) != 0 || header->Version != ASSET_PACK_VERSION || tocEnd + header->NamesSize > file.getSize()) {
+			logging::loggingMessage(logging::LogType::WARNING, "Ignored the invalid asset pack " + path);
+			file.close();
+			return false;
+		}
+		entries = (const AssetPackEntry*)(file.getData() + sizeof(AssetPackHeader));
+		count = header->Entries;
+		names = (const char*)(file.getData() + tocEnd);
+		namesSize = header->NamesSize;
+		logging::loggingMessage(logging::LogType::DEBUG, "Opened asset pack " + path + " with " + std::to_string(count) + " assets");
+		return true;
+	}
+
+	void close() {
+		file.close();
+		entries = NULL;
+		count = 0;
+		names = NULL;
+		namesSize = 0;
+	}
+
+	bool isOpen() const {
+		return entries != NULL;
+	}
+
+	// "Resources\Textures\Metal.png" and "resources/textures/metal.png" are the same asset.
+	static std::string normalize(const std::string& path) {
+		std::string normalized = path;
+		for (size_t i = 0; i < normalized.size(); i++) {
+			char c = normalized[i];
+			normalized[i] = (c == '\\') ? '/' : (char)((c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c);
+		}
+		size_t start = 0;
+		while (normalized.compare(start, 2, "./") == 0) {
+			start += 2;
+		}
+		return normalized.substr(start);
+	}
+
+	static uint64_t hash(const std::string& normalized) {
+		return fnv1a(normalized);
+	}
+
+	// NULL when the pack is not open or has no such asset.
+	const AssetPackEntry* find(const std::string& path) const {
+		if (!isOpen()) {
+			return NULL;
+		}
+		std::string normalized = normalize(path);
+		uint64_t key = hash(normalized);
+		const AssetPackEntry* end = entries + count;
+		const AssetPackEntry* entry = std::lower_bound(entries, end, key, [](const AssetPackEntry& e, uint64_t k) {
+			return e.Hash < k;
+		});
+		for (; entry != end && entry->Hash == key; entry++) {
+			if (entry->NameOffset < namesSize && normalized == names + entry->NameOffset) {
+				return entry;
+			}
+		}
+		return NULL;
+	}
+
+	// Raw entries are not copied, the view stays valid while the pack is open.
+	bool read(const std::string& path, AssetView& view) const {
+		const AssetPackEntry* entry = find(path);
+		if (entry == NULL || entry->Offset + entry->StoredSize > file.getSize()) {
+			return false;
+		}
+		const unsigned char* stored = file.getData() + entry->Offset;
+		view.Storage.clear();
+		view.Size = (size_t)entry->Size;
+		if (!(entry->Flags & ASSET_COMPRESSED)) {
+			view.Data = stored;
+			return true;
+		}
+		view.Data = NULL;
+		view.Storage.resize(view.Size);
+		if (!lzDecompress(stored, (size_t)entry->StoredSize, view.Storage.data(), view.Size)) {
+			logging::loggingMessage(logging::LogType::ERROR, "Corrupted asset " + path + " in the asset pack");
+			view.Storage.clear();
+			view.Size = 0;
+			return false;
+		}
+		return true;
+	}
+
+	bool readText(const std::string& path, std::string& text) const {
+		AssetView view;
+		if (!read(path, view)) {
+			return false;
+		}
+		text.assign((const char*)view.data(), view.Size);
+		return true;
+	}
+
+	// -1 when the asset is not in the pack.
+	int64_t getModifiedTime(const std::string& path) const {
+		const AssetPackEntry* entry = find(path);
+		return (entry != NULL) ? entry->ModifiedTime : -1;
+	}
+
+	// LZ77 with the sequence layout of LZ4: a token (literal length << 4 | match length - 4), extra length
+	// bytes of 255 when a nibble is 15, the literals, then a 16 bit offset. The last sequence has no match.
+	static void lzCompress(const unsigned char* source, size_t size, std::vector<unsigned char>& out) {
+		const unsigned int HASH_BITS = 14;
+		std::vector<int64_t> table((size_t)1 << HASH_BITS, -1);
+		out.clear();
+		out.reserve(size + size / 255 + 16);
+
+		size_t anchor = 0;
+		size_t i = 0;
+		while (i + LZ_MIN_MATCH <= size) {
+			uint32_t sequence = read32(source + i);
+			uint32_t slot = (sequence * 2654435761u) >> (32 - HASH_BITS);
+			int64_t candidate = table[slot];
+			table[slot] = (int64_t)i;
+			if (candidate < 0 || i - (size_t)candidate > 0xFFFF || read32(source + candidate) != sequence) {
+				i++;
+				continue;
+			}
+			size_t length = LZ_MIN_MATCH;
+			while (i + length < size && source[candidate + length] == source[i + length]) {
+				length++;
+			}
+			writeSequence(out, source + anchor, i - anchor, i - (size_t)candidate, length);
+			i += length;
+			anchor = i;
+		}
+		writeSequence(out, source + anchor, size - anchor, 0, 0);
+	}
+
+	// False on a corrupted stream or a size mismatch.
+	static bool lzDecompress(const unsigned char* source, size_t size, unsigned char* out, size_t outSize) {
+		const unsigned char* in = source;
+		const unsigned char* inEnd = source + size;
+		size_t written = 0;
+		while (in < inEnd) {
+			unsigned int token = *in++;
+			size_t literals = token >> 4;
+			if (!readLength(in, inEnd, literals) || literals > (size_t)(inEnd - in) || literals > outSize - written) {
+				return false;
+			}
+			memcpy(out + written, in, literals);
+			in += literals;
+			written += literals;
+			if (in == inEnd) {
+				break;
+			}
+			if (inEnd - in < 2) {
+				return false;
+			}
+			size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+			in += 2;
+			size_t length = token & 0xF;
+			if (!readLength(in, inEnd, length)) {
+				return false;
+			}
+			length += LZ_MIN_MATCH;
+			if (offset == 0 || offset > written || length > outSize - written) {
+				return false;
+			}
+			// Byte by byte, the match may overlap the bytes it produces
+			const unsigned char* match = out + written - offset;
+			for (size_t j = 0; j < length; j++) {
+				out[written + j] = match[j];
+			}
+			written += length;
+		}
+		return written == outSize;
+	}
+
+	// Pack every file under "roots", the paths are stored as found, e.g. "Shaders/lighting.vs".
+	// Entries are only compressed when it saves more than an eighth, the images are compressed already.
+	static bool build(const std::vector<std::string>& roots, const std::string& output) {
+		std::vector<std::string> paths;
+		for (unsigned int i = 0; i < roots.size(); i++) {
+			listFiles(roots[i], paths);
+		}
+
+		struct Pending {
+			AssetPackEntry Entry;
+			std::string Name;
+			std::vector<unsigned char> Stored;
+		};
+		std::vector<Pending> pending;
+		uint64_t rawBytes = 0;
+		for (unsigned int i = 0; i < paths.size(); i++) {
+			std::ifstream input(paths[i], std::ios::binary);
+			std::vector<unsigned char> content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+			if (!input.good() && !input.eof()) {
+				logging::loggingMessage(logging::LogType::ERROR, "Failed to read " + paths[i]);
+				return false;
+			}
+			Pending asset;
+			asset.Name = normalize(paths[i]);
+			asset.Entry = AssetPackEntry();
+			asset.Entry.Hash = hash(asset.Name);
+			asset.Entry.Size = content.size();
+			struct stat info;
+			asset.Entry.ModifiedTime = (stat(paths[i].c_str(), &info) == 0) ? (int64_t)info.st_mtime : 0;
+			lzCompress(content.data(), content.size(), asset.Stored);
+			if (asset.Stored.size() < content.size() - content.size() / 8) {
+				asset.Entry.Flags = ASSET_COMPRESSED;
+			} else {
+				asset.Stored.swap(content);
+			}
+			asset.Entry.StoredSize = asset.Stored.size();
+			rawBytes += asset.Entry.Size;
+			pending.push_back(std::move(asset));
+		}
+		std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+			return (a.Entry.Hash != b.Entry.Hash) ? a.Entry.Hash < b.Entry.Hash : a.Name < b.Name;
+		});
+
+		AssetPackHeader header;
+		memcpy(header.Magic, "APAK", 4);
+		header.Version = ASSET_PACK_VERSION;
+		header.Entries = (uint32_t)pending.size();
+		std::string nameTable;
+		for (unsigned int i = 0; i < pending.size(); i++) {
+			pending[i].Entry.NameOffset = (uint32_t)nameTable.size();
+			nameTable += pending[i].Name;
+			nameTable += '\0';
+		}
+		header.NamesSize = (uint32_t)nameTable.size();
+
+		uint64_t offset = sizeof(AssetPackHeader) + pending.size() * sizeof(AssetPackEntry) + nameTable.size();
+		for (unsigned int i = 0; i < pending.size(); i++) {
+			offset = align(offset);
+			pending[i].Entry.Offset = offset;
+			offset += pending[i].Entry.StoredSize;
+		}
+
+		// Written next to the target first, so a running instance never maps a half written pack
+		std::string temporary = output + ".tmp";
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		out.write((const char*)&header, sizeof(header));
+		for (unsigned int i = 0; i < pending.size(); i++) {
+			out.write((const char*)&pending[i].Entry, sizeof(AssetPackEntry));
+		}
+		out.write(nameTable.data(), nameTable.size());
+		uint64_t position = sizeof(AssetPackHeader) + pending.size() * sizeof(AssetPackEntry) + nameTable.size();
+		const char padding[ASSET_PACK_ALIGNMENT] = {};
+		for (unsigned int i = 0; i < pending.size(); i++) {
+			out.write(padding, (std::streamsize)(pending[i].Entry.Offset - position));
+			out.write((const char*)pending[i].Stored.data(), pending[i].Stored.size());
+			position = pending[i].Entry.Offset + pending[i].Entry.StoredSize;
+		}
+		out.close();
+		if (!out) {
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to write the asset pack " + output);
+			std::remove(temporary.c_str());
+			return false;
+		}
+		std::remove(output.c_str());
+		if (std::rename(temporary.c_str(), output.c_str()) != 0) {
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to replace the asset pack " + output);
+			return false;
+		}
+		logging::loggingMessage(logging::LogType::INFO, "Built " + output + " with " + std::to_string(pending.size()) + " assets, "
+			+ std::to_string(rawBytes / 1024) + " KB packed into " + std::to_string(position / 1024) + " KB");
+		return true;
+	}
+
+private:
+	static const size_t LZ_MIN_MATCH = 4;
+
+	MappedFile file;
+	const AssetPackEntry* entries;
+	uint32_t count;
+	const char* names;
+	uint32_t namesSize;
+
+	AssetPack() : entries(NULL), count(0), names(NULL), namesSize(0) {}
+
+	static uint32_t read32(const unsigned char* p) {
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	static uint64_t align(uint64_t offset) {
+		return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+	}
+
+	static void writeLength(std::vector<unsigned char>& out, size_t length) {
+		for (; length >= 255; length -= 255) {
+			out.push_back(255);
+		}
+		out.push_back((unsigned char)length);
+	}
+
+	// Adds the extra bytes to a nibble of 15.
+	static bool readLength(const unsigned char*& in, const unsigned char* end, size_t& length) {
+		if (length != 15) {
+			return true;
+		}
+		unsigned char extra;
+		do {
+			if (in == end) {
+				return false;
+			}
+			extra = *in++;
+			length += extra;
+		} while (extra == 255);
+		return true;
+	}
+
+	// A "length" of 0 writes only literals, which ends the stream.
+	static void writeSequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t numLiterals, size_t offset, size_t length) {
+		size_t matchNibble = (length != 0) ? length - LZ_MIN_MATCH : 0;
+		out.push_back((unsigned char)((std::min(numLiterals, (size_t)15) << 4) | std::min(matchNibble, (size_t)15)));
+		if (numLiterals >= 15) {
+			writeLength(out, numLiterals - 15);
+		}
+		out.insert(out.end(), literals, literals + numLiterals);
+		if (length == 0) {
+			return;
+		}
+		out.push_back((unsigned char)(offset & 0xFF));
+		out.push_back((unsigned char)(offset >> 8));
+		if (matchNibble >= 15) {
+			writeLength(out, matchNibble - 15);
+		}
+	}
+
+	// Recursive, sorted so that the same tree always builds the same pack.
+	static void listFiles(const std::string& directory, std::vector<std::string>& paths) {
+		std::vector<std::string> found;
+		std::vector<std::string> subdirectories;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE search = FindFirstFileA((directory + "/*").c_str(), &data);
+		if (search == INVALID_HANDLE_VALUE) {
+			return;
+		}
+		do {
+			std::string name = data.cFileName;
+			if (name == "." || name == "..") {
+				continue;
+			}
+			((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? subdirectories : found).push_back(directory + "/" + name);
+		} while (FindNextFileA(search, &data));
+		FindClose(search);
+#else
+		DIR* search = opendir(directory.c_str());
+		if (search == NULL) {
+			return;
+		}
+		while (struct dirent* item = readdir(search)) {
+			std::string name = item->d_name;
+			if (name == "." || name == "..") {
+				continue;
+			}
+			std::string path = directory + "/" + name;
+			struct stat info;
+			if (stat(path.c_str(), &info) == 0) {
+				(S_ISDIR(info.st_mode) ? subdirectories : found).push_back(path);
+			}
+		}
+		closedir(search);
+#endif
+		std::sort(found.begin(), found.end());
+		std::sort(subdirectories.begin(), subdirectories.end());
+		paths.insert(paths.end(), found.begin(), found.end());
+		for (unsigned int i = 0; i < subdirectories.size(); i++) {
+			listFiles(subdirectories[i], paths);
+		}
+	}
+};
+
+#endif // !ASSETPACK_H
\ No newline at end of file
@@ -0,0 +1,137 @@
+#ifndef BILLBOARD_H
+#define BILLBOARD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+enum Billboard_Mode {
+	CYLINDRICAL,	// Y axis is fixed
+	SPHERICAL		// Y axis is not fixed
+};
+
+// Per-instance data, the layout must match location 3 ~ 5 and 9 in lighting.vs and gouraud.vs
+struct BillboardInstance {
+	glm::vec3 Position;
+	glm::vec2 Size;
+	float Mode;
+	glm::vec3 Sprite;	// x: first layer in the sprite array, y: number of frames, z: phase offset in frames
+};
+
+class Billboard {
+public:
+	unsigned int VAO;
+	unsigned int QuadVBO;
+	unsigned int InstanceVBO;
+	unsigned int DrawCount;
+	std::vector<BillboardInstance> Instances;
+
+	Billboard() : VAO(0), QuadVBO(0), InstanceVBO(0), DrawCount(0), capacity(0) {}
+
+	// Must be called after the OpenGL context has been created.
+	void setup() {
+		// The quad is defined in billboard space, x in [-0.5, 0.5] and y in [0, 1].
+		// The vertex shader expands it along the billboard axes of each instance.
+		float quadVertices[] = {
+			// Positions		// Normals			// Texture coords
+			-0.5f, 0.0f, 0.0f,	0.0f, 0.0f, 1.0f,	0.0f, 1.0f,
+			-0.5f, 1.0f, 0.0f,	0.0f, 0.0f, 1.0f,	0.0f, 0.0f,
+			 0.5f, 1.0f, 0.0f,	0.0f, 0.0f, 1.0f,	1.0f, 0.0f,
+
+			-0.5f, 0.0f, 0.0f,	0.0f, 0.0f, 1.0f,	0.0f, 1.0f,
+			 0.5f, 1.0f, 0.0f,	0.0f, 0.0f, 1.0f,	1.0f, 0.0f,
+			 0.5f, 0.0f, 0.0f,	0.0f, 0.0f, 1.0f,	1.0f, 1.0f,
+		};
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &QuadVBO);
+		glGenBuffers(1, &InstanceVBO);
+		glBindVertexArray(VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, QuadVBO);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+
+			glBindBuffer(GL_ARRAY_BUFFER, InstanceVBO);
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, Position));
+			glVertexAttribDivisor(3, 1);
+			glEnableVertexAttribArray(4);
+			glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, Size));
+			glVertexAttribDivisor(4, 1);
+			glEnableVertexAttribArray(5);
+			glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, Mode));
+			glVertexAttribDivisor(5, 1);
+			glEnableVertexAttribArray(9);
+			glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, Sprite));
+			glVertexAttribDivisor(9, 1);
+		glBindVertexArray(0);
+	}
+
+	// Animated sprites loop over "frames" layers starting at "layer", "phase" desynchronizes the instances.
+	void addInstance(glm::vec3 position, float size_w, float size_h, int mode, unsigned int layer, unsigned int frames = 1, float phase = 0.0f) {
+		Instances.push_back({ position, glm::vec2(size_w, size_h), (float)mode, glm::vec3((float)layer, (float)frames, phase) });
+	}
+
+	// Upload all instances to the GPU, only needs to be called when the instances changed.
+	void upload() {
+		uploadData(Instances);
+	}
+
+	// Upload only the given instances (e.g. the ones left after frustum culling).
+	void upload(const std::vector<unsigned int>& indices) {
+		gather(indices);
+		uploadGathered();
+	}
+
+	// Copy the given instances into the upload list, without any OpenGL call, so it can run on a job of the job system.
+	void gather(const std::vector<unsigned int>& indices) {
+		visibleInstances.clear();
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			visibleInstances.push_back(Instances[indices[i]]);
+		}
+	}
+
+	// Upload the instances of the last gather(), on the thread owning the OpenGL context.
+	void uploadGathered() {
+		uploadData(visibleInstances);
+	}
+
+	void draw() {
+		if (DrawCount == 0) {
+			return;
+		}
+		glBindVertexArray(VAO);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)DrawCount);
+		glBindVertexArray(0);
+	}
+
+	void release() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &QuadVBO);
+		glDeleteBuffers(1, &InstanceVBO);
+	}
+
+private:
+	unsigned int capacity;
+	std::vector<BillboardInstance> visibleInstances;
+
+	void uploadData(const std::vector<BillboardInstance>& instances) {
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceVBO);
+		if (instances.size() > capacity) {
+			capacity = (unsigned int)instances.size();
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(BillboardInstance), instances.data(), GL_DYNAMIC_DRAW);
+		} else {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(BillboardInstance), instances.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		DrawCount = (unsigned int)instances.size();
+	}
+};
+
+#endif // !BILLBOARD_H
\ No newline at end of file
@@ -0,0 +1,427 @@
+#ifndef BLOCKCOMPRESS_H
+#define BLOCKCOMPRESS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define BLOCKCOMPRESS_USE_SSE
+#endif
+
+// S3TC formats, part of EXT_texture_compression_s3tc which every desktop driver exposes
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum Compression_Quality {
+	COMPRESSION_NONE,	// upload the pixels as they are
+	COMPRESSION_FAST,	// bounding box endpoints
+	COMPRESSION_HIGH,	// principal axis endpoints, refined by least squares
+};
+
+// Bytes of one 4 x 4 block: BC1 (DXT1) for RGB, BC3 (DXT5) for RGBA
+inline unsigned int getBlockBytes(GLenum format) {
+	return (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+}
+
+inline unsigned int getCompressedSize(int width, int height, GLenum format) {
+	return ((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+namespace blockcompress {
+	inline uint16_t packColor(const float* color) {
+		int r = std::min(std::max((int)(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g = std::min(std::max((int)(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b = std::min(std::max((int)(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	inline void unpackColor(uint16_t color, float* rgb) {
+		int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		rgb[0] = (float)((r << 3) | (r >> 2));
+		rgb[1] = (float)((g << 2) | (g >> 4));
+		rgb[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	// The four colors of the 4-color mode, the same weights as the hardware
+	inline void buildPalette(uint16_t color0, uint16_t color1, float palette[4][3]) {
+		unpackColor(color0, palette[0]);
+		unpackColor(color1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+	}
+
+	// Nearest palette entry of every pixel, returns the squared error of the block.
+	inline float selectColorIndices(const float pixels[3][16], const float palette[4][3], unsigned char indices[16]) {
+#ifdef BLOCKCOMPRESS_USE_SSE
+		__m128 total = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4) {
+			__m128 r = _mm_loadu_ps(&pixels[0][i]), g = _mm_loadu_ps(&pixels[1][i]), b = _mm_loadu_ps(&pixels[2][i]);
+			__m128 best = _mm_set1_ps(1e30f);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int p = 0; p < 4; p++) {
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				best = _mm_min_ps(distance, best);
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+			}
+			total = _mm_add_ps(total, best);
+			int lanes[4];
+			_mm_storeu_si128((__m128i*)lanes, bestIndex);
+			for (int k = 0; k < 4; k++) {
+				indices[i + k] = (unsigned char)lanes[k];
+			}
+		}
+		float sums[4];
+		_mm_storeu_ps(sums, total);
+		return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+		float total = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			float best = 1e30f;
+			for (int p = 0; p < 4; p++) {
+				float dr = pixels[0][i] - palette[p][0], dg = pixels[1][i] - palette[p][1], db = pixels[2][i] - palette[p][2];
+				float distance = dr * dr + dg * dg + db * db;
+				if (distance < best) {
+					best = distance;
+					indices[i] = (unsigned char)p;
+				}
+			}
+			total += best;
+		}
+		return total;
+#endif
+	}
+
+	// Least squares endpoints for the given indices, keeps the old endpoints when every pixel uses the same weight.
+	inline bool refineEndpoints(const float pixels[3][16], const unsigned char indices[16], float* high, float* low) {
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f }, bx[3] = { 0.0f };
+		for (int i = 0; i < 16; i++) {
+			float a = weights[indices[i]], b = 1.0f - a;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for (int c = 0; c < 3; c++) {
+				ax[c] += a * pixels[c][i];
+				bx[c] += b * pixels[c][i];
+			}
+		}
+		float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f) {
+			return false;
+		}
+		for (int c = 0; c < 3; c++) {
+			high[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+			low[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	// Endpoints along the axis of the largest spread of the colors: the bounding box diagonal,
+	// or the principal axis of the covariance found by power iteration.
+	inline void findEndpoints(const float pixels[3][16], Compression_Quality quality, float* high, float* low) {
+		float minimum[3] = { 255.0f, 255.0f, 255.0f }, maximum[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 3; c++) {
+				minimum[c] = std::min(minimum[c], pixels[c][i]);
+				maximum[c] = std::max(maximum[c], pixels[c][i]);
+			}
+		}
+
+		if (quality == COMPRESSION_FAST) {
+			// Inset by 1/16 of the range, the extremes are rarely hit exactly by the interpolated colors
+			for (int c = 0; c < 3; c++) {
+				float inset = (maximum[c] - minimum[c]) / 16.0f;
+				high[c] = maximum[c] - inset;
+				low[c] = minimum[c] + inset;
+			}
+			return;
+		}
+
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 3; c++) {
+				mean[c] += pixels[c][i] / 16.0f;
+			}
+		}
+		float covariance[6] = { 0.0f };	// rr, rg, rb, gg, gb, bb
+		for (int i = 0; i < 16; i++) {
+			float r = pixels[0][i] - mean[0], g = pixels[1][i] - mean[1], b = pixels[2][i] - mean[2];
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		float axis[3] = { maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2] };
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+			if (length < 1e-6f) {
+				break;
+			}
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+
+		float lowest = 1e30f, highest = -1e30f;
+		int lowIndex = 0, highIndex = 0;
+		for (int i = 0; i < 16; i++) {
+			float projection = pixels[0][i] * axis[0] + pixels[1][i] * axis[1] + pixels[2][i] * axis[2];
+			if (projection < lowest) {
+				lowest = projection;
+				lowIndex = i;
+			}
+			if (projection > highest) {
+				highest = projection;
+				highIndex = i;
+			}
+		}
+		for (int c = 0; c < 3; c++) {
+			high[c] = pixels[c][highIndex];
+			low[c] = pixels[c][lowIndex];
+		}
+	}
+
+	// The color half of a block, always in 4-color mode (color0 > color1) so BC1 never gets transparent texels.
+	inline void encodeColorBlock(const float pixels[3][16], Compression_Quality quality, unsigned char* out) {
+		float high[3], low[3];
+		findEndpoints(pixels, quality, high, low);
+
+		uint16_t color0 = packColor(high), color1 = packColor(low);
+		unsigned char indices[16];
+		float palette[4][3];
+		float error = 1e30f;
+		if (color0 != color1) {
+			if (color0 < color1) {
+				std::swap(color0, color1);
+			}
+			buildPalette(color0, color1, palette);
+			error = selectColorIndices(pixels, palette, indices);
+
+			// One least squares pass, kept only when it lowers the error
+			float refinedHigh[3], refinedLow[3];
+			if (quality == COMPRESSION_HIGH && refineEndpoints(pixels, indices, refinedHigh, refinedLow)) {
+				uint16_t refined0 = packColor(refinedHigh), refined1 = packColor(refinedLow);
+				if (refined0 < refined1) {
+					std::swap(refined0, refined1);
+				}
+				if (refined0 != refined1) {
+					unsigned char refinedIndices[16];
+					float refinedPalette[4][3];
+					buildPalette(refined0, refined1, refinedPalette);
+					float refinedError = selectColorIndices(pixels, refinedPalette, refinedIndices);
+					if (refinedError < error) {
+						color0 = refined0;
+						color1 = refined1;
+						memcpy(indices, refinedIndices, sizeof(indices));
+					}
+				}
+			}
+		} else {
+			// One color, index 0 is color0 in both modes
+			memset(indices, 0, sizeof(indices));
+		}
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++) {
+			bits |= (uint32_t)indices[i] << (i * 2);
+		}
+		out[0] = (unsigned char)(color0 & 0xFF);
+		out[1] = (unsigned char)(color0 >> 8);
+		out[2] = (unsigned char)(color1 & 0xFF);
+		out[3] = (unsigned char)(color1 >> 8);
+		for (int i = 0; i < 4; i++) {
+			out[4 + i] = (unsigned char)(bits >> (i * 8));
+		}
+	}
+
+	// The alpha half of a BC3 block, in 8-value mode (alpha0 > alpha1).
+	inline void encodeAlphaBlock(const float alpha[16], unsigned char* out) {
+		float minimum = 255.0f, maximum = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			minimum = std::min(minimum, alpha[i]);
+			maximum = std::max(maximum, alpha[i]);
+		}
+		int alpha0 = (int)(maximum + 0.5f), alpha1 = (int)(minimum + 0.5f);
+
+		unsigned char indices[16] = { 0 };
+		if (alpha0 != alpha1) {
+			float values[8];
+			values[0] = (float)alpha0;
+			values[1] = (float)alpha1;
+			for (int k = 1; k < 7; k++) {
+				values[k + 1] = (float)(((7 - k) * alpha0 + k * alpha1) / 7);
+			}
+#ifdef BLOCKCOMPRESS_USE_SSE
+			for (int i = 0; i < 16; i += 4) {
+				__m128 a = _mm_loadu_ps(&alpha[i]);
+				__m128 best = _mm_set1_ps(1e30f);
+				__m128i bestIndex = _mm_setzero_si128();
+				for (int p = 0; p < 8; p++) {
+					__m128 delta = _mm_sub_ps(a, _mm_set1_ps(values[p]));
+					__m128 distance = _mm_mul_ps(delta, delta);
+					__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+					best = _mm_min_ps(distance, best);
+					bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+				}
+				int lanes[4];
+				_mm_storeu_si128((__m128i*)lanes, bestIndex);
+				for (int k = 0; k < 4; k++) {
+					indices[i + k] = (unsigned char)lanes[k];
+				}
+			}
+#else
+			for (int i = 0; i < 16; i++) {
+				float best = 1e30f;
+				for (int p = 0; p < 8; p++) {
+					float distance = (alpha[i] - values[p]) * (alpha[i] - values[p]);
+					if (distance < best) {
+						best = distance;
+						indices[i] = (unsigned char)p;
+					}
+				}
+			}
+#endif
+		}
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; i++) {
+			bits |= (uint64_t)indices[i] << (i * 3);
+		}
+		out[0] = (unsigned char)alpha0;
+		out[1] = (unsigned char)alpha1;
+		for (int i = 0; i < 6; i++) {
+			out[2 + i] = (unsigned char)(bits >> (i * 8));
+		}
+	}
+
+	// 4 x 4 texels starting at (x, y), the edges are repeated for the blocks sticking out of the image
+	inline void fetchBlock(const unsigned char* pixels, int width, int height, int components, int x, int y, float block[4][16]) {
+		for (int i = 0; i < 16; i++) {
+			int px = std::min(x + (i & 3), width - 1), py = std::min(y + (i >> 2), height - 1);
+			const unsigned char* texel = pixels + (py * width + px) * components;
+			for (int c = 0; c < 3; c++) {
+				block[c][i] = texel[c];
+			}
+			block[3][i] = (components == 4) ? texel[3] : 255.0f;
+		}
+	}
+}
+
+// Compress the block rows firstRow ~ lastRow - 1 of one level of RGB or RGBA pixels. "out" is the start of the level,
+// so the rows can be split over several threads writing into the same buffer.
+inline void compressBlocks(const unsigned char* pixels, int width, int height, int components, GLenum format, Compression_Quality quality,
+	unsigned int firstRow, unsigned int lastRow, unsigned char* out) {
+	unsigned int blocksX = (width + 3) / 4;
+	unsigned int blockBytes = getBlockBytes(format);
+	float block[4][16];
+	for (unsigned int by = firstRow; by < lastRow; by++) {
+		for (unsigned int bx = 0; bx < blocksX; bx++) {
+			blockcompress::fetchBlock(pixels, width, height, components, bx * 4, by * 4, block);
+			unsigned char* target = out + (by * blocksX + bx) * blockBytes;
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				blockcompress::encodeAlphaBlock(block[3], target);
+				target += 8;
+			}
+			blockcompress::encodeColorBlock(block, quality, target);
+		}
+	}
+}
+
+// Decode one level back to RGBA, used for the quality report.
+inline void decompressBlocks(const unsigned char* data, int width, int height, GLenum format, unsigned char* rgba) {
+	unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned int blockBytes = getBlockBytes(format);
+	for (unsigned int by = 0; by < blocksY; by++) {
+		for (unsigned int bx = 0; bx < blocksX; bx++) {
+			const unsigned char* block = data + (by * blocksX + bx) * blockBytes;
+			unsigned char alpha[16];
+			memset(alpha, 255, sizeof(alpha));
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				int alpha0 = block[0], alpha1 = block[1];
+				uint64_t bits = 0;
+				for (int i = 0; i < 6; i++) {
+					bits |= (uint64_t)block[2 + i] << (i * 8);
+				}
+				for (int i = 0; i < 16; i++) {
+					int index = (int)((bits >> (i * 3)) & 7);
+					if (index == 0) {
+						alpha[i] = (unsigned char)alpha0;
+					} else if (index == 1) {
+						alpha[i] = (unsigned char)alpha1;
+					} else if (alpha0 > alpha1) {
+						alpha[i] = (unsigned char)(((8 - index) * alpha0 + (index - 1) * alpha1) / 7);
+					} else {
+						alpha[i] = (index == 6) ? 0 : (index == 7) ? 255 : (unsigned char)(((6 - index) * alpha0 + (index - 1) * alpha1) / 5);
+					}
+				}
+				block += 8;
+			}
+
+			uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8)), color1 = (uint16_t)(block[2] | (block[3] << 8));
+			float palette[4][3];
+			blockcompress::buildPalette(color0, color1, palette);
+			if (color0 <= color1 && format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+				for (int c = 0; c < 3; c++) {
+					palette[2][c] = (palette[0][c] + palette[1][c]) / 2.0f;
+					palette[3][c] = 0.0f;
+				}
+			}
+			uint32_t bits = (uint32_t)(block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24));
+			for (int i = 0; i < 16; i++) {
+				int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+				if (x >= width || y >= height) {
+					continue;
+				}
+				int index = (int)((bits >> (i * 2)) & 3);
+				unsigned char* texel = rgba + (y * width + x) * 4;
+				for (int c = 0; c < 3; c++) {
+					texel[c] = (unsigned char)(palette[index][c] + 0.5f);
+				}
+				texel[3] = alpha[i];
+			}
+		}
+	}
+}
+
+// Peak signal to noise ratio in dB between the pixels and their compressed level, over every channel the format keeps.
+inline float computePSNR(const unsigned char* pixels, int width, int height, int components, const unsigned char* compressed, GLenum format) {
+	unsigned char* decoded = new unsigned char[width * height * 4];
+	decompressBlocks(compressed, width, height, format, decoded);
+	int channels = (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ? 4 : 3;
+	double error = 0.0;
+	for (int i = 0; i < width * height; i++) {
+		for (int c = 0; c < channels; c++) {
+			double delta = (double)pixels[i * components + c] - (double)decoded[i * 4 + c];
+			error += delta * delta;
+		}
+	}
+	delete[] decoded;
+	error /= (double)width * height * channels;
+	if (error <= 0.0) {
+		return 99.0f;
+	}
+	return (float)(10.0 * std::log10(255.0 * 255.0 / error));
+}
+
+#endif // !BLOCKCOMPRESS_H
\ No newline at end of file
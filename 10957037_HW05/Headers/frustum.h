@@ -0,0 +1,127 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE
+#endif
+
+// Six planes (left, right, bottom, top, near, far) pointing inside, with normalized normals.
+struct Frustum {
+	glm::vec4 Planes[6];
+
+	Frustum() {}
+
+	// Extract the planes from projection * view, works for both perspective and orthogonal projection.
+	Frustum(const glm::mat4& viewProjection) {
+		glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+		glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+		glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+		glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+		Planes[0] = row3 + row0;
+		Planes[1] = row3 - row0;
+		Planes[2] = row3 + row1;
+		Planes[3] = row3 - row1;
+		Planes[4] = row3 + row2;
+		Planes[5] = row3 - row2;
+
+		for (int i = 0; i < 6; i++) {
+			Planes[i] /= glm::length(glm::vec3(Planes[i]));
+		}
+	}
+};
+
+// Bounding spheres stored as structure of arrays, so four spheres are tested at once.
+class SphereSet {
+public:
+	std::vector<float> X;
+	std::vector<float> Y;
+	std::vector<float> Z;
+	std::vector<float> Radius;
+
+	void add(glm::vec3 center, float radius) {
+		X.push_back(center.x);
+		Y.push_back(center.y);
+		Z.push_back(center.z);
+		Radius.push_back(radius);
+	}
+
+	void clear() {
+		X.clear();
+		Y.clear();
+		Z.clear();
+		Radius.clear();
+	}
+
+	unsigned int size() const {
+		return (unsigned int)X.size();
+	}
+
+	// Write the index of every sphere that touches the frustum into "visible".
+	void cull(const Frustum& frustum, std::vector<unsigned int>& visible) const {
+		cull(&frustum, 1, visible);
+	}
+
+	// Same for the union of "numFrustums" frustums, when several views are drawn in one pass.
+	void cull(const Frustum* frustums, unsigned int numFrustums, std::vector<unsigned int>& visible) const {
+		visible.clear();
+		cull(frustums, numFrustums, 0, size(), visible);
+	}
+
+	// Append the visible spheres of first ~ last - 1, so the chunks of a large set can be culled by different threads.
+	void cull(const Frustum* frustums, unsigned int numFrustums, unsigned int first, unsigned int last, std::vector<unsigned int>& visible) const {
+		unsigned int count = last;
+		unsigned int i = first;
+
+#ifdef FRUSTUM_USE_SSE
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps(&X[i]);
+			__m128 y = _mm_loadu_ps(&Y[i]);
+			__m128 z = _mm_loadu_ps(&Z[i]);
+			__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&Radius[i]));
+
+			__m128 touched = _mm_setzero_ps();
+			for (unsigned int f = 0; f < numFrustums; f++) {
+				__m128 inside = _mm_cmpeq_ps(x, x);
+				for (int p = 0; p < 6; p++) {
+					const glm::vec4& plane = frustums[f].Planes[p];
+					__m128 distance = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+						_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+					inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negRadius));
+				}
+				touched = _mm_or_ps(touched, inside);
+			}
+
+			int mask = _mm_movemask_ps(touched);
+			for (unsigned int j = 0; j < 4; j++) {
+				if (mask & (1 << j)) {
+					visible.push_back(i + j);
+				}
+			}
+		}
+#endif
+
+		// Remaining spheres (or all of them without SSE)
+		for (; i < count; i++) {
+			bool touched = false;
+			for (unsigned int f = 0; f < numFrustums && !touched; f++) {
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; p++) {
+					const glm::vec4& plane = frustums[f].Planes[p];
+					inside = plane.x * X[i] + plane.y * Y[i] + plane.z * Z[i] + plane.w > -Radius[i];
+				}
+				touched = inside;
+			}
+			if (touched) {
+				visible.push_back(i);
+			}
+		}
+	}
+};
+
+#endif // !FRUSTUM_H
\ No newline at end of file
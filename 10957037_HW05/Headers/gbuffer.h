@@ -0,0 +1,135 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <glad/glad.h>
+
+#include "../Headers/logging.h"
+
+// Texture units of the G-buffer, the samplers are set once in ShaderVariants
+enum GBuffer_Unit {
+	GBUFFER_ALBEDO_UNIT = 8,
+	GBUFFER_AMBIENT_UNIT = 9,
+	GBUFFER_SPECULAR_UNIT = 10,
+	GBUFFER_NORMAL_UNIT = 11,
+	GBUFFER_DEPTH_UNIT = 12
+};
+
+// Render targets of deferred shading, must match the outputs of the DEFERRED variant of lighting.fs:
+//   albedo   (RGBA8)    rgb: diffuse
+//   ambient  (RGBA8)    rgb: ambient, a: emission
+//   specular (RGBA8)    rgb: specular
+//   normal   (RGBA16F)  xyz: world space normal, w: shininess
+// The world position is rebuilt from the depth texture, so it doesn't need a target of its own.
+class GBuffer {
+public:
+	unsigned int FBO;
+	int Width;
+	int Height;
+
+	GBuffer() : FBO(0), Width(0), Height(0), depthTexture(0), quadVAO(0), quadVBO(0) {
+		for (unsigned int i = 0; i < 4; i++) {
+			colorTextures[i] = 0;
+		}
+	}
+
+	// (Re)create the targets when the size of the window changes, must be called after the OpenGL context has been created.
+	void resize(int width, int height) {
+		if (FBO != 0 && width == Width && height == Height) {
+			return;
+		}
+		releaseTargets();
+		Width = width;
+		Height = height;
+
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		createTarget(colorTextures[0], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0);
+		createTarget(colorTextures[1], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT1);
+		createTarget(colorTextures[2], GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT2);
+		createTarget(colorTextures[3], GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_COLOR_ATTACHMENT3);
+		createTarget(depthTexture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, GL_DEPTH_ATTACHMENT);
+
+		unsigned int attachments[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+		glDrawBuffers(4, attachments);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			logging::loggingMessage(logging::LogType::ERROR, "G-buffer framebuffer is not complete.");
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// Start the geometry pass. The viewport is left alone, so every monitor writes to its own rectangle.
+	void bindGeometryPass() {
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	void bindTextures() {
+		for (unsigned int i = 0; i < 4; i++) {
+			glActiveTexture(GL_TEXTURE0 + GBuffer_Unit::GBUFFER_ALBEDO_UNIT + i);
+			glBindTexture(GL_TEXTURE_2D, colorTextures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0 + GBuffer_Unit::GBUFFER_DEPTH_UNIT);
+		glBindTexture(GL_TEXTURE_2D, depthTexture);
+	}
+
+	// One triangle covering the viewport, its positions are already in clip space.
+	void drawQuad() {
+		if (quadVAO == 0) {
+			float vertices[] = {
+				-1.0f, -1.0f, 0.0f,
+				 3.0f, -1.0f, 0.0f,
+				-1.0f,  3.0f, 0.0f,
+			};
+			glGenVertexArrays(1, &quadVAO);
+			glGenBuffers(1, &quadVBO);
+			glBindVertexArray(quadVAO);
+			glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+			glBindVertexArray(0);
+		}
+		glBindVertexArray(quadVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+	}
+
+	void release() {
+		releaseTargets();
+		glDeleteVertexArrays(1, &quadVAO);
+		glDeleteBuffers(1, &quadVBO);
+		quadVAO = 0;
+		quadVBO = 0;
+	}
+
+private:
+	unsigned int colorTextures[4];
+	unsigned int depthTexture;
+	unsigned int quadVAO, quadVBO;
+
+	// The targets are read with texelFetch(), so they have no mipmaps.
+	void createTarget(unsigned int& texture, GLint internalFormat, GLenum format, GLenum type, GLenum attachment) {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, Width, Height, 0, format, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	void releaseTargets() {
+		if (FBO == 0) {
+			return;
+		}
+		glDeleteTextures(4, colorTextures);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+	}
+};
+
+#endif // !GBUFFER_H
\ No newline at end of file
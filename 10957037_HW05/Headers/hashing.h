@@ -0,0 +1,25 @@
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 64-bit FNV-1a, shared by the asset pack and the program and texture caches so their keys stay the same.
+inline uint64_t fnv1a(const std::string& key) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : key) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Cache entries are named by the hash of everything that changes their content.
+inline std::string getCacheFile(const std::string& directory, const std::string& key, const std::string& extension) {
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)fnv1a(key));
+	return directory + name + extension;
+}
+
+#endif // !HASHING_H
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef INSTANCEDMESH_H
+#define INSTANCEDMESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+// Per-instance data, the layout must match location 6 ~ 7 in lighting.vs and gouraud.vs
+struct MeshInstance {
+	glm::vec4 Transform;	// xyz: position, w: uniform scale
+	glm::vec2 Params;		// x: bobbing amplitude, y: index into the MaterialData block
+};
+
+// Draws every instance of an indexed mesh (e.g. the cube or the sphere) with one call.
+class InstancedMesh {
+public:
+	unsigned int VAO;
+	unsigned int InstanceVBO;
+	unsigned int IndexCount;
+	unsigned int DrawCount;
+	std::vector<MeshInstance> Instances;
+
+	InstancedMesh() : VAO(0), InstanceVBO(0), IndexCount(0), DrawCount(0), capacity(0) {}
+
+	// Must be called after the OpenGL context has been created.
+	// The vertex buffer is shared with the mesh, it must hold positions, normals and texture coords.
+	void setup(unsigned int vbo, unsigned int ebo, unsigned int indexCount) {
+		IndexCount = indexCount;
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &InstanceVBO);
+		glBindVertexArray(VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+
+			glBindBuffer(GL_ARRAY_BUFFER, InstanceVBO);
+			glEnableVertexAttribArray(6);
+			glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)offsetof(MeshInstance, Transform));
+			glVertexAttribDivisor(6, 1);
+			glEnableVertexAttribArray(7);
+			glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (void*)offsetof(MeshInstance, Params));
+			glVertexAttribDivisor(7, 1);
+		glBindVertexArray(0);
+	}
+
+	void addInstance(glm::vec3 position, float scale, float bobbing, unsigned int material) {
+		Instances.push_back({ glm::vec4(position, scale), glm::vec2(bobbing, (float)material) });
+	}
+
+	void clear() {
+		Instances.clear();
+	}
+
+	// Upload all instances to the GPU, only needs to be called when the instances changed.
+	void upload() {
+		uploadData(Instances);
+	}
+
+	// Upload only the given instances (e.g. the ones left after frustum culling).
+	void upload(const std::vector<unsigned int>& indices) {
+		gather(indices);
+		uploadGathered();
+	}
+
+	// Copy the given instances into the upload list, without any OpenGL call, so it can run on a job of the job system.
+	void gather(const std::vector<unsigned int>& indices) {
+		visibleInstances.clear();
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			visibleInstances.push_back(Instances[indices[i]]);
+		}
+	}
+
+	// Upload the instances of the last gather(), on the thread owning the OpenGL context.
+	void uploadGathered() {
+		uploadData(visibleInstances);
+	}
+
+	void draw() {
+		if (DrawCount == 0) {
+			return;
+		}
+		glBindVertexArray(VAO);
+		glDrawElementsInstanced(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, 0, (GLsizei)DrawCount);
+		glBindVertexArray(0);
+	}
+
+	void release() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &InstanceVBO);
+	}
+
+private:
+	unsigned int capacity;
+	std::vector<MeshInstance> visibleInstances;
+
+	void uploadData(const std::vector<MeshInstance>& instances) {
+		glBindBuffer(GL_ARRAY_BUFFER, InstanceVBO);
+		if (instances.size() > capacity) {
+			capacity = (unsigned int)instances.size();
+			glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(MeshInstance), instances.data(), GL_DYNAMIC_DRAW);
+		} else {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(MeshInstance), instances.data());
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		DrawCount = (unsigned int)instances.size();
+	}
+};
+
+#endif // !INSTANCEDMESH_H
\ No newline at end of file
@@ -0,0 +1,240 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include "../Headers/logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Job;
+
+// Number of unfinished jobs of a group, JobSystem::wait() returns once it drops to 0.
+// A group can be waited on by a later job, which is how the steps of a task graph are chained.
+class JobCounter {
+public:
+	JobCounter() : pending(0) {}
+
+	bool done() const {
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class JobSystem;
+	std::atomic<int> pending;
+};
+
+// Work-stealing job system. Every thread owns a deque: it pushes and pops its own jobs at the back,
+// idle threads steal the oldest jobs from the front of the others. The main thread owns deque 0
+// and runs jobs while it waits, so it helps instead of blocking. OpenGL calls must stay on the main thread.
+class JobSystem {
+public:
+	// Statistics, accumulated until resetStats()
+	std::atomic<unsigned int> Executed;
+	std::atomic<unsigned int> Stolen;
+
+	JobSystem() : Executed(0), Stolen(0), running(false), queued(0) {}
+
+	~JobSystem() {
+		release();
+	}
+
+	// One worker per core, the main thread takes the last one.
+	static unsigned int defaultWorkers() {
+		unsigned int cores = std::thread::hardware_concurrency();
+		return (cores > 1) ? cores - 1 : 0;
+	}
+
+	// Start the workers, with 0 workers every job runs on the main thread inside wait().
+	void setup(unsigned int numWorkers) {
+		release();
+		queues.clear();
+		for (unsigned int i = 0; i <= numWorkers; i++) {
+			queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+		}
+		running = true;
+		for (unsigned int i = 1; i <= numWorkers; i++) {
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+		}
+		logging::loggingMessage(logging::LogType::DEBUG, "Job system started with " + std::to_string(numWorkers) + " workers");
+	}
+
+	unsigned int getWorkers() const {
+		return (unsigned int)workers.size();
+	}
+
+	// Queue a job on the deque of the calling thread, "counter" drops back once it has run.
+	void run(Job job, JobCounter& counter) {
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+		WorkQueue& queue = *queues[threadIndex()];
+		{
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			queue.Tasks.push_back(Task{ job, &counter });
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			queued++;
+		}
+		wake.notify_one();
+	}
+
+	// Queue a job that starts once every job of "dependency" is done.
+	void runAfter(JobCounter& dependency, Job job, JobCounter& counter) {
+		run([this, &dependency, job]() {
+			wait(dependency);
+			job();
+		}, counter);
+	}
+
+	// Run the queued jobs (own ones first, then stolen ones) until every job of "counter" is done.
+	void wait(JobCounter& counter) {
+		unsigned int index = threadIndex();
+		while (!counter.done()) {
+			Task task;
+			if (pop(index, task) || steal(index, task)) {
+				execute(task);
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	// Split 0 ~ count - 1 into ranges of "grain" items and call func(begin, end) for each of them in parallel.
+	// Returns once every range is done, so "func" may reference locals of the caller.
+	template <typename Function>
+	void parallelFor(unsigned int count, unsigned int grain, const Function& func) {
+		grain = std::max(grain, 1u);
+		if (count <= grain || queues.size() == 1) {
+			func(0u, count);
+			return;
+		}
+		JobCounter counter;
+		for (unsigned int begin = 0; begin < count; begin += grain) {
+			unsigned int end = std::min(begin + grain, count);
+			run([&func, begin, end]() {
+				func(begin, end);
+			}, counter);
+		}
+		wait(counter);
+	}
+
+	void resetStats() {
+		Executed = 0;
+		Stolen = 0;
+	}
+
+	void release() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			running = false;
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+		workers.clear();
+	}
+
+private:
+	struct Task {
+		Job Function;
+		JobCounter* Counter;
+	};
+
+	struct WorkQueue {
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+	};
+
+	// Deque of the calling thread, threads of other job systems use the one of the main thread
+	struct ThreadSlot {
+		const JobSystem* System;
+		unsigned int Index;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+	bool running;
+	unsigned int queued;		// jobs in every deque, guarded by sleepMutex
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	static ThreadSlot& currentSlot() {
+		static thread_local ThreadSlot slot = { NULL, 0 };
+		return slot;
+	}
+
+	unsigned int threadIndex() const {
+		const ThreadSlot& slot = currentSlot();
+		return (slot.System == this) ? slot.Index : 0;
+	}
+
+	void workerLoop(unsigned int index) {
+		currentSlot() = { this, index };
+		while (true) {
+			Task task;
+			if (pop(index, task) || steal(index, task)) {
+				execute(task);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this]() {
+				return !running || queued > 0;
+			});
+			if (!running) {
+				return;
+			}
+		}
+	}
+
+	// Newest job of the own deque, it is the most likely to still be in the cache.
+	bool pop(unsigned int index, Task& task) {
+		WorkQueue& queue = *queues[index];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if (queue.Tasks.empty()) {
+			return false;
+		}
+		task = queue.Tasks.back();
+		queue.Tasks.pop_back();
+		taken();
+		return true;
+	}
+
+	// Oldest job of another deque, the victims are visited round-robin from the next thread on.
+	bool steal(unsigned int index, Task& task) {
+		unsigned int count = (unsigned int)queues.size();
+		for (unsigned int i = 1; i < count; i++) {
+			WorkQueue& queue = *queues[(index + i) % count];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (queue.Tasks.empty()) {
+				continue;
+			}
+			task = queue.Tasks.front();
+			queue.Tasks.pop_front();
+			taken();
+			Stolen++;
+			return true;
+		}
+		return false;
+	}
+
+	void taken() {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queued--;
+	}
+
+	void execute(Task& task) {
+		task.Function();
+		Executed++;
+		task.Counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+};
+
+#endif // !JOBSYSTEM_H
\ No newline at end of file
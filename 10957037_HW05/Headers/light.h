@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
+#include <cfloat>
 
 enum Light_Caster {
 	DIRECTION,
@@ -24,6 +25,24 @@ const float CUTOFF = 12.0f;
 const float OUTERCUTOFF = 15.0f;
 const float EXPONENT = 128.0f;
 
+// std140 layout of the Light struct in the FrameData uniform block.
+struct LightData {
+	glm::vec3 Position;
+	float Constant;
+	glm::vec3 Direction;
+	float Linear;
+	glm::vec3 Ambient;
+	float Quadratic;
+	glm::vec3 Diffuse;
+	float Cutoff;
+	glm::vec3 Specular;
+	float OuterCutoff;
+	float Exponent;
+	int Enable;
+	int Caster;
+	float Padding;
+};
+
 class Light
 {
 public:
@@ -66,6 +85,42 @@ public:
 		Direction = direction;
 		Enable = enable;
 	}
+
+	// The cutoff angles are converted to cosine here, so the shader can compare them with dot().
+	LightData getData() const {
+		LightData data;
+		data.Position = Position;
+		data.Constant = Constant;
+		data.Direction = Direction;
+		data.Linear = Linear;
+		data.Ambient = Ambient;
+		data.Quadratic = Quadratic;
+		data.Diffuse = Diffuse;
+		data.Cutoff = glm::cos(glm::radians(Cutoff));
+		data.Specular = Specular;
+		data.OuterCutoff = glm::cos(glm::radians(OuterCutoff));
+		data.Exponent = Exponent;
+		data.Enable = Enable;
+		data.Caster = Caster;
+		data.Padding = 0.0f;
+		return data;
+	}
+
+	// Distance where the attenuated light drops below "threshold" of full intensity, used to bin the light into clusters.
+	float getRadius(float threshold = 5.0f / 256.0f) const {
+		glm::vec3 color = Ambient + Diffuse + Specular;
+		float target = glm::max(color.x, glm::max(color.y, color.z)) / threshold;
+		if (target <= Constant) {
+			return 0.0f;
+		}
+		if (Quadratic > 0.0f) {
+			return (-Linear + glm::sqrt(Linear * Linear - 4.0f * Quadratic * (Constant - target))) / (2.0f * Quadratic);
+		}
+		if (Linear > 0.0f) {
+			return (target - Constant) / Linear;
+		}
+		return FLT_MAX;
+	}
 private:
 };
 
@@ -0,0 +1,208 @@
+#ifndef LIGHTCLUSTERS_H
+#define LIGHTCLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/light.h"
+
+#include <cmath>
+#include <vector>
+
+// Size of the froxel grid, must match CLUSTER_X / Y / Z in lighting.fs
+const unsigned int CLUSTER_X = 16;
+const unsigned int CLUSTER_Y = 9;
+const unsigned int CLUSTER_Z = 24;
+const unsigned int NUM_CLUSTERS = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+// Texture units of the buffers, the samplers are set once in ShaderVariants
+enum Cluster_Unit {
+	CLUSTER_LIGHTS_UNIT = 5,
+	CLUSTER_GRID_UNIT = 6,
+	CLUSTER_INDICES_UNIT = 7
+};
+
+// Point and spot lights binned into a view-space froxel grid, rebuilt for every viewport.
+// The grid is split evenly on screen and exponentially in depth, every cluster keeps a compact
+// list of the lights whose attenuation radius reaches it, so a fragment only loops over those.
+// OpenGL 3.3 has no shader storage buffers, so the data is read through buffer textures.
+class LightClusters {
+public:
+	float Near;
+	float Far;
+	unsigned int Lights;
+	unsigned int Indices;
+
+	LightClusters() : Near(0.1f), Far(250.0f), Lights(0), Indices(0), lightBuffer(0), lightTexture(0), gridBuffer(0), gridTexture(0), indexBuffer(0), indexTexture(0) {}
+
+	// Must be called after the OpenGL context has been created.
+	void setup() {
+		createBuffer(lightBuffer, lightTexture, GL_RGBA32F);
+		createBuffer(gridBuffer, gridTexture, GL_RG32UI);
+		createBuffer(indexBuffer, indexTexture, GL_R32UI);
+	}
+
+	// Recover the near and far planes of a perspective or orthogonal projection, the depth slices are spread between them.
+	static glm::vec2 getClipPlanes(const glm::mat4& projection) {
+		if (projection[2][3] != 0.0f) {
+			return glm::vec2(projection[3][2] / (projection[2][2] - 1.0f), projection[3][2] / (projection[2][2] + 1.0f));
+		}
+		// Orthogonal projections may start at 0, which can't be sliced exponentially
+		return glm::vec2(glm::max((projection[3][2] + 1.0f) / projection[2][2], 0.01f), (projection[3][2] - 1.0f) / projection[2][2]);
+	}
+
+	// Bin the lights for one viewport and upload the result.
+	void build(const std::vector<const Light*>& lights, const glm::mat4& view, const glm::mat4& projection) {
+		build(lights, &view, &projection, 1);
+	}
+
+	// Bin the lights for "numViews" viewports drawn in one pass, the grid of view v starts at cluster v * NUM_CLUSTERS.
+	// The lights are shared by every view, each one is uploaded once.
+	void build(const std::vector<const Light*>& lights, const glm::mat4* views, const glm::mat4* projections, unsigned int numViews) {
+		lightData.clear();
+		lightIndices.assign(lights.size(), ~0u);
+		grid.resize(NUM_CLUSTERS * 2 * numViews);
+		indices.clear();
+
+		for (unsigned int v = 0; v < numViews; v++) {
+			binLights(lights, views[v], projections[v]);
+
+			// Flatten the lists, every cluster keeps an offset into the index list and a count
+			unsigned int* cells = &grid[NUM_CLUSTERS * 2 * v];
+			for (unsigned int i = 0; i < NUM_CLUSTERS; i++) {
+				cells[i * 2] = (unsigned int)indices.size();
+				cells[i * 2 + 1] = (unsigned int)clusters[i].size();
+				indices.insert(indices.end(), clusters[i].begin(), clusters[i].end());
+			}
+		}
+		Lights = (unsigned int)lightData.size();
+		Indices = (unsigned int)indices.size();
+
+		// Buffer textures must not be empty
+		if (lightData.empty()) {
+			lightData.push_back(LightData());
+		}
+		if (indices.empty()) {
+			indices.push_back(0);
+		}
+		upload(lightBuffer, lightData.data(), lightData.size() * sizeof(LightData));
+		upload(gridBuffer, grid.data(), grid.size() * sizeof(unsigned int));
+		upload(indexBuffer, indices.data(), indices.size() * sizeof(unsigned int));
+	}
+
+	void bind() {
+		glActiveTexture(GL_TEXTURE0 + Cluster_Unit::CLUSTER_LIGHTS_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+		glActiveTexture(GL_TEXTURE0 + Cluster_Unit::CLUSTER_GRID_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+		glActiveTexture(GL_TEXTURE0 + Cluster_Unit::CLUSTER_INDICES_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+	}
+
+	void release() {
+		glDeleteTextures(1, &lightTexture);
+		glDeleteTextures(1, &gridTexture);
+		glDeleteTextures(1, &indexTexture);
+		glDeleteBuffers(1, &lightBuffer);
+		glDeleteBuffers(1, &gridBuffer);
+		glDeleteBuffers(1, &indexBuffer);
+	}
+
+private:
+	unsigned int lightBuffer, lightTexture;
+	unsigned int gridBuffer, gridTexture;
+	unsigned int indexBuffer, indexTexture;
+
+	std::vector<unsigned int> clusters[NUM_CLUSTERS];
+	std::vector<LightData> lightData;
+	std::vector<unsigned int> lightIndices;		// index of every light in lightData, ~0 until a view reaches it
+	std::vector<unsigned int> grid;
+	std::vector<unsigned int> indices;
+
+	// Fill the clusters of one view with the lights whose sphere reaches them.
+	void binLights(const std::vector<const Light*>& lights, const glm::mat4& view, const glm::mat4& projection) {
+		glm::vec2 planes = getClipPlanes(projection);
+		Near = planes.x;
+		Far = planes.y;
+		float logDepth = std::log(Far / Near);
+
+		for (unsigned int i = 0; i < NUM_CLUSTERS; i++) {
+			clusters[i].clear();
+		}
+
+		for (unsigned int i = 0; i < lights.size(); i++) {
+			const Light& light = *lights[i];
+			float radius = light.getRadius();
+			glm::vec3 center = glm::vec3(view * glm::vec4(light.Position, 1.0f));
+
+			// Depth range of the sphere, skip the lights completely outside the clip planes
+			float minDepth = -center.z - radius;
+			float maxDepth = -center.z + radius;
+			if (maxDepth < Near || minDepth > Far) {
+				continue;
+			}
+			unsigned int z0 = depthSlice(glm::max(minDepth, Near), logDepth);
+			unsigned int z1 = depthSlice(glm::min(maxDepth, Far), logDepth);
+
+			// Screen rectangle of the sphere's bounding box, clipped to the near plane
+			glm::vec2 minNdc(1.0f), maxNdc(-1.0f);
+			for (unsigned int corner = 0; corner < 8; corner++) {
+				glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+				glm::vec3 point = center + offset;
+				point.z = glm::min(point.z, -Near);
+				glm::vec4 clip = projection * glm::vec4(point, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+				minNdc = glm::min(minNdc, ndc);
+				maxNdc = glm::max(maxNdc, ndc);
+			}
+			if (maxNdc.x < -1.0f || maxNdc.y < -1.0f || minNdc.x > 1.0f || minNdc.y > 1.0f) {
+				continue;
+			}
+			unsigned int x0 = tile(minNdc.x, CLUSTER_X), x1 = tile(maxNdc.x, CLUSTER_X);
+			unsigned int y0 = tile(minNdc.y, CLUSTER_Y), y1 = tile(maxNdc.y, CLUSTER_Y);
+
+			if (lightIndices[i] == ~0u) {
+				lightIndices[i] = (unsigned int)lightData.size();
+				lightData.push_back(light.getData());
+			}
+			unsigned int index = lightIndices[i];
+			for (unsigned int z = z0; z <= z1; z++) {
+				for (unsigned int y = y0; y <= y1; y++) {
+					for (unsigned int x = x0; x <= x1; x++) {
+						clusters[(z * CLUSTER_Y + y) * CLUSTER_X + x].push_back(index);
+					}
+				}
+			}
+		}
+	}
+
+	unsigned int depthSlice(float depth, float logDepth) const {
+		int slice = (int)(std::log(depth / Near) / logDepth * CLUSTER_Z);
+		return (unsigned int)glm::clamp(slice, 0, (int)CLUSTER_Z - 1);
+	}
+
+	unsigned int tile(float ndc, unsigned int count) const {
+		int index = (int)((ndc * 0.5f + 0.5f) * count);
+		return (unsigned int)glm::clamp(index, 0, (int)count - 1);
+	}
+
+	void createBuffer(unsigned int& buffer, unsigned int& texture, GLenum format) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// Orphan the old storage, the draws of the previous viewport may still read it
+	void upload(unsigned int buffer, const void* data, size_t size) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+};
+
+#endif // !LIGHTCLUSTERS_H
\ No newline at end of file
@@ -0,0 +1,143 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#ifdef _WIN32
+// The only place <windows.h> is included. NOGDI keeps wingdi.h from defining ERROR, which would break
+// logging::LogType::ERROR, and the near and far of minwindef.h would empty the parameters of that name.
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef NOGDI
+#define NOGDI
+#endif
+#include <windows.h>
+#undef near
+#undef far
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file. The pages are read from disk the first time they are touched,
+// so the data can be copied straight from the file cache without going through a read buffer.
+class MappedFile {
+public:
+	MappedFile() : data(NULL), size(0) {
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		file = -1;
+#endif
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// False when the file is missing or empty.
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			close();
+			return false;
+		}
+		data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		size = (size_t)fileSize.QuadPart;
+#else
+		file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(file, &info) != 0 || info.st_size == 0) {
+			close();
+			return false;
+		}
+		void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		data = (view == MAP_FAILED) ? NULL : (const unsigned char*)view;
+		size = (size_t)info.st_size;
+#endif
+		if (data == NULL) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (data != NULL) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping != NULL) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		if (data != NULL) {
+			munmap((void*)data, size);
+		}
+		if (file >= 0) {
+			::close(file);
+		}
+		file = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+
+	// Touch one byte of every page, so the disk reads happen on the calling thread instead of the first user.
+	void prefetch() const {
+		volatile unsigned char sum = 0;
+		for (size_t i = 0; i < size; i += 4096) {
+			sum += data[i];
+		}
+	}
+
+	const unsigned char* getData() const {
+		return data;
+	}
+
+	size_t getSize() const {
+		return size;
+	}
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+};
+
+#endif // !MAPPEDFILE_H
\ No newline at end of file
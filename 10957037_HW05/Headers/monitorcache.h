@@ -0,0 +1,159 @@
+#ifndef MONITORCACHE_H
+#define MONITORCACHE_H
+
+#include <glad/glad.h>
+
+#include "../Headers/logging.h"
+
+#include <string>
+
+// The ortho monitors of the quad view (X, Y and Z) are cached.
+const int NUM_CACHED_MONITORS = 3;
+
+// Texture unit of the cached image while it is composited
+const unsigned int MONITOR_CACHE_UNIT = 13;
+
+// Offscreen images of the auxiliary monitors, each one is redrawn at a reduced rate and resolution
+// and composited from its texture on the other frames. At most one monitor is redrawn per frame,
+// so the cost of the quad view stays close to one full view.
+class MonitorCache {
+public:
+	int Width;
+	int Height;
+	float RefreshRate;		// redraws per second of every monitor
+
+	MonitorCache() : Width(0), Height(0), RefreshRate(10.0f), quadVAO(0), quadVBO(0) {
+		for (int i = 0; i < NUM_CACHED_MONITORS; i++) {
+			framebuffers[i] = 0;
+			textures[i] = 0;
+			depthBuffers[i] = 0;
+			lastRefresh[i] = 0.0f;
+			valid[i] = false;
+		}
+	}
+
+	// (Re)create the targets when the size changes, must be called after the OpenGL context has been created.
+	void resize(int width, int height) {
+		if (framebuffers[0] != 0 && width == Width && height == Height) {
+			return;
+		}
+		releaseTargets();
+		Width = width;
+		Height = height;
+
+		for (int i = 0; i < NUM_CACHED_MONITORS; i++) {
+			glGenFramebuffers(1, &framebuffers[i]);
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+
+			glGenTextures(1, &textures[i]);
+			glBindTexture(GL_TEXTURE_2D, textures[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Width, Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenRenderbuffers(1, &depthBuffers[i]);
+			glBindRenderbuffer(GL_RENDERBUFFER, depthBuffers[i]);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffers[i]);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				logging::loggingMessage(logging::LogType::ERROR, "Monitor cache framebuffer " + std::to_string(i) + " is not complete.");
+			}
+			valid[i] = false;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// The monitor to redraw this frame: a monitor without an image first, otherwise the one
+	// waiting the longest once its refresh period has passed. -1 when every image is recent enough.
+	int nextRefresh(float time) const {
+		int next = -1;
+		for (int i = 0; i < NUM_CACHED_MONITORS; i++) {
+			if (!valid[i]) {
+				return i;
+			}
+			if (time - lastRefresh[i] >= 1.0f / RefreshRate && (next == -1 || lastRefresh[i] < lastRefresh[next])) {
+				next = i;
+			}
+		}
+		return next;
+	}
+
+	// Start redrawing a monitor, the viewport covers its whole image.
+	void bindTarget(int monitor, float time) {
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[monitor]);
+		glViewport(0, 0, Width, Height);
+		lastRefresh[monitor] = time;
+		valid[monitor] = true;
+	}
+
+	unsigned int getFramebuffer(int monitor) const {
+		return framebuffers[monitor];
+	}
+
+	// The cached image of a monitor is stretched over the current viewport.
+	void draw(int monitor, unsigned int unit) {
+		if (quadVAO == 0) {
+			float vertices[] = {
+				-1.0f, -1.0f, 0.0f,
+				 3.0f, -1.0f, 0.0f,
+				-1.0f,  3.0f, 0.0f,
+			};
+			glGenVertexArrays(1, &quadVAO);
+			glGenBuffers(1, &quadVBO);
+			glBindVertexArray(quadVAO);
+			glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+			glBindVertexArray(0);
+		}
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, textures[monitor]);
+		glBindVertexArray(quadVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+	}
+
+	// Redraw every monitor on the next frames, e.g. when the layout of the quad view changes.
+	void invalidate() {
+		for (int i = 0; i < NUM_CACHED_MONITORS; i++) {
+			valid[i] = false;
+		}
+	}
+
+	void release() {
+		releaseTargets();
+		glDeleteVertexArrays(1, &quadVAO);
+		glDeleteBuffers(1, &quadVBO);
+		quadVAO = 0;
+		quadVBO = 0;
+	}
+
+private:
+	unsigned int framebuffers[NUM_CACHED_MONITORS];
+	unsigned int textures[NUM_CACHED_MONITORS];
+	unsigned int depthBuffers[NUM_CACHED_MONITORS];
+	float lastRefresh[NUM_CACHED_MONITORS];
+	bool valid[NUM_CACHED_MONITORS];
+	unsigned int quadVAO, quadVBO;
+
+	void releaseTargets() {
+		if (framebuffers[0] == 0) {
+			return;
+		}
+		glDeleteFramebuffers(NUM_CACHED_MONITORS, framebuffers);
+		glDeleteTextures(NUM_CACHED_MONITORS, textures);
+		glDeleteRenderbuffers(NUM_CACHED_MONITORS, depthBuffers);
+		for (int i = 0; i < NUM_CACHED_MONITORS; i++) {
+			framebuffers[i] = 0;
+		}
+	}
+};
+
+#endif // !MONITORCACHE_H
\ No newline at end of file
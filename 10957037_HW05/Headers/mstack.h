@@ -31,6 +31,14 @@ public:
 		stack[0] = glm::mat4(1.0f);
 	}
 
+	// The recording jobs create a stack per region and frame
+	~StackArray() {
+		delete[] stack;
+	}
+
+	StackArray(const StackArray&) = delete;
+	StackArray& operator=(const StackArray&) = delete;
+
 	void push() {
 		if (index == capacity - 1) {
 			doubleCapacity();
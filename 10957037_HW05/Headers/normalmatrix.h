@@ -0,0 +1,98 @@
+#ifndef NORMALMATRIX_H
+#define NORMALMATRIX_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE__)
+#include <xmmintrin.h>
+#define NORMALMATRIX_USE_SSE
+#endif
+
+// Relative tolerance of the uniform scale test
+const float NORMAL_MATRIX_EPSILON = 1e-4f;
+
+#ifdef NORMALMATRIX_USE_SSE
+// a x b, the w component stays 0
+inline __m128 crossSSE(__m128 a, __m128 b) {
+	__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// (a0 . b0, a1 . b1, a2 . b2, 0) for vectors with w = 0
+inline __m128 dot3x3SSE(__m128 a0, __m128 b0, __m128 a1, __m128 b1, __m128 a2, __m128 b2) {
+	__m128 x = _mm_mul_ps(a0, b0), y = _mm_mul_ps(a1, b1), z = _mm_mul_ps(a2, b2), w = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	return _mm_add_ps(_mm_add_ps(x, y), z);
+}
+#endif
+
+// Normal matrices of a batch of model matrices, computed on the CPU once per object instead of once per vertex.
+// The shaders normalize the normal afterwards, so a rotation with a uniform scale keeps mat3(model) and skips the inverse.
+// Any other matrix gets transpose(inverse(mat3(model))), which is the cofactor matrix divided by the determinant.
+inline void computeNormalMatrices(const glm::mat4* models, glm::mat3* normals, unsigned int count) {
+#ifdef NORMALMATRIX_USE_SSE
+	const __m128 mask = _mm_setr_ps(1.0f, 1.0f, 1.0f, 0.0f);
+	for (unsigned int i = 0; i < count; i++) {
+		__m128 c0 = _mm_mul_ps(_mm_loadu_ps(&models[i][0][0]), mask);
+		__m128 c1 = _mm_mul_ps(_mm_loadu_ps(&models[i][1][0]), mask);
+		__m128 c2 = _mm_mul_ps(_mm_loadu_ps(&models[i][2][0]), mask);
+
+		// Squared lengths of the columns and the dot products between them
+		float lengths[4], dots[4];
+		_mm_storeu_ps(lengths, dot3x3SSE(c0, c0, c1, c1, c2, c2));
+		_mm_storeu_ps(dots, dot3x3SSE(c0, c1, c1, c2, c2, c0));
+		float tolerance = NORMAL_MATRIX_EPSILON * lengths[0];
+		bool uniformScale = std::fabs(lengths[0] - lengths[1]) <= tolerance && std::fabs(lengths[0] - lengths[2]) <= tolerance &&
+			std::fabs(dots[0]) <= tolerance && std::fabs(dots[1]) <= tolerance && std::fabs(dots[2]) <= tolerance;
+
+		__m128 n0 = c0, n1 = c1, n2 = c2;
+		if (!uniformScale) {
+			// Cofactor columns, the determinant is c0 . (c1 x c2)
+			__m128 x0 = crossSSE(c1, c2);
+			__m128 x1 = crossSSE(c2, c0);
+			__m128 x2 = crossSSE(c0, c1);
+			float determinant[4];
+			_mm_storeu_ps(determinant, dot3x3SSE(c0, x0, c0, x0, c0, x0));
+			if (std::fabs(determinant[0]) > 1e-12f) {
+				__m128 scale = _mm_set1_ps(1.0f / determinant[0]);
+				n0 = _mm_mul_ps(x0, scale);
+				n1 = _mm_mul_ps(x1, scale);
+				n2 = _mm_mul_ps(x2, scale);
+			}
+		}
+
+		// glm::mat3 is 9 floats, so the last column can't be written with a 4 float store
+		float column[4];
+		_mm_storeu_ps(&normals[i][0][0], n0);
+		_mm_storeu_ps(&normals[i][1][0], n1);
+		_mm_storeu_ps(column, n2);
+		memcpy(&normals[i][2][0], column, 3 * sizeof(float));
+	}
+#else
+	for (unsigned int i = 0; i < count; i++) {
+		glm::mat3 model(models[i]);
+		float length = glm::dot(model[0], model[0]);
+		float tolerance = NORMAL_MATRIX_EPSILON * length;
+		bool uniformScale = std::fabs(length - glm::dot(model[1], model[1])) <= tolerance && std::fabs(length - glm::dot(model[2], model[2])) <= tolerance &&
+			std::fabs(glm::dot(model[0], model[1])) <= tolerance && std::fabs(glm::dot(model[1], model[2])) <= tolerance && std::fabs(glm::dot(model[2], model[0])) <= tolerance;
+		if (uniformScale || std::fabs(glm::determinant(model)) <= 1e-12f) {
+			normals[i] = model;
+		} else {
+			normals[i] = glm::transpose(glm::inverse(model));
+		}
+	}
+#endif
+}
+
+inline glm::mat3 computeNormalMatrix(const glm::mat4& model) {
+	glm::mat3 normal;
+	computeNormalMatrices(&model, &normal, 1);
+	return normal;
+}
+
+#endif // !NORMALMATRIX_H
\ No newline at end of file
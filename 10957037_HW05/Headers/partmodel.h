@@ -0,0 +1,90 @@
+#ifndef PARTMODEL_H
+#define PARTMODEL_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+// The layout must match location 0 ~ 2 and 8 in lighting.vs and gouraud.vs
+struct PartVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+	glm::vec2 Part;		// x: joint, y: index into the MaterialData block
+};
+
+// A hierarchical model baked into one mesh, the static parts are pre-transformed
+// and only the animated joints are sent as a small array of matrices every frame.
+class PartModel {
+public:
+	unsigned int VAO;
+	unsigned int VBO;
+	unsigned int EBO;
+	std::vector<PartVertex> Vertices;
+	std::vector<unsigned int> Indices;
+
+	// Joint 0 is the root of the model and always stays identity.
+	std::vector<glm::mat4> Joints;
+
+	PartModel() : VAO(0), VBO(0), EBO(0), Joints(1, glm::mat4(1.0f)) {}
+
+	// Reserve a joint for an animated part, the returned index is passed to addPart().
+	unsigned int addJoint() {
+		Joints.push_back(glm::mat4(1.0f));
+		return (unsigned int)Joints.size() - 1;
+	}
+
+	// "vertices" holds positions, normals and texture coords, "transform" is relative to the joint.
+	void addPart(const std::vector<float>& vertices, const std::vector<unsigned int>& indices, glm::mat4 transform, unsigned int joint, unsigned int material) {
+		glm::mat3 normalMatrix = glm::mat3(glm::transpose(glm::inverse(transform)));
+		unsigned int base = (unsigned int)Vertices.size();
+
+		for (unsigned int i = 0; i + 8 <= vertices.size(); i += 8) {
+			PartVertex vertex;
+			vertex.Position = glm::vec3(transform * glm::vec4(vertices[i], vertices[i + 1], vertices[i + 2], 1.0f));
+			vertex.Normal = glm::normalize(normalMatrix * glm::vec3(vertices[i + 3], vertices[i + 4], vertices[i + 5]));
+			vertex.TexCoords = glm::vec2(vertices[i + 6], vertices[i + 7]);
+			vertex.Part = glm::vec2((float)joint, (float)material);
+			Vertices.push_back(vertex);
+		}
+		for (unsigned int i = 0; i < indices.size(); i++) {
+			Indices.push_back(base + indices[i]);
+		}
+	}
+
+	// Must be called after the OpenGL context has been created, once every part is added.
+	void setup() {
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glBindVertexArray(VAO);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(PartVertex), Vertices.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(unsigned int), Indices.data(), GL_STATIC_DRAW);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (void*)offsetof(PartVertex, Position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (void*)offsetof(PartVertex, Normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (void*)offsetof(PartVertex, TexCoords));
+			glEnableVertexAttribArray(8);
+			glVertexAttribPointer(8, 2, GL_FLOAT, GL_FALSE, sizeof(PartVertex), (void*)offsetof(PartVertex, Part));
+		glBindVertexArray(0);
+	}
+
+	void draw() {
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, (GLsizei)Indices.size(), GL_UNSIGNED_INT, 0);
+		glBindVertexArray(0);
+	}
+
+	void release() {
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+	}
+};
+
+#endif // !PARTMODEL_H
\ No newline at end of file
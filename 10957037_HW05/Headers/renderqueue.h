@@ -0,0 +1,296 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/normalmatrix.h"
+#include "../Headers/shader.h"
+#include "../Headers/shadervariants.h"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// Passes are executed in this order, the pass is the most significant part of the sort key.
+enum Render_Pass {
+	PASS_OPAQUE			= 0,	// front-to-back, sorted by state first
+	PASS_ALPHA_TESTED	= 1,	// billboards, drawn over the opaque objects so their soft edges blend correctly
+	PASS_BLENDED		= 2,	// back-to-front, sorted by depth first
+};
+
+// Textures bound to unit 0 ~ 2, 0 leaves the unit empty.
+// A unit is only bound when the features of the packet sample it.
+struct TextureSet {
+	unsigned int Diffuse;
+	unsigned int Specular;
+	unsigned int Emission;
+};
+
+// Material set through the "material" uniform, objects reading the MaterialData block don't need one.
+struct PacketMaterial {
+	glm::vec4 Ambient;
+	glm::vec4 Diffuse;
+	glm::vec4 Specular;
+	float Shininess;
+};
+
+struct DrawPacket {
+	uint64_t Key;
+	unsigned int Features;
+	unsigned int TextureSet;	// index into the texture sets, 0 is reserved for "nothing bound"
+	unsigned int Material;		// index into the materials, 0 means no material uniform
+	std::function<void(Shader&)> Draw;
+};
+
+// A draw recorded into a CommandBuffer, the material and the textures are kept by value
+// because the texture sets and materials are only indexed once the packet reaches a RenderQueue.
+struct RecordedPacket {
+	Render_Pass Pass;
+	unsigned int Features;
+	TextureSet Textures;
+	bool HasMaterial;
+	PacketMaterial Material;
+	glm::mat4 Model;
+	std::function<void(Shader&)> Draw;
+};
+
+// Draws recorded without touching OpenGL or any shared state, so every worker thread can fill its own buffer.
+// The GL thread then merges the buffers into a RenderQueue with RenderQueue::submit(buffer), in a fixed order.
+class CommandBuffer {
+public:
+	void clear() {
+		packets.clear();
+	}
+
+	// Same arguments as RenderQueue::submit()
+	void submit(Render_Pass pass, unsigned int features, const TextureSet& textures, const PacketMaterial* material, const glm::mat4& model, std::function<void(Shader&)> draw) {
+		RecordedPacket packet;
+		packet.Pass = pass;
+		packet.Features = features;
+		packet.Textures = textures;
+		packet.HasMaterial = (material != NULL);
+		packet.Material = (material != NULL) ? *material : PacketMaterial();
+		packet.Model = model;
+		packet.Draw = draw;
+		packets.push_back(packet);
+	}
+
+	unsigned int size() const {
+		return (unsigned int)packets.size();
+	}
+
+	const RecordedPacket& operator[](unsigned int index) const {
+		return packets[index];
+	}
+
+private:
+	std::vector<RecordedPacket> packets;
+};
+
+// Sort key layout, from the most significant bit:
+//   opaque:  pass (4) | variant (16) | texture set (12) | material (8) | depth (24)
+//   blended: pass (4) | inverted depth (24) | variant (16) | texture set (12) | material (8)
+const unsigned int KEY_PASS_SHIFT = 60;
+const unsigned int KEY_DEPTH_BITS = 24;
+const uint64_t KEY_DEPTH_MAX = (1u << KEY_DEPTH_BITS) - 1;
+
+// Collects the draws of one viewport, sorts them by state and depth, then executes them
+// while skipping the texture and material changes that the previous draw already made.
+class RenderQueue {
+public:
+	// Statistics, accumulated until resetStats()
+	unsigned int Packets;
+	unsigned int TextureBinds;
+	unsigned int TextureBindsSkipped;
+	unsigned int MaterialChanges;
+
+	RenderQueue() : Packets(0), TextureBinds(0), TextureBindsSkipped(0), MaterialChanges(0), farPlane(1.0f), sorted(false) {
+		textureSets.push_back({ 0, 0, 0 });
+		materials.push_back(PacketMaterial());
+	}
+
+	// Start a new viewport, the view matrix is used to compute the depth of every packet.
+	void begin(const glm::mat4& view, float farPlane) {
+		this->view = view;
+		this->farPlane = farPlane;
+		packets.clear();
+		models.clear();
+		sorted = false;
+	}
+
+	// "features" are the material features passed to useShader(), the depth is taken at the origin of "model".
+	void submit(Render_Pass pass, unsigned int features, const TextureSet& textures, const PacketMaterial* material, const glm::mat4& model, std::function<void(Shader&)> draw) {
+		DrawPacket packet;
+		packet.Features = features;
+		packet.TextureSet = findTextureSet(textures);
+		packet.Material = (material != NULL) ? findMaterial(*material) : 0;
+		packet.Draw = draw;
+
+		float depth = -(view * model[3]).z / farPlane;
+		uint64_t quantized = (uint64_t)(glm::clamp(depth, 0.0f, 1.0f) * KEY_DEPTH_MAX);
+		uint64_t state = ((uint64_t)(features & 0xFFFF) << 20) | ((uint64_t)(packet.TextureSet & 0xFFF) << 8) | (packet.Material & 0xFF);
+		if (pass == PASS_BLENDED) {
+			packet.Key = ((uint64_t)pass << KEY_PASS_SHIFT) | ((KEY_DEPTH_MAX - quantized) << 36) | state;
+		} else {
+			packet.Key = ((uint64_t)pass << KEY_PASS_SHIFT) | (state << KEY_DEPTH_BITS) | quantized;
+		}
+		packets.push_back(packet);
+		models.push_back(model);
+		sorted = false;
+	}
+
+	// Replay the draws recorded by another thread, a buffer can be merged into the queue of every viewport.
+	void submit(const CommandBuffer& buffer) {
+		packets.reserve(packets.size() + buffer.size());
+		models.reserve(models.size() + buffer.size());
+		for (unsigned int i = 0; i < buffer.size(); i++) {
+			const RecordedPacket& packet = buffer[i];
+			submit(packet.Pass, packet.Features, packet.Textures, packet.HasMaterial ? &packet.Material : NULL, packet.Model, packet.Draw);
+		}
+	}
+
+	// "useShader" selects (and binds) the shader variant of the given material features.
+	// Only the packets of the passes first ~ last are executed, so deferred shading can draw them with different shaders.
+	void execute(Shader (*useShader)(unsigned int), Render_Pass first = PASS_OPAQUE, Render_Pass last = PASS_BLENDED) {
+		if (!sorted) {
+			sort();
+			// The normal matrices of every packet in one batch, instead of an inverse per vertex in the shaders
+			normalMatrices.resize(models.size());
+			computeNormalMatrices(models.data(), normalMatrices.data(), (unsigned int)models.size());
+			sorted = true;
+		}
+
+		static const unsigned int samplers[3] = {
+			Shader_Feature::FEATURE_DIFFUSE_TEXTURE, Shader_Feature::FEATURE_SPECULAR_TEXTURE, Shader_Feature::FEATURE_EMISSION_TEXTURE
+		};
+
+		// Other code may have changed the bindings since the last viewport
+		unsigned int currentTextures[3] = { ~0u, ~0u, ~0u };
+		unsigned int currentShader = 0;
+		unsigned int currentMaterial = ~0u;
+
+		for (unsigned int i = 0; i < order.size(); i++) {
+			unsigned int pass = (unsigned int)(order[i].Key >> KEY_PASS_SHIFT);
+			if (pass < (unsigned int)first || pass > (unsigned int)last) {
+				continue;
+			}
+			unsigned int index = order[i].Index;
+			DrawPacket& packet = packets[index];
+
+			const TextureSet& set = textureSets[packet.TextureSet];
+			unsigned int textures[3] = { set.Diffuse, set.Specular, set.Emission };
+			for (unsigned int unit = 0; unit < 3; unit++) {
+				if (!(packet.Features & samplers[unit])) {
+					continue;
+				}
+				if (currentTextures[unit] == textures[unit]) {
+					TextureBindsSkipped++;
+					continue;
+				}
+				glActiveTexture(GL_TEXTURE0 + unit);
+				glBindTexture(GL_TEXTURE_2D, textures[unit]);
+				currentTextures[unit] = textures[unit];
+				TextureBinds++;
+			}
+
+			Shader shader = useShader(packet.Features);
+			if (shader.ID != currentShader) {
+				currentShader = shader.ID;
+				currentMaterial = ~0u;
+			}
+			if (packet.Material != 0 && packet.Material != currentMaterial) {
+				const PacketMaterial& material = materials[packet.Material];
+				shader.setVec4("material.ambient", material.Ambient);
+				shader.setVec4("material.diffuse", material.Diffuse);
+				shader.setVec4("material.specular", material.Specular);
+				shader.setFloat("material.shininess", material.Shininess);
+				currentMaterial = packet.Material;
+				MaterialChanges++;
+			}
+			shader.setMat4("model", models[index]);
+			shader.setMat3("normalMatrix", normalMatrices[index]);
+			packet.Draw(shader);
+			Packets++;
+		}
+	}
+
+	void resetStats() {
+		Packets = 0;
+		TextureBinds = 0;
+		TextureBindsSkipped = 0;
+		MaterialChanges = 0;
+	}
+
+private:
+	struct SortItem {
+		uint64_t Key;
+		unsigned int Index;
+	};
+
+	glm::mat4 view;
+	float farPlane;
+	bool sorted;
+	std::vector<DrawPacket> packets;
+	std::vector<glm::mat4> models;			// model matrix of every packet, kept apart so the normal matrices are computed in one batch
+	std::vector<glm::mat3> normalMatrices;
+	std::vector<SortItem> order;
+	std::vector<SortItem> scratch;
+	std::vector<TextureSet> textureSets;
+	std::vector<PacketMaterial> materials;
+
+	// Least significant digit radix sort, one byte per pass, the bytes shared by every key are skipped.
+	void sort() {
+		unsigned int count = (unsigned int)packets.size();
+		order.resize(count);
+		scratch.resize(count);
+		for (unsigned int i = 0; i < count; i++) {
+			order[i].Key = packets[i].Key;
+			order[i].Index = i;
+		}
+
+		for (unsigned int shift = 0; shift < 64; shift += 8) {
+			unsigned int histogram[256] = { 0 };
+			for (unsigned int i = 0; i < count; i++) {
+				histogram[(order[i].Key >> shift) & 0xFF]++;
+			}
+			if (count == 0 || histogram[(order[0].Key >> shift) & 0xFF] == count) {
+				continue;
+			}
+
+			unsigned int offset = 0;
+			for (unsigned int i = 0; i < 256; i++) {
+				unsigned int size = histogram[i];
+				histogram[i] = offset;
+				offset += size;
+			}
+			for (unsigned int i = 0; i < count; i++) {
+				scratch[histogram[(order[i].Key >> shift) & 0xFF]++] = order[i];
+			}
+			order.swap(scratch);
+		}
+	}
+
+	unsigned int findTextureSet(const TextureSet& textures) {
+		for (unsigned int i = 0; i < textureSets.size(); i++) {
+			if (memcmp(&textureSets[i], &textures, sizeof(TextureSet)) == 0) {
+				return i;
+			}
+		}
+		textureSets.push_back(textures);
+		return (unsigned int)textureSets.size() - 1;
+	}
+
+	unsigned int findMaterial(const PacketMaterial& material) {
+		for (unsigned int i = 1; i < materials.size(); i++) {
+			if (memcmp(&materials[i], &material, sizeof(PacketMaterial)) == 0) {
+				return i;
+			}
+		}
+		materials.push_back(material);
+		return (unsigned int)materials.size() - 1;
+	}
+};
+
+#endif // !RENDERQUEUE_H
\ No newline at end of file
@@ -0,0 +1,358 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include "../Headers/logging.h"
+#include "../Headers/assetpack.h"
+#include "../Headers/mappedfile.h"
+#include "../Headers/instancedmesh.h"
+#include "../Headers/billboard.h"
+#include "../Headers/light.h"
+#include "../Headers/fog.h"
+#include "../Headers/uniformbuffer.h"
+
+#include <direct.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Built with "--build-scene", the populations are generated at random when it is missing.
+const std::string SCENE_DIR = "Resources/Scenes/";
+const std::string SCENE_PATH = SCENE_DIR + "seabed.scene";
+// A new major version changes the existing tables, a new minor version only adds tables, which older loaders skip.
+const uint32_t SCENE_VERSION = 1;
+const uint32_t SCENE_MINOR_VERSION = 0;
+const uint64_t SCENE_TABLE_ALIGNMENT = 16;
+
+enum Scene_Table {
+	SCENE_TABLE_BOXES,			// MeshInstance
+	SCENE_TABLE_PLASTICS,		// MeshInstance
+	SCENE_TABLE_SPRITES,		// BillboardInstance
+	SCENE_TABLE_LIGHTS,			// SceneLight
+	SCENE_TABLE_MATERIALS,		// SceneMaterial
+	SCENE_TABLE_FOG,			// FogData
+	NUM_SCENE_TABLES
+};
+
+// Layout: header, one SceneTableInfo per table, then the records of every table. The records have
+// the layout of the instance buffers, so a table is copied into its InstancedMesh or Billboard in one go.
+struct SceneFileHeader {
+	char Magic[4];				// "SCNE"
+	uint32_t Version;
+	uint32_t NumTables;
+	uint32_t MinorVersion;		// was padding, so the files written before it are minor version 0
+};
+
+struct SceneTableInfo {
+	uint32_t Type;
+	uint32_t Stride;			// size of one record, a changed struct is not read as garbage
+	uint64_t Count;
+	uint64_t Offset;			// from the start of the file
+};
+
+// A Light with the cutoff angles in degrees, as set in the panel.
+struct SceneLight {
+	glm::vec3 Position;
+	float Constant;
+	glm::vec3 Direction;
+	float Linear;
+	glm::vec3 Ambient;
+	float Quadratic;
+	glm::vec3 Diffuse;
+	float Cutoff;
+	glm::vec3 Specular;
+	float OuterCutoff;
+	float Exponent;
+	uint32_t Caster;
+	uint32_t Enable;
+	float Padding;
+};
+
+// Overrides one entry of the MaterialData block.
+struct SceneMaterial {
+	uint32_t Index;
+	uint32_t Padding[3];
+	MaterialEntry Material;
+};
+
+// Everything placed in the world when the program starts. The ROV, the cameras and their lights are not part of it.
+class Scene {
+public:
+	std::vector<MeshInstance> Boxes;
+	std::vector<MeshInstance> Plastics;
+	std::vector<BillboardInstance> Sprites;
+	std::vector<SceneLight> Lights;
+	std::vector<SceneMaterial> Materials;
+	FogData Fog;
+	bool HasFog;
+
+	Scene() : Fog(FogData()), HasFog(false) {}
+
+	static SceneLight fromLight(const Light& light) {
+		SceneLight data = SceneLight();
+		data.Position = light.Position;
+		data.Constant = light.Constant;
+		data.Direction = light.Direction;
+		data.Linear = light.Linear;
+		data.Ambient = light.Ambient;
+		data.Quadratic = light.Quadratic;
+		data.Diffuse = light.Diffuse;
+		data.Cutoff = light.Cutoff;
+		data.Specular = light.Specular;
+		data.OuterCutoff = light.OuterCutoff;
+		data.Exponent = light.Exponent;
+		data.Caster = light.Caster;
+		data.Enable = light.Enable;
+		return data;
+	}
+
+	static Light toLight(const SceneLight& data) {
+		Light light(data.Position, data.Enable != 0);
+		light.Direction = data.Direction;
+		light.Ambient = data.Ambient;
+		light.Diffuse = data.Diffuse;
+		light.Specular = data.Specular;
+		light.Constant = data.Constant;
+		light.Linear = data.Linear;
+		light.Quadratic = data.Quadratic;
+		light.Cutoff = data.Cutoff;
+		light.OuterCutoff = data.OuterCutoff;
+		light.Exponent = data.Exponent;
+		light.Caster = data.Caster;
+		return light;
+	}
+
+	static void applyFog(const FogData& data, ::Fog& fog) {
+		fog.Color = data.Color;
+		fog.Mode = data.Mode;
+		fog.DepthType = data.DepthType;
+		fog.Density = data.Density;
+		fog.F_start = data.F_start;
+		fog.F_end = data.F_end;
+		fog.Enable = data.Enable != 0;
+	}
+
+	unsigned int getEntities() const {
+		return (unsigned int)(Boxes.size() + Plastics.size() + Sprites.size());
+	}
+
+	void clear() {
+		Boxes.clear();
+		Plastics.clear();
+		Sprites.clear();
+		Lights.clear();
+		Materials.clear();
+		Fog = FogData();
+		HasFog = false;
+	}
+
+	// From the asset pack when it has the scene, else from the file. Both are mapped,
+	// so loading is one copy per table and the time doesn't depend on the number of records.
+	// "quiet" leaves out the line of a successful load, for the streamed chunks.
+	bool load(const std::string& path, bool quiet = false) {
+		auto start = std::chrono::high_resolution_clock::now();
+		AssetView view;
+		MappedFile file;
+		const unsigned char* data = NULL;
+		size_t size = 0;
+		if (AssetPack::instance().read(path, view)) {
+			data = view.data();
+			size = view.Size;
+		} else if (file.open(path)) {
+			data = file.getData();
+			size = file.getSize();
+		} else {
+			return false;
+		}
+
+		clear();
+		if (!parse(data, size)) {
+			logging::loggingMessage(logging::LogType::WARNING, "Ignored the invalid scene " + path);
+			clear();
+			return false;
+		}
+		if (quiet) {
+			return true;
+		}
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		logging::loggingMessage(logging::LogType::INFO, "Loaded scene " + path + " with " + std::to_string(getEntities()) + " entities and " +
+			std::to_string(Lights.size()) + " lights in " + std::to_string(elapsed) + " ms");
+		return true;
+	}
+
+	bool save(const std::string& path) const {
+		std::vector<SceneTableInfo> tables;
+		std::vector<const void*> records;
+		addTable(tables, records, SCENE_TABLE_BOXES, Boxes);
+		addTable(tables, records, SCENE_TABLE_PLASTICS, Plastics);
+		addTable(tables, records, SCENE_TABLE_SPRITES, Sprites);
+		addTable(tables, records, SCENE_TABLE_LIGHTS, Lights);
+		addTable(tables, records, SCENE_TABLE_MATERIALS, Materials);
+		if (HasFog) {
+			tables.push_back({ SCENE_TABLE_FOG, (uint32_t)sizeof(FogData), 1, 0 });
+			records.push_back(&Fog);
+		}
+
+		uint64_t offset = sizeof(SceneFileHeader) + tables.size() * sizeof(SceneTableInfo);
+		for (unsigned int i = 0; i < tables.size(); i++) {
+			offset = (offset + SCENE_TABLE_ALIGNMENT - 1) / SCENE_TABLE_ALIGNMENT * SCENE_TABLE_ALIGNMENT;
+			tables[i].Offset = offset;
+			offset += tables[i].Count * tables[i].Stride;
+		}
+
+		SceneFileHeader header;
+		memcpy(header.Magic, "SCNE", 4);
+		header.Version = SCENE_VERSION;
+		header.NumTables = (uint32_t)tables.size();
+		header.MinorVersion = SCENE_MINOR_VERSION;
+
+		_mkdir("Resources");
+		_mkdir(SCENE_DIR.c_str());
+		std::string temporary = path + ".tmp";
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)tables.data(), tables.size() * sizeof(SceneTableInfo));
+		uint64_t position = sizeof(SceneFileHeader) + tables.size() * sizeof(SceneTableInfo);
+		const char padding[SCENE_TABLE_ALIGNMENT] = {};
+		for (unsigned int i = 0; i < tables.size(); i++) {
+			out.write(padding, (std::streamsize)(tables[i].Offset - position));
+			out.write((const char*)records[i], (std::streamsize)(tables[i].Count * tables[i].Stride));
+			position = tables[i].Offset + tables[i].Count * tables[i].Stride;
+		}
+		out.close();
+		if (!out) {
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to write the scene " + path);
+			std::remove(temporary.c_str());
+			return false;
+		}
+		std::remove(path.c_str());
+		if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to replace the scene " + path);
+			return false;
+		}
+		logging::loggingMessage(logging::LogType::INFO, "Saved scene " + path + " with " + std::to_string(getEntities()) + " entities");
+		return true;
+	}
+
+	// One line per record, only meant to be read when looking for a broken scene.
+	bool exportText(const std::string& path) const {
+		FILE* out = fopen(path.c_str(), "w");
+		if (out == NULL) {
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to write " + path);
+			return false;
+		}
+		fprintf(out, "# scene version %u.%u\n", SCENE_VERSION, SCENE_MINOR_VERSION);
+		if (HasFog) {
+			fprintf(out, "fog color %g %g %g %g mode %d depth %d density %g start %g end %g enable %d\n", Fog.Color.x, Fog.Color.y, Fog.Color.z, Fog.Color.w,
+				Fog.Mode, Fog.DepthType, Fog.Density, Fog.F_start, Fog.F_end, Fog.Enable);
+		}
+		for (unsigned int i = 0; i < Materials.size(); i++) {
+			const MaterialEntry& m = Materials[i].Material;
+			fprintf(out, "material %u ambient %g %g %g %g diffuse %g %g %g %g specular %g %g %g %g shininess %g\n", Materials[i].Index,
+				m.Ambient.x, m.Ambient.y, m.Ambient.z, m.Ambient.w, m.Diffuse.x, m.Diffuse.y, m.Diffuse.z, m.Diffuse.w,
+				m.Specular.x, m.Specular.y, m.Specular.z, m.Specular.w, m.Shininess);
+		}
+		for (unsigned int i = 0; i < Lights.size(); i++) {
+			const SceneLight& l = Lights[i];
+			fprintf(out, "light caster %u enable %u position %g %g %g direction %g %g %g ambient %g %g %g diffuse %g %g %g specular %g %g %g "
+				"attenuation %g %g %g cutoff %g %g exponent %g\n", l.Caster, l.Enable, l.Position.x, l.Position.y, l.Position.z,
+				l.Direction.x, l.Direction.y, l.Direction.z, l.Ambient.x, l.Ambient.y, l.Ambient.z, l.Diffuse.x, l.Diffuse.y, l.Diffuse.z,
+				l.Specular.x, l.Specular.y, l.Specular.z, l.Constant, l.Linear, l.Quadratic, l.Cutoff, l.OuterCutoff, l.Exponent);
+		}
+		exportMeshes(out, "box", Boxes);
+		exportMeshes(out, "plastic", Plastics);
+		for (unsigned int i = 0; i < Sprites.size(); i++) {
+			const BillboardInstance& s = Sprites[i];
+			fprintf(out, "sprite %g %g %g size %g %g mode %g layer %g frames %g phase %g\n", s.Position.x, s.Position.y, s.Position.z,
+				s.Size.x, s.Size.y, s.Mode, s.Sprite.x, s.Sprite.y, s.Sprite.z);
+		}
+		fclose(out);
+		logging::loggingMessage(logging::LogType::INFO, "Exported scene to " + path);
+		return true;
+	}
+
+private:
+	template <typename T>
+	static void addTable(std::vector<SceneTableInfo>& tables, std::vector<const void*>& records, Scene_Table type, const std::vector<T>& items) {
+		tables.push_back({ (uint32_t)type, (uint32_t)sizeof(T), items.size(), 0 });
+		records.push_back(items.data());
+	}
+
+	template <typename T>
+	static bool readTable(const unsigned char* data, const SceneTableInfo& table, std::vector<T>& items) {
+		if (table.Stride != sizeof(T)) {
+			return false;
+		}
+		items.resize((size_t)table.Count);
+		if (table.Count != 0) {
+			memcpy(items.data(), data + table.Offset, (size_t)(table.Count * sizeof(T)));
+		}
+		return true;
+	}
+
+	bool parse(const unsigned char* data, size_t size) {
+		if (size < sizeof(SceneFileHeader)) {
+			return false;
+		}
+		const SceneFileHeader* header = (const SceneFileHeader*)data;
+		uint64_t tablesEnd = sizeof(SceneFileHeader) + (uint64_t)header->NumTables * sizeof(SceneTableInfo);
+		if (memcmp(header->Magic, "SCNE", 4) != 0 || header->Version != SCENE_VERSION || tablesEnd > size) {
+			return false;
+		}
+		const SceneTableInfo* tables = (const SceneTableInfo*)(data + sizeof(SceneFileHeader));
+		for (unsigned int i = 0; i < header->NumTables; i++) {
+			const SceneTableInfo& table = tables[i];
+			if (table.Stride == 0 || table.Offset > size || table.Count > (size - table.Offset) / table.Stride) {
+				return false;
+			}
+			bool valid = true;
+			switch (table.Type) {
+			case SCENE_TABLE_BOXES:
+				valid = readTable(data, table, Boxes);
+				break;
+			case SCENE_TABLE_PLASTICS:
+				valid = readTable(data, table, Plastics);
+				break;
+			case SCENE_TABLE_SPRITES:
+				valid = readTable(data, table, Sprites);
+				break;
+			case SCENE_TABLE_LIGHTS:
+				valid = readTable(data, table, Lights);
+				break;
+			case SCENE_TABLE_MATERIALS:
+				valid = readTable(data, table, Materials);
+				break;
+			case SCENE_TABLE_FOG:
+				valid = table.Stride == sizeof(FogData) && table.Count == 1;
+				if (valid) {
+					memcpy(&Fog, data + table.Offset, sizeof(FogData));
+					HasFog = true;
+				}
+				break;
+			default:
+				// A table of a later minor version, its records were checked against the file size above
+				break;
+			}
+			if (!valid) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static void exportMeshes(FILE* out, const char* name, const std::vector<MeshInstance>& meshes) {
+		for (unsigned int i = 0; i < meshes.size(); i++) {
+			const MeshInstance& m = meshes[i];
+			fprintf(out, "%s %g %g %g scale %g bobbing %g material %g\n", name, m.Transform.x, m.Transform.y, m.Transform.z,
+				m.Transform.w, m.Params.x, m.Params.y);
+		}
+	}
+};
+
+#endif // !SCENE_H
\ No newline at end of file
@@ -4,44 +4,266 @@
 #include <glad/glad.h>
 
 #include "..\Headers\logging.h";
+#include "../Headers/assetpack.h"
+#include "../Headers/hashing.h"
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <unordered_map>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <cstdint>
+#include <direct.h>
+
+// Linked program binaries are stored here, one file per hash of the sources, defines and driver.
+const std::string PROGRAM_CACHE_DIR = "Cache/Shaders/";
+
+// Shadow copy of one active uniform, the last value is compared before calling glUniform*.
+struct UniformSlot {
+	int Location;
+	unsigned int Size;
+	unsigned char Value[64];
+};
+
+// Shared by every copy of the same Shader, so the shadow values never go out of sync.
+struct UniformCache {
+	std::unordered_map<std::string, unsigned int> Index;
+	std::vector<UniformSlot> Slots;
+	unsigned int Calls = 0;
+	unsigned int Elided = 0;
+	unsigned int Inactive = 0;	// calls for uniforms the driver optimized out, in neither of the counts above
+};
+
+// Accumulated over every Shader created since startup, reported with the time to first frame.
+struct ProgramCacheStats {
+	unsigned int Hits = 0;
+	unsigned int Misses = 0;
+	double HitTime = 0.0;
+	double MissTime = 0.0;
+};
 
 class Shader {
 public:
 	unsigned int ID;
 
-	Shader(const char* vertexPath, const char* fragmentPath) {
+	// "defines" is inserted after the #version line of every stage, e.g. "#define LIGHTING\n".
+	// The geometry shader is optional.
+	Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines = "", const char* geometryPath = NULL) {
 		std::string vertexCode;
 		std::string fragmentCode;
+		std::string geometryCode;
+
+		if (!readSource(vertexPath, vertexCode) || !readSource(fragmentPath, fragmentCode) || (geometryPath != NULL && !readSource(geometryPath, geometryCode))) {
+			logging::loggingMessage(logging::LogType::ERROR, "[ERROR] Failed to load shader files.");
+		}
+		injectDefines(vertexCode, defines);
+		injectDefines(fragmentCode, defines);
+		if (geometryPath != NULL) {
+			injectDefines(geometryCode, defines);
+		}
+
+		// Try the program binary cache before compiling, without program binaries every shader is compiled from source.
+		auto start = std::chrono::high_resolution_clock::now();
+		bool binaryCache = supportsProgramBinary();
+		std::string cachePath = binaryCache ? getCachePath(vertexCode, fragmentCode, geometryCode) : "";
+		bool hit = binaryCache && loadBinary(cachePath);
+		if (!hit) {
+			compile(vertexCode, fragmentCode, geometryCode, vertexPath, fragmentPath, geometryPath);
+			if (binaryCache) {
+				saveBinary(cachePath);
+			}
+		}
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		ProgramCacheStats& stats = getCacheStats();
+		if (hit) {
+			stats.Hits++;
+			stats.HitTime += elapsed;
+		}
+		else {
+			stats.Misses++;
+			stats.MissTime += elapsed;
+		}
+		logging::loggingMessage(logging::LogType::DEBUG, std::string("Shader cache ") + (hit ? "hit" : "miss") + " (" + std::to_string(elapsed) + " ms): " + vertexPath + ", " + fragmentPath);
+
+		reflectUniforms();
+	};
 
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
+	static ProgramCacheStats& getCacheStats() {
+		static ProgramCacheStats stats;
+		return stats;
+	}
 
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try {
-			// Open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
+	// Util functions
 
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
+	void use() {
+		glUseProgram(ID);
+	}
 
-			vShaderFile.close();
-			fShaderFile.close();
+	// GLSL 330 has no layout(binding), so the uniform blocks are bound here.
+	void bindUniformBlock(const std::string& name, unsigned int binding) const {
+		unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+		if (index != GL_INVALID_INDEX) {
+			glUniformBlockBinding(ID, index, binding);
+		}
+	}
 
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+	void setBool(const std::string& name, bool value) const {
+		int v = value;
+		int loc = changedLocation(name, &v, sizeof(v));
+		if (loc != -1) {
+			glUniform1i(loc, v);
 		}
-		catch (std::ifstream::failure& e) {
-			// Handle Failure
-			logging::loggingMessage(logging::LogType::ERROR, "[ERROR] Failed to load shader files.");
+	}
+
+	void setInt(const std::string& name, int value) const {
+		int loc = changedLocation(name, &value, sizeof(value));
+		if (loc != -1) {
+			glUniform1i(loc, value);
+		}
+	}
+
+	void setFloat(const std::string& name, float value) const {
+		int loc = changedLocation(name, &value, sizeof(value));
+		if (loc != -1) {
+			glUniform1f(loc, value);
+		}
+	}
+
+	void setVec3(const std::string& name, glm::vec3 vector) const {
+		int loc = changedLocation(name, &vector[0], sizeof(vector));
+		if (loc != -1) {
+			glUniform3fv(loc, 1, &vector[0]);
+		}
+	}
+
+	void setVec3(const std::string& name, float x, float y, float z) const {
+		setVec3(name, glm::vec3(x, y, z));
+	}
+
+	void setVec4(const std::string& name, glm::vec4 vector) const {
+		int loc = changedLocation(name, &vector[0], sizeof(vector));
+		if (loc != -1) {
+			glUniform4fv(loc, 1, &vector[0]);
+		}
+	}
+
+	void setVec4(const std::string& name, float x, float y, float z, float w) const {
+		setVec4(name, glm::vec4(x, y, z, w));
+	}
+
+	void setMat3(const std::string& name, glm::mat3 matrices) const {
+		int loc = changedLocation(name, &matrices[0][0], sizeof(matrices));
+		if (loc != -1) {
+			glUniformMatrix3fv(loc, 1, GL_FALSE, &matrices[0][0]);
+		}
+	}
+
+	void setMat4(const std::string& name, glm::mat4 matrices) const {
+		int loc = changedLocation(name, &matrices[0][0], sizeof(matrices));
+		if (loc != -1) {
+			glUniformMatrix4fv(loc, 1, GL_FALSE, &matrices[0][0]);
+		}
+	}
+
+	// Statistics of the uniform cache, the elided calls never reach the driver.
+	unsigned int getUniformCalls() const {
+		return uniforms->Calls;
+	}
+
+	unsigned int getElidedCalls() const {
+		return uniforms->Elided;
+	}
+
+	unsigned int getInactiveCalls() const {
+		return uniforms->Inactive;
+	}
+
+	void resetUniformStats() const {
+		uniforms->Calls = 0;
+		uniforms->Elided = 0;
+		uniforms->Inactive = 0;
+	}
+
+private:
+	std::shared_ptr<UniformCache> uniforms = std::make_shared<UniformCache>();
+
+	// Query every active uniform once after link, instead of calling glGetUniformLocation per set.
+	void reflectUniforms() {
+		int count = 0;
+		int maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+		std::vector<char> buffer(maxLength + 1);
+		for (int i = 0; i < count; i++) {
+			int length = 0;
+			int size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, i, maxLength, &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), length);
+
+			// Uniforms inside a uniform block have no location.
+			int loc = glGetUniformLocation(ID, name.c_str());
+			if (loc == -1) {
+				continue;
+			}
+			addSlot(name, loc);
+
+			// Arrays of basic types are reported once as "name[0]".
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				std::string base = name.substr(0, name.size() - 3);
+				addSlot(base, loc);
+				for (int j = 1; j < size; j++) {
+					std::string element = base + "[" + std::to_string(j) + "]";
+					addSlot(element, glGetUniformLocation(ID, element.c_str()));
+				}
+			}
+		}
+	}
+
+	unsigned int addSlot(const std::string& name, int loc) const {
+		UniformSlot slot;
+		slot.Location = loc;
+		slot.Size = 0;
+		uniforms->Slots.push_back(slot);
+		uniforms->Index[name] = (unsigned int)uniforms->Slots.size() - 1;
+		return (unsigned int)uniforms->Slots.size() - 1;
+	}
+
+	UniformSlot& slot(const std::string& name) const {
+		auto it = uniforms->Index.find(name);
+		if (it != uniforms->Index.end()) {
+			return uniforms->Slots[it->second];
+		}
+		// Not an active uniform (e.g. optimized out), remember the -1 so it is not queried again.
+		return uniforms->Slots[addSlot(name, glGetUniformLocation(ID, name.c_str()))];
+	}
+
+	// Returns -1 when the uniform is inactive or already holds this value.
+	int changedLocation(const std::string& name, const void* value, unsigned int size) const {
+		UniformSlot& s = slot(name);
+		if (s.Location == -1) {
+			uniforms->Inactive++;
+			return -1;
 		}
+		uniforms->Calls++;
+		if (s.Size == size && std::memcmp(s.Value, value, size) == 0) {
+			uniforms->Elided++;
+			return -1;
+		}
+		s.Size = size;
+		std::memcpy(s.Value, value, size);
+		return s.Location;
+	}
+
+	void compile(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode, const char* vertexPath, const char* fragmentPath, const char* geometryPath) {
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
 
@@ -57,59 +279,152 @@ public:
 		glCompileShader(fragment);
 		checkCompileErrors(fragment, "Fragment", fragmentPath);
 
+		unsigned int geometry = 0;
+		if (!geometryCode.empty()) {
+			const char* gShaderCode = geometryCode.c_str();
+			geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(geometry, 1, &gShaderCode, NULL);
+			glCompileShader(geometry);
+			checkCompileErrors(geometry, "Geometry", geometryPath);
+		}
+
 		ID = glCreateProgram();
 		glAttachShader(ID, vertex);
 		glAttachShader(ID, fragment);
+		if (geometry != 0) {
+			glAttachShader(ID, geometry);
+		}
+		if (supportsProgramBinary()) {
+			glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
 		glLinkProgram(ID);
 		checkCompileErrors(ID, "Program", NULL);
 
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
-	};
-
-	// Util functions
-
-	void use() {
-		glUseProgram(ID);
+		if (geometry != 0) {
+			glDeleteShader(geometry);
+		}
 	}
 
-	void setBool(const std::string& name, bool value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	// Program binaries are core in GL 4.1, the 3.3 context only has them through ARB_get_program_binary.
+	static bool supportsProgramBinary() {
+		bool available = false;
+#ifdef GL_VERSION_4_1
+		available = available || GLAD_GL_VERSION_4_1;
+#endif
+#ifdef GL_ARB_get_program_binary
+		available = available || GLAD_GL_ARB_get_program_binary;
+#endif
+		return available && glProgramParameteri != NULL && glProgramBinary != NULL && glGetProgramBinary != NULL;
 	}
 
-	void setInt(const std::string& name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	// The renderer and driver version are part of the hash, a binary from another driver is never tried.
+	static std::string getCachePath(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode) {
+		std::string key = vertexCode + '\0' + fragmentCode + '\0' + geometryCode + '\0';
+		key += reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		key += reinterpret_cast<const char*>(glGetString(GL_VERSION));
+		return getCacheFile(PROGRAM_CACHE_DIR, key, ".bin");
 	}
 
-	void setFloat(const std::string& name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-	}
+	// The file holds the binary format followed by the blob of glGetProgramBinary.
+	bool loadBinary(const std::string& path) {
+		int numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		if (numFormats == 0) {
+			return false;
+		}
 
-	void setVec3(const std::string& name, glm::vec3 vector) const {
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &vector[0]);
-	}
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		GLenum format = 0;
+		if (!file.read(reinterpret_cast<char*>(&format), sizeof(format))) {
+			return false;
+		}
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (binary.empty()) {
+			return false;
+		}
 
-	void setVec3(const std::string& name, float x, float y, float z) const {
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
-	}
+		ID = glCreateProgram();
+		glProgramBinary(ID, format, binary.data(), (GLsizei)binary.size());
 
-	void setVec4(const std::string& name, glm::vec4 vector) const {
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &vector[0]);
+		// The driver may reject a binary at any time (e.g. after an update), compile it again then.
+		int success = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (!success) {
+			logging::loggingMessage(logging::LogType::WARNING, "Program binary rejected by the driver: " + path);
+			glDeleteProgram(ID);
+			ID = 0;
+			return false;
+		}
+		return true;
 	}
 
-	void setVec4(const std::string& name, float x, float y, float z, float w) const {
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+	void saveBinary(const std::string& path) const {
+		int success = 0;
+		int length = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (!success || length == 0) {
+			return;
+		}
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(ID, length, NULL, &format, binary.data());
+
+		// Written next to the entry first, so a crash never leaves a truncated binary behind
+		_mkdir("Cache");
+		_mkdir(PROGRAM_CACHE_DIR.c_str());
+		std::string temporary = path + ".tmp";
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+		file.write(binary.data(), binary.size());
+		file.close();
+		if (!file) {
+			logging::loggingMessage(logging::LogType::WARNING, "Failed to write program binary: " + path);
+			std::remove(temporary.c_str());
+			return;
+		}
+		std::remove(path.c_str());
+		if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+			logging::loggingMessage(logging::LogType::WARNING, "Failed to replace program binary: " + path);
+			std::remove(temporary.c_str());
+		}
 	}
 
-	void setMat3(const std::string& name, glm::mat3 matrices) const {
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &matrices[0][0]);
+	// From the asset pack when it has the file, else from the loose file.
+	static bool readSource(const char* path, std::string& code) {
+		if (AssetPack::instance().readText(path, code)) {
+			return true;
+		}
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		code = stream.str();
+		return true;
 	}
 
-	void setMat4(const std::string& name, glm::mat4 matrices) const {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &matrices[0][0]);
+	static void injectDefines(std::string& code, const std::string& defines) {
+		if (defines.empty()) {
+			return;
+		}
+		size_t version = code.find("#version");
+		size_t line = (version == std::string::npos) ? 0 : code.find('\n', version);
+		if (line == std::string::npos) {
+			code += "\n" + defines;
+		}
+		else {
+			code.insert(version == std::string::npos ? 0 : line + 1, defines);
+		}
 	}
 
-private:
 	void checkCompileErrors(unsigned int shader, std::string type, const char* filePath) {
 		int success;
 		char infoLog[1024];
@@ -0,0 +1,156 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <glad/glad.h>
+
+#include "../Headers/logging.h"
+#include "../Headers/shader.h"
+#include "../Headers/uniformbuffer.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Each bit is compiled into the shaders as "#define <name>", instead of branching on a bool uniform.
+enum Shader_Feature {
+	FEATURE_LIGHTING			= 1 << 0,
+	FEATURE_BLINN_PHONG			= 1 << 1,
+	FEATURE_SPOT_EXPONENT		= 1 << 2,
+	FEATURE_GAMMA				= 1 << 3,
+	FEATURE_FOG					= 1 << 4,
+	FEATURE_CUBEMAP				= 1 << 5,	// unused, the skybox has a program of its own (cubemap.vs / cubemap.fs)
+	FEATURE_DIFFUSE_TEXTURE		= 1 << 6,
+	FEATURE_SPECULAR_TEXTURE	= 1 << 7,
+	FEATURE_EMISSION			= 1 << 8,
+	FEATURE_EMISSION_TEXTURE	= 1 << 9,
+	FEATURE_BILLBOARD			= 1 << 10,
+	FEATURE_BILLBOARD_FIXED		= 1 << 11,
+	FEATURE_INSTANCED			= 1 << 12,
+	FEATURE_PARTS				= 1 << 13,
+	FEATURE_CLUSTERED			= 1 << 14,
+	FEATURE_DEFERRED			= 1 << 15,	// geometry pass, writes the G-buffer
+	FEATURE_LIGHTING_PASS		= 1 << 16,	// fullscreen pass, lights the G-buffer
+	FEATURE_MULTIVIEW			= 1 << 17,	// every monitor of the quad view in one pass, adds the geometry shader
+};
+
+const unsigned int NUM_FEATURES = 18;
+
+// The rest of the key holds the values of the numeric defines, it no longer fits in 32 bits.
+const unsigned int FOG_MODE_SHIFT = 18;			// 2 bits
+const unsigned int FOG_DEPTH_TYPE_SHIFT = 20;	// 1 bit
+const unsigned int DIR_LIGHTS_SHIFT = 21;		// 4 bits
+const unsigned int POINT_LIGHTS_SHIFT = 25;		// 4 bits
+const unsigned int SPOT_LIGHTS_SHIFT = 29;		// 4 bits
+
+// All the permutations of one vertex / fragment shader pair, compiled on first use.
+// The geometry shader is optional, it is only attached to the MULTIVIEW variants.
+class ShaderVariants {
+public:
+	std::string VertexPath;
+	std::string FragmentPath;
+	std::string GeometryPath;
+
+	ShaderVariants(const char* vertexPath, const char* fragmentPath, const char* geometryPath = "") : VertexPath(vertexPath), FragmentPath(fragmentPath), GeometryPath(geometryPath) {}
+
+	static uint64_t fogKey(unsigned int mode, unsigned int depthType) {
+		return ((uint64_t)(mode & 0x3) << FOG_MODE_SHIFT) | ((uint64_t)(depthType & 0x1) << FOG_DEPTH_TYPE_SHIFT);
+	}
+
+	static uint64_t lightKey(unsigned int numDir, unsigned int numPoint, unsigned int numSpot) {
+		return ((uint64_t)(numDir & 0xF) << DIR_LIGHTS_SHIFT) | ((uint64_t)(numPoint & 0xF) << POINT_LIGHTS_SHIFT) | ((uint64_t)(numSpot & 0xF) << SPOT_LIGHTS_SHIFT);
+	}
+
+	static std::string getDefines(uint64_t key) {
+		static const char* names[NUM_FEATURES] = {
+			"LIGHTING", "BLINN_PHONG", "SPOT_EXPONENT", "GAMMA", "FOG", "CUBEMAP",
+			"DIFFUSE_TEXTURE", "SPECULAR_TEXTURE", "EMISSION", "EMISSION_TEXTURE", "BILLBOARD", "BILLBOARD_FIXED",
+			"INSTANCED", "PARTS", "CLUSTERED", "DEFERRED", "LIGHTING_PASS", "MULTIVIEW",
+		};
+
+		std::string defines;
+		for (unsigned int i = 0; i < NUM_FEATURES; i++) {
+			if (key & (1ull << i)) {
+				defines += "#define " + std::string(names[i]) + "\n";
+			}
+		}
+		defines += "#define FOG_MODE " + std::to_string((key >> FOG_MODE_SHIFT) & 0x3) + "\n";
+		defines += "#define FOG_DEPTH_TYPE " + std::to_string((key >> FOG_DEPTH_TYPE_SHIFT) & 0x1) + "\n";
+		defines += "#define NUM_DIR_LIGHTS " + std::to_string((key >> DIR_LIGHTS_SHIFT) & 0xF) + "\n";
+		defines += "#define NUM_POINT_LIGHTS " + std::to_string((key >> POINT_LIGHTS_SHIFT) & 0xF) + "\n";
+		defines += "#define NUM_SPOT_LIGHTS " + std::to_string((key >> SPOT_LIGHTS_SHIFT) & 0xF) + "\n";
+		return defines;
+	}
+
+	// Must be called after the OpenGL context has been created, the new program is left in use.
+	Shader& get(uint64_t key) {
+		auto it = variants.find(key);
+		if (it != variants.end()) {
+			return it->second;
+		}
+
+		logging::loggingMessage(logging::LogType::DEBUG, "Compile shader variant " + std::to_string(key) + " of " + VertexPath + ", " + FragmentPath);
+		const char* geometryPath = ((key & Shader_Feature::FEATURE_MULTIVIEW) && !GeometryPath.empty()) ? GeometryPath.c_str() : NULL;
+		Shader& shader = variants.emplace(key, Shader(VertexPath.c_str(), FragmentPath.c_str(), getDefines(key), geometryPath)).first->second;
+
+		shader.bindUniformBlock("FrameData", Uniform_Binding::FRAME_BINDING);
+		shader.bindUniformBlock("ViewData", Uniform_Binding::VIEW_BINDING);
+		shader.bindUniformBlock("MaterialData", Uniform_Binding::MATERIAL_BINDING);
+		shader.bindUniformBlock("MultiViewData", Uniform_Binding::MULTIVIEW_BINDING);
+
+		// Texture units never change, so they are only set once.
+		shader.use();
+		shader.setInt("material.diffuse_texture", 0);
+		shader.setInt("material.specular_texture", 1);
+		shader.setInt("material.emission_texture", 2);
+		shader.setInt("skybox", 3);
+		shader.setInt("sprites", 4);
+		shader.setInt("clusterLights", 5);
+		shader.setInt("clusterGrid", 6);
+		shader.setInt("clusterIndices", 7);
+		shader.setInt("gbufferAlbedo", 8);
+		shader.setInt("gbufferAmbient", 9);
+		shader.setInt("gbufferSpecular", 10);
+		shader.setInt("gbufferNormal", 11);
+		shader.setInt("gbufferDepth", 12);
+		return shader;
+	}
+
+	unsigned int size() const {
+		return (unsigned int)variants.size();
+	}
+
+	unsigned int getUniformCalls() const {
+		unsigned int calls = 0;
+		for (auto& variant : variants) {
+			calls += variant.second.getUniformCalls();
+		}
+		return calls;
+	}
+
+	unsigned int getElidedCalls() const {
+		unsigned int elided = 0;
+		for (auto& variant : variants) {
+			elided += variant.second.getElidedCalls();
+		}
+		return elided;
+	}
+
+	unsigned int getInactiveCalls() const {
+		unsigned int inactive = 0;
+		for (auto& variant : variants) {
+			inactive += variant.second.getInactiveCalls();
+		}
+		return inactive;
+	}
+
+	void resetUniformStats() const {
+		for (auto& variant : variants) {
+			variant.second.resetUniformStats();
+		}
+	}
+
+private:
+	std::unordered_map<uint64_t, Shader> variants;
+};
+
+#endif // !SHADERVARIANTS_H
\ No newline at end of file
@@ -0,0 +1,141 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "../Headers/logging.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Lock-free ring buffer between exactly one producer thread and one consumer thread.
+// One slot is kept empty to tell a full buffer from an empty one.
+template <typename T, unsigned int Capacity>
+class SpscQueue {
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// Producer side, false when the buffer is full.
+	bool push(const T& item) {
+		unsigned int current = tail.load(std::memory_order_relaxed);
+		unsigned int next = (current + 1) % Capacity;
+		if (next == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		items[current] = item;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, false when the buffer is empty.
+	bool pop(T& item) {
+		unsigned int current = head.load(std::memory_order_relaxed);
+		if (current == tail.load(std::memory_order_acquire)) {
+			return false;
+		}
+		item = items[current];
+		head.store((current + 1) % Capacity, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[Capacity];
+	std::atomic<unsigned int> head;
+	std::atomic<unsigned int> tail;
+};
+
+// Runs tick(state, step) at a fixed rate on its own thread. After every tick the previous and the new
+// state are published through a triple buffer, so the render thread always reads a complete snapshot
+// without waiting for the simulation, and the simulation never waits for the renderer.
+template <typename State>
+class FixedStepThread {
+public:
+	typedef std::function<void(State&, float)> Tick;
+
+	// Two states of the simulation, "Time" is when Current was produced.
+	struct Snapshot {
+		State Previous;
+		State Current;
+		double Time;
+	};
+
+	std::atomic<float> TickRate;		// ticks per second
+
+	FixedStepThread() : TickRate(60.0f), back(0), middle(1), front(2), running(false) {}
+
+	~FixedStepThread() {
+		stop();
+	}
+
+	static double now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void start(const State& initial, Tick tick) {
+		stop();
+		for (unsigned int i = 0; i < 3; i++) {
+			buffers[i].Previous = initial;
+			buffers[i].Current = initial;
+			buffers[i].Time = now();
+		}
+		back = 0;
+		middle = 1;
+		front = 2;
+		running = true;
+		thread = std::thread(&FixedStepThread::loop, this, initial, tick);
+		logging::loggingMessage(logging::LogType::DEBUG, "Simulation thread started at " + std::to_string(TickRate.load()) + " Hz");
+	}
+
+	void stop() {
+		running = false;
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	// Latest snapshot and how far the render time is between its two states (0 ~ 1).
+	// The renderer stays one tick behind the simulation, so it only interpolates and never extrapolates.
+	const Snapshot& read(float& alpha) {
+		unsigned int fresh = middle.load(std::memory_order_relaxed);
+		if (fresh & FRESH_BIT) {
+			fresh = middle.exchange(front, std::memory_order_acq_rel);
+			front = fresh & ~FRESH_BIT;
+		}
+		const Snapshot& snapshot = buffers[front];
+		alpha = (float)std::min(std::max((now() - snapshot.Time) * TickRate.load(), 0.0), 1.0);
+		return snapshot;
+	}
+
+private:
+	static const unsigned int FRESH_BIT = 4;
+
+	Snapshot buffers[3];
+	unsigned int back;					// only used by the simulation thread
+	std::atomic<unsigned int> middle;	// index of the shared buffer, FRESH_BIT once it holds a newer snapshot
+	unsigned int front;					// only used by the render thread
+	std::atomic<bool> running;
+	std::thread thread;
+
+	void loop(State state, Tick tick) {
+		double next = now();
+		while (running) {
+			float step = 1.0f / TickRate.load();
+			State previous = state;
+			tick(state, step);
+
+			Snapshot& snapshot = buffers[back];
+			snapshot.Previous = previous;
+			snapshot.Current = state;
+			snapshot.Time = now();
+			back = middle.exchange(back | FRESH_BIT, std::memory_order_acq_rel) & ~FRESH_BIT;
+
+			// A late tick is not caught up with a burst, the simulation just runs slower for a while
+			next = std::max(next + step, now() - step);
+			std::this_thread::sleep_for(std::chrono::duration<double>(std::max(next - now(), 0.0)));
+		}
+	}
+};
+
+#endif // !SIMULATION_H
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/blockcompress.h"
+
+// Images of different sizes packed into the layers of one GL_TEXTURE_2D_ARRAY,
+// so every sprite can be drawn in one batch and picked by a layer index.
+class TextureArray {
+public:
+	unsigned int ID;
+	int Width;
+	int Height;
+	unsigned int Layers;
+	unsigned int LoadedLayers;
+
+	TextureArray() : ID(0), Width(0), Height(0), Layers(0), LoadedLayers(0) {}
+
+	// Allocate the layers without any pixels and leave the array bound, TextureLoader fills every level
+	// of every layer later. "mipmaps" allocates the whole mip chain.
+	// "internalFormat" is GL_RGBA8 or one of the GL_COMPRESSED_* formats of blockcompress.h.
+	void create(int width, int height, unsigned int layers, bool mipmaps, GLenum internalFormat) {
+		Width = width;
+		Height = height;
+		Layers = layers;
+		LoadedLayers = 0;
+
+		glGenTextures(1, &ID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+		unsigned int levels = mipmaps ? getLevels() : 1;
+		for (unsigned int level = 0; level < levels; level++) {
+			int levelWidth = glm::max(Width >> level, 1), levelHeight = glm::max(Height >> level, 1);
+			if (internalFormat == GL_RGBA8) {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth, levelHeight, Layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			} else {
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, levelWidth, levelHeight, Layers, 0, getCompressedSize(levelWidth, levelHeight, internalFormat) * Layers, NULL);
+			}
+		}
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// Number of levels of the full mip chain
+	unsigned int getLevels() const {
+		unsigned int levels = 1;
+		while ((Width >> levels) > 0 || (Height >> levels) > 0) {
+			levels++;
+		}
+		return levels;
+	}
+
+	// The layers stay undefined until they are loaded, the sprites are not drawn before that
+	bool ready() const {
+		return ID != 0 && LoadedLayers == Layers;
+	}
+
+	void bind(unsigned int unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+	}
+
+	void release() {
+		glDeleteTextures(1, &ID);
+	}
+
+	// Bilinear resampling of an RGBA image, the texture coordinates of the sprites still cover the whole image.
+	static void resize(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* target, int width, int height) {
+		for (int y = 0; y < height; y++) {
+			float sy = glm::clamp((y + 0.5f) * sourceHeight / height - 0.5f, 0.0f, (float)(sourceHeight - 1));
+			int y0 = (int)sy;
+			int y1 = glm::min(y0 + 1, sourceHeight - 1);
+			float fy = sy - y0;
+			for (int x = 0; x < width; x++) {
+				float sx = glm::clamp((x + 0.5f) * sourceWidth / width - 0.5f, 0.0f, (float)(sourceWidth - 1));
+				int x0 = (int)sx;
+				int x1 = glm::min(x0 + 1, sourceWidth - 1);
+				float fx = sx - x0;
+				for (int c = 0; c < 4; c++) {
+					float top = source[(y0 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y0 * sourceWidth + x1) * 4 + c] * fx;
+					float bottom = source[(y1 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y1 * sourceWidth + x1) * 4 + c] * fx;
+					target[(y * width + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+				}
+			}
+		}
+	}
+};
+
+#endif // !TEXTUREARRAY_H
\ No newline at end of file
@@ -0,0 +1,752 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <glad/glad.h>
+
+#include "../Headers/assetpack.h"
+#include "../Headers/blockcompress.h"
+#include "../Headers/hashing.h"
+#include "../Headers/logging.h"
+#include "../Headers/mappedfile.h"
+#include "../Headers/stb_image.h"
+#include "../Headers/texturearray.h"
+
+#include <sys/stat.h>
+#include <direct.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bytes streamed through the pixel buffer per frame, a larger image still goes up in one frame
+const unsigned int TEXTURE_UPLOAD_BUDGET = 8 * 1024 * 1024;
+
+// Blocks compressed by one job of the loader threads, the levels of an image are split into jobs of whole block rows
+const unsigned int COMPRESSION_CHUNK_BLOCKS = 1024;
+
+// Decoded textures with their mip chains, one file per source image and load settings.
+const std::string TEXTURE_CACHE_DIR = "Cache/Textures/";
+const uint32_t BAKED_TEXTURE_VERSION = 2;
+
+// Start of a baked texture, followed by the offset of every level (uint32_t) and then the levels themselves.
+struct BakedTextureHeader {
+	char Magic[4];				// "BTEX"
+	uint32_t Version;
+	int64_t SourceTime;			// modification time of the source image when it was baked
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Components;
+	uint32_t Levels;
+	uint32_t Format;			// GL_COMPRESSED_* of the blocks, 0 for raw pixels
+	uint32_t Reserved;
+};
+
+// Pixels of one decoded image and its mip chain, level 0 first and every level tightly packed.
+// The pixels are either decoded into Pixels or read in place from a mapped baked texture.
+// Once compressed, Pixels holds the blocks of every level instead.
+struct DecodedImage {
+	int Width;
+	int Height;
+	int Components;				// of the source, the blocks of BC1 have 3 and the blocks of BC3 have 4
+	GLenum Format;				// GL_COMPRESSED_* of the blocks, 0 for raw pixels
+	std::vector<unsigned char> Pixels;
+	std::vector<unsigned int> Offsets;		// start of every level in the pixels
+	std::shared_ptr<MappedFile> Baked;
+	size_t BakedOffset;
+	size_t BakedSize;
+
+	DecodedImage() : Width(0), Height(0), Components(0), Format(0), BakedOffset(0), BakedSize(0) {}
+
+	const unsigned char* getPixels() const {
+		return Baked ? Baked->getData() + BakedOffset : Pixels.data();
+	}
+
+	size_t getSize() const {
+		return Baked ? BakedSize : Pixels.size();
+	}
+
+	int getWidth(unsigned int level) const {
+		return std::max(Width >> level, 1);
+	}
+
+	int getHeight(unsigned int level) const {
+		return std::max(Height >> level, 1);
+	}
+
+	// 2 x 2 box filter down to 1 x 1, the odd rows and columns are folded into the last texel.
+	void buildMipChain() {
+		unsigned int level = 0;
+		while (getWidth(level) > 1 || getHeight(level) > 1) {
+			int sourceWidth = getWidth(level), sourceHeight = getHeight(level);
+			int width = getWidth(level + 1), height = getHeight(level + 1);
+			unsigned int source = Offsets[level];
+			unsigned int target = (unsigned int)Pixels.size();
+			Offsets.push_back(target);
+			Pixels.resize(target + width * height * Components);
+
+			for (int y = 0; y < height; y++) {
+				int y0 = std::min(y * 2, sourceHeight - 1), y1 = std::min(y * 2 + 1, sourceHeight - 1);
+				for (int x = 0; x < width; x++) {
+					int x0 = std::min(x * 2, sourceWidth - 1), x1 = std::min(x * 2 + 1, sourceWidth - 1);
+					for (int c = 0; c < Components; c++) {
+						unsigned int sum = Pixels[source + (y0 * sourceWidth + x0) * Components + c] + Pixels[source + (y0 * sourceWidth + x1) * Components + c] +
+							Pixels[source + (y1 * sourceWidth + x0) * Components + c] + Pixels[source + (y1 * sourceWidth + x1) * Components + c];
+						Pixels[target + (y * width + x) * Components + c] = (unsigned char)((sum + 2) / 4);
+					}
+				}
+			}
+			level++;
+		}
+	}
+
+	unsigned int getLevels() const {
+		return (unsigned int)Offsets.size();
+	}
+
+	unsigned int getLevelSize(unsigned int level) const {
+		if (Format != 0) {
+			return getCompressedSize(getWidth(level), getHeight(level), Format);
+		}
+		return getWidth(level) * getHeight(level) * Components;
+	}
+};
+
+// Loads textures without blocking the GL thread. The loader threads decode the files with stb_image and
+// build the mip chains, then update() streams the pixels into the textures through a pixel buffer object.
+// The texture names are returned right away and sample a 1 x 1 placeholder until their pixels arrive.
+// RGB and RGBA images are compressed to BC1 and BC3 before they are baked, unless the quality is COMPRESSION_NONE.
+class TextureLoader {
+public:
+	// Statistics, accumulated until resetStats()
+	unsigned int UploadedBytes;
+	unsigned int UploadedImages;
+	// Images read from the texture cache and images decoded and baked again, since the start
+	std::atomic<unsigned int> CacheHits;
+	std::atomic<unsigned int> CacheBakes;
+	// Bytes of every level uploaded so far, the video memory taken by the textures
+	size_t ResidentBytes;
+
+	TextureLoader() : UploadedBytes(0), UploadedImages(0), CacheHits(0), CacheBakes(0), ResidentBytes(0), pixelBuffer(0), compression(COMPRESSION_NONE),
+		threadCount(1), running(false), pending(0), startTime(0.0) {}
+
+	~TextureLoader() {
+		stop();
+	}
+
+	// Must be called after the OpenGL context has been created.
+	void setup(unsigned int numThreads, Compression_Quality quality) {
+		release();
+		glGenBuffers(1, &pixelBuffer);
+		compression = getSupported(quality);
+		threadCount = std::max(numThreads, 1u);
+		start();
+	}
+
+	Compression_Quality getQuality() const {
+		return compression;
+	}
+
+	// Every texture keeps its name and is loaded again with the new quality, from the texture cache
+	// when it was baked with that quality before, otherwise it is decoded and baked again.
+	void setQuality(Compression_Quality quality) {
+		quality = getSupported(quality);
+		if (quality == compression) {
+			return;
+		}
+		stop();
+		uploads.clear();
+		compression = quality;
+		for (unsigned int i = 0; i < entries.size(); i++) {
+			Entry& entry = entries[i];
+			entry.Faces.clear();
+			entry.FacesDecoded = 0;
+			if (entry.Array != NULL) {
+				// The layers were allocated in the old format
+				TextureArray& array = *entry.Array;
+				array.release();
+				array.create(array.Width, array.Height, array.Layers, true, getArrayFormat());
+				entry.ID = array.ID;
+			}
+		}
+		ResidentBytes = 0;
+		start();
+
+		std::vector<Request> previous;
+		previous.swap(requests);
+		for (unsigned int i = 0; i < previous.size(); i++) {
+			const Request& request = previous[i];
+			queue(entries[request.EntryIndex], request.Path, request.Image, request.Components, request.Width, request.Height, request.Mipmaps);
+		}
+		logging::loggingMessage(logging::LogType::INFO, "Loading " + std::to_string(previous.size()) + " texture images again with the new compression quality");
+	}
+
+	// Same wrapping as the textures loaded before: RGBA images are clamped, the others mirrored.
+	unsigned int loadTexture(const std::string& path) {
+		Entry entry = createEntry(GL_TEXTURE_2D, 1, 0);
+		glBindTexture(GL_TEXTURE_2D, entry.ID);
+		uploadPlaceholder(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		queue(entry, path, 0, 0, 0, 0, true);
+		return entry.ID;
+	}
+
+	// The six faces are uploaded together, so the cubemap is never sampled with faces of different sizes.
+	unsigned int loadCubemap(const std::vector<std::string>& faces) {
+		Entry entry = createEntry(GL_TEXTURE_CUBE_MAP, (unsigned int)faces.size(), 0);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, entry.ID);
+		for (unsigned int i = 0; i < 6; i++) {
+			uploadPlaceholder(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+		}
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		for (unsigned int i = 0; i < faces.size(); i++) {
+			queue(entry, faces[i], i, 3, 0, 0, true);
+		}
+		return entry.ID;
+	}
+
+	// Every image is converted to RGBA and resized to width x height on the loader threads,
+	// the array is ready() once all of its layers are uploaded.
+	void loadArray(TextureArray& array, const std::vector<std::string>& paths, int width, int height) {
+		array.create(width, height, (unsigned int)paths.size(), true, getArrayFormat());
+		Entry entry = createEntry(GL_TEXTURE_2D_ARRAY, 1, array.ID);
+		entries.back().Array = &array;
+		for (unsigned int i = 0; i < paths.size(); i++) {
+			queue(entry, paths[i], i, 4, width, height, true);
+		}
+	}
+
+	// Upload the decoded images, called once per frame on the GL thread.
+	void update() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (!decoded.empty()) {
+				uploads.push_back(std::move(decoded.front()));
+				decoded.pop_front();
+			}
+		}
+
+		if (uploads.empty()) {
+			return;
+		}
+		unsigned int budget = 0;
+		while (!uploads.empty() && budget < TEXTURE_UPLOAD_BUDGET) {
+			Result result = std::move(uploads.front());
+			uploads.pop_front();
+			budget += upload(result);
+		}
+		if (pending == 0) {
+			logging::loggingMessage(logging::LogType::INFO, "Textures loaded in " + std::to_string((now() - startTime) * 1000.0) + " ms");
+		}
+	}
+
+	// Images still waiting to be decoded or uploaded
+	unsigned int getPending() const {
+		return pending;
+	}
+
+	void resetStats() {
+		UploadedBytes = 0;
+		UploadedImages = 0;
+	}
+
+	void release() {
+		stop();
+		glDeleteBuffers(1, &pixelBuffer);
+		pixelBuffer = 0;
+		uploads.clear();
+		entries.clear();
+		requests.clear();
+	}
+
+private:
+	// A texture and the images it is made of: one for a 2D texture, six faces for a cubemap, the layers for an array
+	struct Entry {
+		GLenum Target;
+		unsigned int ID;
+		unsigned int Images;
+		unsigned int Index;			// into entries
+		TextureArray* Array;
+		std::vector<DecodedImage> Faces;	// faces decoded so far, a cubemap is only uploaded once they are all there
+		unsigned int FacesDecoded;
+	};
+
+	struct Request {
+		unsigned int EntryIndex;
+		unsigned int Image;			// face or layer
+		std::string Path;
+		int Components;				// 0 keeps the components of the file
+		int Width;					// size of the array layers, 0 keeps the size of the file
+		int Height;
+		bool Mipmaps;
+		Compression_Quality Quality;
+	};
+
+	struct Result {
+		Request Source;
+		DecodedImage Image;
+		bool Failed;
+		bool Cached;				// read from the texture cache, nothing to bake
+	};
+
+	// One image being compressed, "Remaining" jobs still have to finish before it can be baked and uploaded
+	struct CompressionTask {
+		Result Output;
+		std::vector<unsigned char> Blocks;
+		std::vector<unsigned int> Offsets;
+		std::atomic<unsigned int> Remaining;
+	};
+
+	// A request to decode, or a range of block rows of a CompressionTask
+	struct LoaderJob {
+		Request Source;
+		std::shared_ptr<CompressionTask> Task;
+		unsigned int Level;
+		unsigned int FirstRow;
+		unsigned int LastRow;
+	};
+
+	std::vector<Entry> entries;
+	std::vector<Request> requests;	// every image queued, loaded again when the quality changes
+	std::deque<Result> uploads;		// only used by the GL thread
+	unsigned int pixelBuffer;
+	Compression_Quality compression;
+	unsigned int threadCount;
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<LoaderJob> jobs;		// guarded by mutex
+	std::deque<Result> decoded;		// guarded by mutex
+	bool running;					// guarded by mutex
+	unsigned int pending;
+	double startTime;
+
+	static double now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// "id" 0 creates a new texture
+	Entry createEntry(GLenum target, unsigned int images, unsigned int id) {
+		Entry entry;
+		entry.Target = target;
+		entry.ID = id;
+		if (entry.ID == 0) {
+			glGenTextures(1, &entry.ID);
+		}
+		entry.Images = images;
+		entry.Index = (unsigned int)entries.size();
+		entry.Array = NULL;
+		entry.FacesDecoded = 0;
+		entries.push_back(entry);
+		return entry;
+	}
+
+	static bool supportsS3TC() {
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (int i = 0; i < count; i++) {
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (name != NULL && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	Compression_Quality getSupported(Compression_Quality quality) {
+		if (quality != COMPRESSION_NONE && !supportsS3TC()) {
+			logging::loggingMessage(logging::LogType::WARNING, "S3TC is not supported, the textures are not compressed");
+			return COMPRESSION_NONE;
+		}
+		return quality;
+	}
+
+	GLenum getArrayFormat() const {
+		return (compression != COMPRESSION_NONE) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+	}
+
+	// Mid grey, a 1 x 1 level is a complete mip chain on its own
+	void uploadPlaceholder(GLenum target) {
+		const unsigned char grey[4] = { 128, 128, 128, 255 };
+		glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	}
+
+	void queue(const Entry& entry, const std::string& path, unsigned int image, int components, int width, int height, bool mipmaps) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			LoaderJob job;
+			job.Source = Request{ entry.Index, image, path, components, width, height, mipmaps, compression };
+			jobs.push_back(job);
+			requests.push_back(job.Source);
+		}
+		pending++;
+		wake.notify_one();
+	}
+
+	void start() {
+		running = true;
+		for (unsigned int i = 0; i < threadCount; i++) {
+			threads.push_back(std::thread(&TextureLoader::loaderLoop, this));
+		}
+		startTime = now();
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+			jobs.clear();
+		}
+		wake.notify_all();
+		for (unsigned int i = 0; i < threads.size(); i++) {
+			threads[i].join();
+		}
+		threads.clear();
+		// Cleared after the join, a thread finishing its last job may still have added a result
+		decoded.clear();
+		pending = 0;
+	}
+
+	void loaderLoop() {
+		while (true) {
+			LoaderJob job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() {
+					return !running || !jobs.empty();
+				});
+				if (!running) {
+					return;
+				}
+				job = jobs.front();
+				jobs.pop_front();
+			}
+
+			if (job.Task) {
+				compressRows(job);
+				continue;
+			}
+
+			Result result;
+			result.Source = job.Source;
+			result.Cached = false;
+			result.Failed = !decode(job.Source, result.Image, result.Cached);
+			if (!result.Failed && !result.Cached && job.Source.Quality != COMPRESSION_NONE &&
+				(result.Image.Components == 3 || result.Image.Components == 4)) {
+				startCompression(result);
+				continue;
+			}
+			finish(result);
+		}
+	}
+
+	// Bake the image if it was decoded from its source, then hand it to the GL thread.
+	void finish(Result& result) {
+		if (!result.Failed && !result.Cached) {
+			int64_t sourceTime = getModifiedTime(result.Source.Path);
+			if (sourceTime >= 0) {
+				bake(getCachePath(result.Source), sourceTime, result.Image);
+				CacheBakes++;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		decoded.push_back(std::move(result));
+	}
+
+	// Split every level into jobs of block rows, queued in front of the other requests so the image is done first.
+	void startCompression(Result& result) {
+		std::shared_ptr<CompressionTask> task = std::make_shared<CompressionTask>();
+		const DecodedImage& image = result.Image;
+		GLenum format = (image.Components == 4) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		std::vector<LoaderJob> rows;
+		unsigned int size = 0;
+		for (unsigned int level = 0; level < image.getLevels(); level++) {
+			task->Offsets.push_back(size);
+			size += getCompressedSize(image.getWidth(level), image.getHeight(level), format);
+
+			unsigned int blocksX = (image.getWidth(level) + 3) / 4, blocksY = (image.getHeight(level) + 3) / 4;
+			unsigned int step = std::max(COMPRESSION_CHUNK_BLOCKS / blocksX, 1u);
+			for (unsigned int row = 0; row < blocksY; row += step) {
+				LoaderJob job;
+				job.Task = task;
+				job.Level = level;
+				job.FirstRow = row;
+				job.LastRow = std::min(row + step, blocksY);
+				rows.push_back(job);
+			}
+		}
+		task->Blocks.resize(size);
+		task->Remaining = (unsigned int)rows.size();
+		task->Output = std::move(result);
+		task->Output.Image.Format = format;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.insert(jobs.begin(), rows.begin(), rows.end());
+		}
+		wake.notify_all();
+	}
+
+	// The thread finishing the last rows of an image swaps the pixels for the blocks and reports the quality.
+	void compressRows(LoaderJob& job) {
+		CompressionTask& task = *job.Task;
+		DecodedImage& image = task.Output.Image;
+		compressBlocks(image.Pixels.data() + image.Offsets[job.Level], image.getWidth(job.Level), image.getHeight(job.Level), image.Components, image.Format,
+			task.Output.Source.Quality, job.FirstRow, job.LastRow, task.Blocks.data() + task.Offsets[job.Level]);
+		if (task.Remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+			return;
+		}
+
+		float psnr = computePSNR(image.Pixels.data(), image.Width, image.Height, image.Components, task.Blocks.data(), image.Format);
+		logging::loggingMessage(logging::LogType::INFO, "Compressed " + task.Output.Source.Path + " to " + (image.Format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? "BC1" : "BC3") +
+			", " + std::to_string(image.Pixels.size() / 1024) + " KB -> " + std::to_string(task.Blocks.size() / 1024) + " KB, PSNR " + std::to_string(psnr) + " dB");
+		image.Pixels.swap(task.Blocks);
+		image.Offsets.swap(task.Offsets);
+		finish(task.Output);
+	}
+
+	// The baked texture when it is still up to date, otherwise the source image.
+	bool decode(const Request& request, DecodedImage& image, bool& cached) {
+		std::string cachePath = getCachePath(request);
+		int64_t sourceTime = getModifiedTime(request.Path);
+		if (loadBaked(cachePath, sourceTime, image)) {
+			CacheHits++;
+			cached = true;
+			return true;
+		}
+
+		int width, height, nrComponents;
+		unsigned char* data = NULL;
+		AssetView view;
+		if (AssetPack::instance().read(request.Path, view)) {
+			data = stbi_load_from_memory(view.data(), (int)view.Size, &width, &height, &nrComponents, request.Components);
+		} else {
+			data = stbi_load(request.Path.c_str(), &width, &height, &nrComponents, request.Components);
+		}
+		if (!data) {
+			return false;
+		}
+		image.Components = (request.Components != 0) ? request.Components : nrComponents;
+		image.Offsets.push_back(0);
+		if (request.Width != 0) {
+			image.Width = request.Width;
+			image.Height = request.Height;
+			image.Pixels.resize(image.Width * image.Height * 4);
+			TextureArray::resize(data, width, height, image.Pixels.data(), image.Width, image.Height);
+		} else {
+			image.Width = width;
+			image.Height = height;
+			image.Pixels.assign(data, data + width * height * image.Components);
+		}
+		stbi_image_free(data);
+		if (request.Mipmaps) {
+			image.buildMipChain();
+		}
+		return true;
+	}
+
+	// The components, the layer size, the mipmaps and the compression change the baked pixels, so they are part of the name.
+	static std::string getCachePath(const Request& request) {
+		std::string key = AssetPack::normalize(request.Path) + '\0' + std::to_string(request.Components) + '\0' + std::to_string(request.Width) + 'x' +
+			std::to_string(request.Height) + '\0' + (request.Mipmaps ? "mips" : "base") + '\0' + std::to_string((int)request.Quality);
+		return getCacheFile(TEXTURE_CACHE_DIR, key, ".tex");
+	}
+
+	// -1 when the file doesn't exist, packed assets keep the time of their source
+	static int64_t getModifiedTime(const std::string& path) {
+		int64_t packed = AssetPack::instance().getModifiedTime(path);
+		if (packed >= 0) {
+			return packed;
+		}
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0) {
+			return -1;
+		}
+		return (int64_t)info.st_mtime;
+	}
+
+	// Without its source the baked texture is used as it is, so a build can ship the cache alone.
+	bool loadBaked(const std::string& path, int64_t sourceTime, DecodedImage& image) {
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(path) || file->getSize() < sizeof(BakedTextureHeader)) {
+			return false;
+		}
+		BakedTextureHeader header;
+		memcpy(&header, file->getData(), sizeof(header));
+		if (memcmp(header.Magic, "BTEX", 4) != 0 || header.Version != BAKED_TEXTURE_VERSION || (sourceTime >= 0 && header.SourceTime != sourceTime) ||
+			header.Levels == 0 || header.Levels > 32 || header.Components == 0 || header.Components > 4 ||
+			(header.Format != 0 && header.Format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT && header.Format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)) {
+			return false;
+		}
+
+		size_t start = sizeof(header) + header.Levels * sizeof(uint32_t);
+		if (file->getSize() < start) {
+			return false;
+		}
+		image.Width = (int)header.Width;
+		image.Height = (int)header.Height;
+		image.Components = (int)header.Components;
+		image.Format = (GLenum)header.Format;
+		image.Offsets.resize(header.Levels);
+		memcpy(image.Offsets.data(), file->getData() + sizeof(header), header.Levels * sizeof(uint32_t));
+
+		// Every level has to be inside the file, a truncated bake is decoded again
+		unsigned int last = header.Levels - 1;
+		size_t end = start + image.Offsets[last] + image.getLevelSize(last);
+		if (image.Offsets[0] != 0 || file->getSize() < end) {
+			image.Offsets.clear();
+			return false;
+		}
+
+		file->prefetch();
+		image.Baked = file;
+		image.BakedOffset = start;
+		image.BakedSize = end - start;
+		return true;
+	}
+
+	// Written to a temporary file first, a loader thread never maps a half written bake.
+	void bake(const std::string& path, int64_t sourceTime, const DecodedImage& image) {
+		BakedTextureHeader header;
+		memcpy(header.Magic, "BTEX", 4);
+		header.Version = BAKED_TEXTURE_VERSION;
+		header.SourceTime = sourceTime;
+		header.Width = (uint32_t)image.Width;
+		header.Height = (uint32_t)image.Height;
+		header.Components = (uint32_t)image.Components;
+		header.Levels = image.getLevels();
+		header.Format = (uint32_t)image.Format;
+		header.Reserved = 0;
+
+		_mkdir("Cache");
+		_mkdir(TEXTURE_CACHE_DIR.c_str());
+		std::string temporary = path + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary);
+			if (!file) {
+				logging::loggingMessage(logging::LogType::WARNING, "Failed to write baked texture: " + path);
+				return;
+			}
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(image.Offsets.data()), image.Offsets.size() * sizeof(uint32_t));
+			file.write(reinterpret_cast<const char*>(image.Pixels.data()), image.Pixels.size());
+		}
+		remove(path.c_str());
+		rename(temporary.c_str(), path.c_str());
+	}
+
+	// Copy every level into the pixel buffer, then let the driver copy them into the texture. Returns the bytes sent.
+	unsigned int upload(Result& result) {
+		Entry& entry = entries[result.Source.EntryIndex];
+		pending--;
+		if (result.Failed) {
+			// A missing layer stays empty like before, a cubemap with a missing face keeps its placeholder
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to load texture at path: " + result.Source.Path);
+			if (entry.Array != NULL) {
+				entry.Array->LoadedLayers++;
+			}
+			return 0;
+		}
+
+		if (entry.Target == GL_TEXTURE_CUBE_MAP) {
+			if (entry.Faces.empty()) {
+				entry.Faces.resize(entry.Images);
+			}
+			entry.Faces[result.Source.Image] = std::move(result.Image);
+			if (++entry.FacesDecoded < entry.Images) {
+				return 0;
+			}
+		}
+
+		std::vector<DecodedImage*> images;
+		if (entry.Target == GL_TEXTURE_CUBE_MAP) {
+			for (unsigned int i = 0; i < entry.Faces.size(); i++) {
+				images.push_back(&entry.Faces[i]);
+			}
+		} else {
+			images.push_back(&result.Image);
+		}
+
+		// Orphan the buffer, so the copy of the previous image doesn't have to finish before this one is written
+		unsigned int size = 0;
+		for (unsigned int i = 0; i < images.size(); i++) {
+			size += (unsigned int)images[i]->getSize();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped == NULL) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			logging::loggingMessage(logging::LogType::ERROR, "Failed to map the pixel buffer for: " + result.Source.Path);
+			return 0;
+		}
+		unsigned int offset = 0;
+		for (unsigned int i = 0; i < images.size(); i++) {
+			memcpy(mapped + offset, images[i]->getPixels(), images[i]->getSize());
+			offset += (unsigned int)images[i]->getSize();
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		// The levels are tightly packed, RGB rows are not aligned to 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(entry.Target, entry.ID);
+		offset = 0;
+		for (unsigned int i = 0; i < images.size(); i++) {
+			const DecodedImage& image = *images[i];
+			GLenum format = (image.Components == 1) ? GL_RED : (image.Components == 3) ? GL_RGB : GL_RGBA;
+			GLenum target = (entry.Target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : entry.Target;
+			for (unsigned int level = 0; level < image.getLevels(); level++) {
+				const void* pixels = (const void*)(size_t)(offset + image.Offsets[level]);
+				int width = image.getWidth(level), height = image.getHeight(level);
+				unsigned int layer = result.Source.Image;
+				if (image.Format != 0 && target == GL_TEXTURE_2D_ARRAY) {
+					glCompressedTexSubImage3D(target, level, 0, 0, layer, width, height, 1, image.Format, image.getLevelSize(level), pixels);
+				} else if (image.Format != 0) {
+					glCompressedTexImage2D(target, level, image.Format, width, height, 0, image.getLevelSize(level), pixels);
+				} else if (target == GL_TEXTURE_2D_ARRAY) {
+					glTexSubImage3D(target, level, 0, 0, layer, width, height, 1, format, GL_UNSIGNED_BYTE, pixels);
+				} else {
+					glTexImage2D(target, level, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+				}
+			}
+			offset += (unsigned int)image.getSize();
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (entry.Target == GL_TEXTURE_2D) {
+			GLenum wrap = (images[0]->Components == 4) ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT;
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+		} else if (entry.Target == GL_TEXTURE_CUBE_MAP) {
+			entry.Faces.clear();
+		} else {
+			entry.Array->LoadedLayers++;
+		}
+		glBindTexture(entry.Target, 0);
+
+		UploadedBytes += size;
+		UploadedImages += (unsigned int)images.size();
+		ResidentBytes += size;
+		return size;
+	}
+};
+
+#endif // !TEXTURELOADER_H
\ No newline at end of file
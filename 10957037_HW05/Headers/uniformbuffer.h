@@ -0,0 +1,135 @@
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../Headers/light.h"
+#include "../Headers/fog.h"
+
+#include <vector>
+#include <cstring>
+
+// Binding points shared by every shader program.
+enum Uniform_Binding {
+	FRAME_BINDING = 0,
+	VIEW_BINDING = 1,
+	MATERIAL_BINDING = 2,
+	MULTIVIEW_BINDING = 3
+};
+
+// Only the enabled lights are packed: Direction Lights, then Point Lights, then Spot Lights.
+const unsigned int MAX_LIGHTS = 8;
+
+// Updated once per frame, std140 layout of the FrameData block.
+struct FrameData {
+	LightData Lights[MAX_LIGHTS];
+	FogData Fog;
+	float GammaValue;
+	float Padding[3];
+};
+
+// Updated once per viewport, std140 layout of the ViewData block.
+struct ViewData {
+	glm::mat4 View;
+	glm::mat4 Projection;
+	glm::vec3 ViewPos;
+	float Time;
+	float ClusterNear;	// clip planes of the projection, the light clusters are sliced between them
+	float ClusterFar;
+	float Padding[2];
+};
+
+// Monitors of the quad view, drawn in one pass by the MULTIVIEW shader variants.
+const unsigned int MAX_VIEWS = 4;
+
+// Updated once per frame in the quad view, std140 layout of the MultiViewData block.
+struct MultiViewData {
+	glm::mat4 Views[MAX_VIEWS];
+	glm::mat4 Projections[MAX_VIEWS];
+	glm::vec4 ViewPositions[MAX_VIEWS];
+	glm::vec4 ClipPlanes[MAX_VIEWS];	// x: near, y: far, same as ClusterNear / ClusterFar
+	glm::vec4 Viewports[MAX_VIEWS];		// xy: scale, zw: offset of the monitor in the normalized device coordinates of the window
+};
+
+// Materials of the instanced meshes, indexed by the material of each instance.
+const unsigned int MAX_MATERIALS = 32;
+
+// std140 layout of the MaterialEntry struct in the MaterialData block.
+struct MaterialEntry {
+	glm::vec4 Ambient;
+	glm::vec4 Diffuse;
+	glm::vec4 Specular;
+	float Shininess;
+	float Padding[3];
+};
+
+struct MaterialData {
+	MaterialEntry Materials[MAX_MATERIALS];
+};
+
+// A uniform buffer holding "count" slots of T, each slot can be bound to the same binding point.
+// The last uploaded value of every slot is kept, so unchanged data is never sent again.
+template <typename T>
+class UniformBuffer {
+public:
+	unsigned int ID;
+	unsigned int Binding;
+	unsigned int Uploads;
+	unsigned int Skipped;
+
+	UniformBuffer() : ID(0), Binding(0), Uploads(0), Skipped(0), stride(0) {}
+
+	// Must be called after the OpenGL context has been created.
+	void setup(unsigned int binding, unsigned int count = 1) {
+		Binding = binding;
+
+		// Every slot offset must be a multiple of the alignment for glBindBufferRange
+		int alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = ((unsigned int)sizeof(T) + alignment - 1) / alignment * alignment;
+
+		shadow.assign(count, T());
+		dirty.assign(count, true);
+
+		glGenBuffers(1, &ID);
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferData(GL_UNIFORM_BUFFER, stride * count, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferRange(GL_UNIFORM_BUFFER, Binding, ID, 0, sizeof(T));
+	}
+
+	void update(const T& data, unsigned int index = 0) {
+		if (!dirty[index] && std::memcmp(&shadow[index], &data, sizeof(T)) == 0) {
+			Skipped++;
+			return;
+		}
+		shadow[index] = data;
+		dirty[index] = false;
+		Uploads++;
+
+		glBindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferSubData(GL_UNIFORM_BUFFER, index * stride, sizeof(T), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void bind(unsigned int index = 0) {
+		glBindBufferRange(GL_UNIFORM_BUFFER, Binding, ID, index * stride, sizeof(T));
+	}
+
+	void resetStats() {
+		Uploads = 0;
+		Skipped = 0;
+	}
+
+	void release() {
+		glDeleteBuffers(1, &ID);
+	}
+
+private:
+	unsigned int stride;
+	std::vector<T> shadow;
+	std::vector<bool> dirty;
+};
+
+#endif // !UNIFORMBUFFER_H
\ No newline at end of file
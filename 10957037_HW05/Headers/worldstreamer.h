@@ -0,0 +1,345 @@
+#ifndef WORLDSTREAMER_H
+#define WORLDSTREAMER_H
+
+#include <glm/glm.hpp>
+
+#include "../Headers/logging.h"
+#include "../Headers/scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The world is cut into square chunks on the seabed, chunk (x, z) covers [x, x + 1) * WORLD_CHUNK_SIZE on both axes.
+// A chunk is a small scene of its own: "Resources/World/<x>_<z>.scene" when it has been built,
+// else the part of the startup scene standing in it, else it is generated.
+const float WORLD_CHUNK_SIZE = 64.0f;
+const std::string WORLD_DIR = "Resources/World/";
+
+// Far enough that a float still resolves millimetres.
+const float WORLD_LIMIT = 16000.0f;
+
+// Chunk content held in memory, only the instance tables and the lights are used.
+struct WorldChunk {
+	int X;
+	int Z;
+	Scene Content;
+	size_t Bytes;
+};
+
+// Keeps the chunks around the focus points (the ROV and the camera) resident. A loader thread reads
+// or generates them, update() on the main thread takes the finished ones and evicts the far ones,
+// so the work per frame depends on the loaded area and not on the size of the world.
+class WorldStreamer {
+public:
+	typedef std::function<void(int, int, Scene&)> Generator;
+
+	int LoadRadius;				// in chunks around each focus point
+	float PrefetchTime;			// seconds of the current velocity of the ROV looked ahead
+	size_t MemoryBudget;		// of the resident chunks, in bytes
+
+	// Statistics, accumulated since start()
+	std::atomic<unsigned int> Loaded;
+	std::atomic<unsigned int> Evicted;
+
+	WorldStreamer() : LoadRadius(3), PrefetchTime(2.0f), MemoryBudget(64 * 1024 * 1024), Loaded(0), Evicted(0), residentBytes(0), largestChunk(0), running(false) {}
+
+	~WorldStreamer() {
+		stop();
+	}
+
+	static int toChunk(float coordinate) {
+		return (int)std::floor(coordinate / WORLD_CHUNK_SIZE);
+	}
+
+	static uint64_t getKey(int x, int z) {
+		return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+	}
+
+	static glm::vec3 getOrigin(int x, int z) {
+		return glm::vec3(x * WORLD_CHUNK_SIZE, 0.0f, z * WORLD_CHUNK_SIZE);
+	}
+
+	static std::string getChunkPath(int x, int z) {
+		return WORLD_DIR + std::to_string(x) + "_" + std::to_string(z) + ".scene";
+	}
+
+	// Moves the instances of "scene" into the chunks they stand in, the lights, materials and fog are left to the caller.
+	static void split(Scene& scene, std::map<uint64_t, Scene>& chunks) {
+		for (unsigned int i = 0; i < scene.Boxes.size(); i++) {
+			chunks[getKey(toChunk(scene.Boxes[i].Transform.x), toChunk(scene.Boxes[i].Transform.z))].Boxes.push_back(scene.Boxes[i]);
+		}
+		for (unsigned int i = 0; i < scene.Plastics.size(); i++) {
+			chunks[getKey(toChunk(scene.Plastics[i].Transform.x), toChunk(scene.Plastics[i].Transform.z))].Plastics.push_back(scene.Plastics[i]);
+		}
+		for (unsigned int i = 0; i < scene.Sprites.size(); i++) {
+			chunks[getKey(toChunk(scene.Sprites[i].Position.x), toChunk(scene.Sprites[i].Position.z))].Sprites.push_back(scene.Sprites[i]);
+		}
+		std::vector<MeshInstance>().swap(scene.Boxes);
+		std::vector<MeshInstance>().swap(scene.Plastics);
+		std::vector<BillboardInstance>().swap(scene.Sprites);
+	}
+
+	// These chunks are not generated, must be called before start().
+	void setAuthored(Scene& scene) {
+		authored.clear();
+		split(scene, authored);
+	}
+
+	void start(Generator generate) {
+		stop();
+		generator = generate;
+		results.clear();
+		pending.clear();
+		Loaded = 0;
+		Evicted = 0;
+		running = true;
+		thread = std::thread(&WorldStreamer::loaderLoop, this);
+		logging::loggingMessage(logging::LogType::DEBUG, "World streamer started with " + std::to_string(authored.size()) + " authored chunks");
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+			requests.clear();
+		}
+		wake.notify_all();
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+
+	// Call once per frame. "predicted" is where the ROV is heading, its chunks are loaded after the ones
+	// around the focus points. True when the resident chunks changed.
+	bool update(const std::vector<glm::vec3>& focus, glm::vec3 predicted) {
+		bool changed = false;
+		unsigned int loadedBefore = Loaded, evictedBefore = Evicted;
+
+		// Take the finished chunks, the ones nobody wants anymore are dropped right away
+		std::vector<std::unique_ptr<WorldChunk>> finished;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.swap(results);
+		}
+		for (unsigned int i = 0; i < finished.size(); i++) {
+			uint64_t key = getKey(finished[i]->X, finished[i]->Z);
+			auto request = std::find(pending.begin(), pending.end(), key);
+			if (request != pending.end()) {
+				pending.erase(request);
+			}
+			if (getDistance(finished[i]->X, finished[i]->Z, focus, predicted) > LoadRadius + 1) {
+				continue;
+			}
+			residentBytes += finished[i]->Bytes;
+			largestChunk = std::max(largestChunk, finished[i]->Bytes);
+			resident[key] = std::move(finished[i]);
+			Loaded++;
+			changed = true;
+		}
+
+		// Evict the chunks out of reach, one chunk past the load radius is kept so a focus on a border doesn't thrash
+		for (auto it = resident.begin(); it != resident.end();) {
+			if (getDistance(it->second->X, it->second->Z, focus, predicted) > LoadRadius + 1) {
+				it = evict(it);
+				changed = true;
+			} else {
+				++it;
+			}
+		}
+		while (residentBytes > MemoryBudget && !resident.empty()) {
+			evict(getFarthest(focus));
+			changed = true;
+		}
+
+		// Wanted chunks nearest first, the ones only reached by the prediction after every chunk around a focus
+		std::vector<Wanted> wanted;
+		std::vector<glm::vec3> points = focus;
+		points.push_back(predicted);
+		for (unsigned int p = 0; p < points.size(); p++) {
+			int cx = toChunk(points[p].x);
+			int cz = toChunk(points[p].z);
+			for (int z = cz - LoadRadius; z <= cz + LoadRadius; z++) {
+				for (int x = cx - LoadRadius; x <= cx + LoadRadius; x++) {
+					glm::vec3 center = getOrigin(x, z) + glm::vec3(0.5f * WORLD_CHUNK_SIZE, 0.0f, 0.5f * WORLD_CHUNK_SIZE);
+					float priority = glm::length(glm::vec2(center.x - points[p].x, center.z - points[p].z));
+					if (p == points.size() - 1) {
+						priority += LoadRadius * WORLD_CHUNK_SIZE;
+					}
+					wanted.push_back({ x, z, priority });
+				}
+			}
+		}
+		std::sort(wanted.begin(), wanted.end(), [](const Wanted& a, const Wanted& b) {
+			return a.Priority < b.Priority;
+		});
+
+		// Only a few requests are in flight, so a moving focus reorders the rest. Over the budget the
+		// farthest resident chunks make room for nearer ones, and nothing farther than them is requested.
+		// Room is made for the largest chunk seen so far, a smaller estimate would load chunks only to evict them again.
+		std::vector<uint64_t> queued;
+		for (unsigned int i = 0; i < wanted.size() && pending.size() + queued.size() < MAX_IN_FLIGHT; i++) {
+			uint64_t key = getKey(wanted[i].X, wanted[i].Z);
+			if (resident.count(key) != 0 || std::find(pending.begin(), pending.end(), key) != pending.end() || std::find(queued.begin(), queued.end(), key) != queued.end()) {
+				continue;
+			}
+			while (residentBytes + (pending.size() + queued.size() + 1) * largestChunk > MemoryBudget) {
+				auto farthest = getFarthest(focus);
+				if (farthest == resident.end() || getPriority(*farthest->second, focus) <= wanted[i].Priority) {
+					break;
+				}
+				evict(farthest);
+				changed = true;
+			}
+			if (residentBytes + (pending.size() + queued.size() + 1) * largestChunk > MemoryBudget) {
+				break;
+			}
+			queued.push_back(key);
+		}
+		if (!queued.empty()) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (unsigned int i = 0; i < queued.size(); i++) {
+					requests.push_back(queued[i]);
+				}
+			}
+			pending.insert(pending.end(), queued.begin(), queued.end());
+			wake.notify_one();
+		}
+
+		// The chunks are loaded quietly, one line per pass that changed them
+		if (changed) {
+			logging::loggingMessage(logging::LogType::DEBUG, "World chunks: " + std::to_string(Loaded - loadedBefore) + " loaded, " +
+				std::to_string(Evicted - evictedBefore) + " evicted, " + std::to_string(resident.size()) + " resident, " +
+				std::to_string(pending.size()) + " loading");
+		}
+		return changed;
+	}
+
+	const std::map<uint64_t, std::unique_ptr<WorldChunk>>& getResident() const {
+		return resident;
+	}
+
+	size_t getResidentBytes() const {
+		return residentBytes;
+	}
+
+	unsigned int getPending() const {
+		return (unsigned int)pending.size();
+	}
+
+private:
+	static const unsigned int MAX_IN_FLIGHT = 4;
+
+	struct Wanted {
+		int X;
+		int Z;
+		float Priority;		// distance to the focus point, lower is loaded first
+	};
+
+	std::map<uint64_t, Scene> authored;			// read by the loader thread, not changed while it runs
+	Generator generator;
+
+	// Only used by the main thread
+	std::map<uint64_t, std::unique_ptr<WorldChunk>> resident;
+	std::vector<uint64_t> pending;
+	size_t residentBytes;
+	size_t largestChunk;
+
+	// Shared with the loader thread
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<uint64_t> requests;
+	std::vector<std::unique_ptr<WorldChunk>> results;
+	bool running;
+	std::thread thread;
+
+	// Chebyshev distance in chunks to the nearest focus point.
+	static int getDistance(int x, int z, const std::vector<glm::vec3>& focus, glm::vec3 predicted) {
+		int distance = std::max(std::abs(x - toChunk(predicted.x)), std::abs(z - toChunk(predicted.z)));
+		for (unsigned int i = 0; i < focus.size(); i++) {
+			distance = std::min(distance, std::max(std::abs(x - toChunk(focus[i].x)), std::abs(z - toChunk(focus[i].z))));
+		}
+		return distance;
+	}
+
+	static float getPriority(const WorldChunk& chunk, const std::vector<glm::vec3>& focus) {
+		glm::vec3 center = getOrigin(chunk.X, chunk.Z) + glm::vec3(0.5f * WORLD_CHUNK_SIZE, 0.0f, 0.5f * WORLD_CHUNK_SIZE);
+		float priority = FLT_MAX;
+		for (unsigned int i = 0; i < focus.size(); i++) {
+			priority = std::min(priority, glm::length(glm::vec2(center.x - focus[i].x, center.z - focus[i].z)));
+		}
+		return priority;
+	}
+
+	std::map<uint64_t, std::unique_ptr<WorldChunk>>::iterator getFarthest(const std::vector<glm::vec3>& focus) {
+		auto farthest = resident.end();
+		float worst = -1.0f;
+		for (auto it = resident.begin(); it != resident.end(); ++it) {
+			float priority = getPriority(*it->second, focus);
+			if (priority > worst) {
+				worst = priority;
+				farthest = it;
+			}
+		}
+		return farthest;
+	}
+
+	std::map<uint64_t, std::unique_ptr<WorldChunk>>::iterator evict(std::map<uint64_t, std::unique_ptr<WorldChunk>>::iterator it) {
+		residentBytes -= it->second->Bytes;
+		Evicted++;
+		return resident.erase(it);
+	}
+
+	void loaderLoop() {
+		while (true) {
+			uint64_t key;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() {
+					return !running || !requests.empty();
+				});
+				if (!running) {
+					return;
+				}
+				key = requests.front();
+				requests.pop_front();
+			}
+
+			std::unique_ptr<WorldChunk> chunk(new WorldChunk());
+			chunk->X = (int)(int32_t)(uint32_t)(key >> 32);
+			chunk->Z = (int)(int32_t)(uint32_t)(key & 0xFFFFFFFF);
+			auto source = authored.find(key);
+			if (chunk->Content.load(getChunkPath(chunk->X, chunk->Z), true)) {
+				// Built chunk
+			} else if (source != authored.end()) {
+				chunk->Content.Boxes = source->second.Boxes;
+				chunk->Content.Plastics = source->second.Plastics;
+				chunk->Content.Sprites = source->second.Sprites;
+				chunk->Content.Lights = source->second.Lights;
+			} else if (generator) {
+				generator(chunk->X, chunk->Z, chunk->Content);
+			}
+			const Scene& content = chunk->Content;
+			chunk->Bytes = sizeof(WorldChunk) + (content.Boxes.size() + content.Plastics.size()) * sizeof(MeshInstance) +
+				content.Sprites.size() * sizeof(BillboardInstance) + content.Lights.size() * sizeof(SceneLight);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			results.push_back(std::move(chunk));
+		}
+	}
+};
+
+#endif // !WORLDSTREAMER_H
\ No newline at end of file
@@ -1,10 +1,120 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec3 TexCoords;
+// Only the FOG, GAMMA and MULTIVIEW features of ShaderVariants apply to the skybox.
+#ifndef FOG_MODE
+#define FOG_MODE 1
+#endif
+#ifndef FOG_DEPTH_TYPE
+#define FOG_DEPTH_TYPE 1
+#endif
+
+// std140, must match LightData in light.h
+struct Light {
+	vec3 position;
+	float constant;
+	vec3 direction;
+	float linear;
+	vec3 ambient;
+	float quadratic;
+	vec3 diffuse;
+	float cutoff;
+	vec3 specular;
+	float outerCutoff;
+	float exponent;
+	bool enable;
+	int caster;
+};
+
+// std140, must match FogData in fog.h
+struct Fog {
+	vec4 color;
+	int mode;
+	int depthType;
+	float density;
+	float f_start;
+	float f_end;
+	bool enable;
+};
+
+#define MAX_LIGHTS 8
+
+#ifdef MULTIVIEW
+#define SURFACE_BLOCK GS_OUT
+#else
+#define SURFACE_BLOCK VS_OUT
+#endif
+
+in SURFACE_BLOCK {
+	vec3 NaviePos;
+	vec3 FragPos;
+	vec3 Normal;
+	vec2 TexCoords;
+#ifdef MULTIVIEW
+	flat int ViewIndex;
+#endif
+} fs_in;
 
 uniform samplerCube skybox;
+// The direction light is the only light of the sky, its tint is computed once per frame
+uniform vec3 skyTint;
+
+layout(std140) uniform FrameData {
+	Light lights[MAX_LIGHTS];
+	Fog fog;
+	float GammaValue;
+};
+
+layout(std140) uniform ViewData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+	float clusterNear;
+	float clusterFar;
+};
+
+#ifdef MULTIVIEW
+#define NUM_VIEWS 4
+
+layout(std140) uniform MultiViewData {
+	mat4 views[NUM_VIEWS];
+	mat4 projections[NUM_VIEWS];
+	vec4 viewPositions[NUM_VIEWS];
+	vec4 viewClipPlanes[NUM_VIEWS];
+	vec4 viewports[NUM_VIEWS];
+};
+
+#define VIEW_POS viewPositions[fs_in.ViewIndex].xyz
+#else
+#define VIEW_POS viewPos
+#endif
+
+void main() {
+	vec4 texel = texture(skybox, normalize(fs_in.NaviePos));
+	vec4 FinalColor = vec4(clamp(texel.rgb * skyTint, 0.0, 1.0), texel.a);
+
+#ifdef FOG
+	#if FOG_DEPTH_TYPE == 0
+	float distance = abs((VIEW_POS - fs_in.FragPos).z);
+	#else
+	float distance = length(VIEW_POS - fs_in.FragPos);
+	#endif
+
+	#if FOG_MODE == 0
+	float fogFactor = clamp((fog.f_end - distance) / (fog.f_end - fog.f_start), 0.0, 1.0);
+	#elif FOG_MODE == 1
+	float fogFactor = clamp(1.0 / exp(fog.density * distance), 0.0, 1.0);
+	#else
+	float fogFactor = clamp(1.0 / exp(fog.density * distance * distance), 0.0, 1.0);
+	#endif
+
+	FinalColor = mix(fog.color, FinalColor, fogFactor);
+#endif
+
+#ifdef GAMMA
+	FinalColor = vec4(pow(FinalColor.xyz, vec3(GammaValue)), FinalColor.w);
+#endif
 
-void main() {    
-    FragColor = texture(skybox, TexCoords);
+	FragColor = FinalColor;
 }
\ No newline at end of file
@@ -1,14 +1,55 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+// Skybox, drawn after the opaque objects. The cube stays around the camera and is pushed to the far plane,
+// so the early depth test rejects every pixel already covered by the scene.
+layout(location = 0) in vec3 aPos;
 
-out vec3 TexCoords;
+#define NUM_VIEWS 4
+
+// Same block as lighting.vs, so lighting.gs can spread the skybox over the monitors of the quad view
+out VS_OUT {
+	vec3 NaviePos;
+	vec3 FragPos;
+	vec3 Normal;
+	vec2 TexCoords;
+#ifdef MULTIVIEW
+	vec4 ViewClip[NUM_VIEWS];
+#endif
+} vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout(std140) uniform ViewData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+	float clusterNear;
+	float clusterFar;
+};
+
+#ifdef MULTIVIEW
+// Must match MultiViewData in uniformbuffer.h
+layout(std140) uniform MultiViewData {
+	mat4 views[NUM_VIEWS];
+	mat4 projections[NUM_VIEWS];
+	vec4 viewPositions[NUM_VIEWS];
+	vec4 viewClipPlanes[NUM_VIEWS];
+	vec4 viewports[NUM_VIEWS];
+};
+#endif
 
 void main() {
-    TexCoords = aPos;    
-    vec4 pos = projection * view * model * vec4(aPos, 1.0);
-    gl_Position = pos.xyww;
+	vs_out.NaviePos = aPos;
+	vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
+	vs_out.Normal = vec3(0.0);
+	vs_out.TexCoords = vec2(0.0);
+
+	// Only the rotation of the view is kept, z = w puts every vertex at depth 1.0
+	gl_Position = (projection * mat4(mat3(view)) * vec4(vs_out.FragPos, 1.0)).xyww;
+
+#ifdef MULTIVIEW
+	for (int v = 0; v < NUM_VIEWS; v++) {
+		vs_out.ViewClip[v] = (projections[v] * mat4(mat3(views[v])) * vec4(vs_out.FragPos, 1.0)).xyww;
+	}
+#endif
 }
\ No newline at end of file
@@ -1,6 +1,14 @@
 #version 330 core
 out vec4 FragColor;
 
+// Features are injected as #define after the #version line by ShaderVariants, see shadervariants.h.
+#ifndef FOG_MODE
+#define FOG_MODE 1
+#endif
+#ifndef FOG_DEPTH_TYPE
+#define FOG_DEPTH_TYPE 1
+#endif
+
 struct Material {
 	vec4 ambient;
 	vec4 diffuse;
@@ -11,23 +19,40 @@ struct Material {
 	sampler2D diffuse_texture;
 	sampler2D specular_texture;
 	sampler2D emission_texture;
+};
 
-	bool enableColorTexture;
-    bool enableSpecularTexture;
-	bool enableEmission;
-    bool enableEmissionTexture;
+// std140, must match LightData in light.h
+struct Light {
+	vec3 position;
+	float constant;
+	vec3 direction;
+	float linear;
+	vec3 ambient;
+	float quadratic;
+	vec3 diffuse;
+	float cutoff;
+	vec3 specular;
+	float outerCutoff;
+	float exponent;
+	bool enable;
+	int caster;
 };
 
+// std140, must match FogData in fog.h
 struct Fog {
+	vec4 color;
 	int mode;
 	int depthType;
 	float density;
 	float f_start;
 	float f_end;
 	bool enable;
-	vec4 color;
 };
 
+// Only the enabled lights are packed: Direction Lights, then Point Lights, then Spot Lights.
+#define MAX_LIGHTS 8
+#define MAX_MATERIALS 32
+
 in VS_OUT {
 	vec3 NaviePos;
 	vec3 FragPos;
@@ -35,92 +60,111 @@ in VS_OUT {
 	vec2 TexCoords;
 } fs_in;
 
-uniform vec3 viewPos;
-uniform bool useLighting;
-uniform bool useDiffuseTexture;
-uniform bool useSpecularTexture;
-uniform bool useEmission;
-uniform bool useGamma;
-uniform float GammaValue;
+uniform Material material;
 
-uniform bool isCubeMap;
-uniform samplerCube skybox;
+#if defined(INSTANCED) || defined(PARTS)
+// std140, must match MaterialEntry in uniformbuffer.h
+struct MaterialEntry {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float shininess;
+};
 
-uniform Material material;
-uniform Fog fog;
+layout(std140) uniform MaterialData {
+	MaterialEntry materials[MAX_MATERIALS];
+};
+
+flat in int MaterialIndex;
+#define MATERIAL materials[MaterialIndex]
+#else
+#define MATERIAL material
+#endif
+
+#ifdef BILLBOARD
+// Sprites are layers of one texture array, the layer is picked per instance in the vertex shader
+uniform sampler2DArray sprites;
+flat in float SpriteLayer;
+#define DIFFUSE_TEXEL texture(sprites, vec3(fs_in.TexCoords, SpriteLayer))
+#else
+#define DIFFUSE_TEXEL texture(material.diffuse_texture, fs_in.TexCoords)
+#endif
+
+layout(std140) uniform FrameData {
+	Light lights[MAX_LIGHTS];
+	Fog fog;
+	float GammaValue;
+};
+
+layout(std140) uniform ViewData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+	float clusterNear;
+	float clusterFar;
+};
 
 void main() {
 
-	vec4 texel_diffuse = vec4(0.0);
-	if (isCubeMap) {
-		// øsѪŲ
-		texel_diffuse = texture(skybox, normalize(fs_in.NaviePos));
-	} else if (useDiffuseTexture && material.enableColorTexture) {
-		// pG}ܧ B Ӫ馳KϮ => Ϥ
-		texel_diffuse = texture(material.diffuse_texture, fs_in.TexCoords);
-	} else {
-		// ¦
-		texel_diffuse = material.diffuse;
-	}
+#if defined(DIFFUSE_TEXTURE) || defined(BILLBOARD)
+	// pG}ܧ B Ӫ馳KϮ => Ϥ
+	vec4 texel_diffuse = DIFFUSE_TEXEL;
+#else
+	// ¦
+	vec4 texel_diffuse = MATERIAL.diffuse;
+#endif
 
-	vec3 texel = vec3(0.0);
-	texel = texel_diffuse.rgb * fs_in.Color;
+	vec3 texel = texel_diffuse.rgb * fs_in.Color;
 
 	// }Ҧ۵o
-	if (useEmission && material.enableEmission) {
-		if (material.enableEmissionTexture) {
-			// ϥΧ
-			texel += texture(material.emission_texture, fs_in.TexCoords).rgb;
-		} else {
-			// ϥC
-			texel += texel_diffuse.rgb * 1.5;
-		}
-	}
+#if defined(EMISSION) && defined(EMISSION_TEXTURE)
+	// ϥΧ
+	texel += texture(material.emission_texture, fs_in.TexCoords).rgb;
+#elif defined(EMISSION)
+	// ϥC
+	texel += texel_diffuse.rgb * 1.5;
+#endif
 
 	// hz
 	if (texel_diffuse.a < 0.1) {
 		discard;
 	}
 
-	if (useLighting) {
-		// Foggy Effect
-		vec4 PreColor = vec4(clamp(texel, 0.0, 1.0), texel_diffuse.a);
-		vec4 FinalColor = vec4(0.0);
-		float distance = 0.0;
-		float fogFactor = 0.0;
-
-		if (fog.depthType == 0) {
-			// Plane Based
-			distance = abs((viewPos - fs_in.FragPos).z);
-		} else {
-			// Range Based
-			distance = length(viewPos - fs_in.FragPos);
-		}
-
-		if (fog.enable) {
-			if (fog.mode == 0) {
-			// Foggy Effect Linear
-			fogFactor = clamp((fog.f_end - distance) / (fog.f_end - fog.f_start), 0.0, 1.0);
-			} else if (fog.mode == 1) {
-				// Foggy Effect EXP
-				fogFactor = clamp(1.0 / exp(fog.density * distance), 0.0, 1.0);
-			} else if (fog.mode == 2) {
-				// Foggy Effect EXP2
-				fogFactor = clamp(1.0 / exp(fog.density * distance * distance), 0.0, 1.0);
-			}
-			FinalColor = mix(fog.color, PreColor, fogFactor);
-		} else {
-			// Close Foggy Effect
-			FinalColor = PreColor;
-		}
-
-		// {ե
-		if (useGamma) {
-			FinalColor = vec4(pow(FinalColor.xyz, vec3(GammaValue)), FinalColor.w);
-		}
-
-		FragColor = FinalColor;
-	} else {
-		FragColor = vec4(texel, texel_diffuse.a);
-	}
+#ifdef LIGHTING
+	// Foggy Effect
+	vec4 FinalColor = vec4(clamp(texel, 0.0, 1.0), texel_diffuse.a);
+
+#ifdef FOG
+	#if FOG_DEPTH_TYPE == 0
+	// Plane Based
+	float distance = abs((viewPos - fs_in.FragPos).z);
+	#else
+	// Range Based
+	float distance = length(viewPos - fs_in.FragPos);
+	#endif
+
+	#if FOG_MODE == 0
+	// Foggy Effect Linear
+	float fogFactor = clamp((fog.f_end - distance) / (fog.f_end - fog.f_start), 0.0, 1.0);
+	#elif FOG_MODE == 1
+	// Foggy Effect EXP
+	float fogFactor = clamp(1.0 / exp(fog.density * distance), 0.0, 1.0);
+	#else
+	// Foggy Effect EXP2
+	float fogFactor = clamp(1.0 / exp(fog.density * distance * distance), 0.0, 1.0);
+	#endif
+
+	FinalColor = mix(fog.color, FinalColor, fogFactor);
+#endif
+
+	// {ե
+#ifdef GAMMA
+	FinalColor = vec4(pow(FinalColor.xyz, vec3(GammaValue)), FinalColor.w);
+#endif
+
+	FragColor = FinalColor;
+#else
+	FragColor = vec4(texel, texel_diffuse.a);
+#endif
 }
\ No newline at end of file
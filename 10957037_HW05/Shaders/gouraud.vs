@@ -2,6 +2,24 @@
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTextureCoords;
+layout(location = 3) in vec3 aInstancePosition;
+layout(location = 4) in vec2 aInstanceSize;
+layout(location = 5) in float aInstanceMode;
+layout(location = 6) in vec4 aInstanceTransform;
+layout(location = 7) in vec2 aInstanceParams;
+layout(location = 8) in vec2 aPart;
+layout(location = 9) in vec3 aInstanceSprite;
+
+// Features are injected as #define after the #version line by ShaderVariants, see shadervariants.h.
+#ifndef NUM_DIR_LIGHTS
+#define NUM_DIR_LIGHTS 0
+#endif
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+#ifndef NUM_SPOT_LIGHTS
+#define NUM_SPOT_LIGHTS 0
+#endif
 
 struct Material {
 	vec4 ambient;
@@ -13,35 +31,40 @@ struct Material {
 	sampler2D diffuse_texture;
 	sampler2D specular_texture;
 	sampler2D emission_texture;
-
-	bool enableColorTexture;
-    bool enableSpecularTexture;
-	bool enableEmission;
-    bool enableEmissionTexture;
 };
 
+// std140, must match LightData in light.h
 struct Light {
 	vec3 position;
-	vec3 direction;
-	
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-
 	float constant;
+	vec3 direction;
 	float linear;
+	vec3 ambient;
 	float quadratic;
-
+	vec3 diffuse;
 	float cutoff;
+	vec3 specular;
 	float outerCutoff;
 	float exponent;
-
 	bool enable;
 	int caster;
 };
 
-// 0 Direction Light; 1 ~ 5 Point Light; 6 ~ 7 Spot Light;
-#define NUM_LIGHTS 8
+// std140, must match FogData in fog.h
+struct Fog {
+	vec4 color;
+	int mode;
+	int depthType;
+	float density;
+	float f_start;
+	float f_end;
+	bool enable;
+};
+
+// Only the enabled lights are packed: Direction Lights, then Point Lights, then Spot Lights.
+#define MAX_LIGHTS 8
+#define MAX_MATERIALS 32
+#define MAX_JOINTS 4
 
 out VS_OUT {
 	vec3 NaviePos;
@@ -51,126 +74,170 @@ out VS_OUT {
 } vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-uniform vec3 viewPos;
-uniform bool useBlinnPhong;
-uniform bool useSpotExponent;
-uniform bool useLighting;
+uniform mat3 normalMatrix;	// transpose(inverse(mat3(model))), computed on the CPU, see normalmatrix.h
+uniform mat4 joints[MAX_JOINTS];
+uniform float spriteFrameRate;
 
-uniform bool isCubeMap;
-uniform samplerCube skybox;
+#ifdef BILLBOARD
+flat out float SpriteLayer;
+#endif
 
 uniform Material material;
-uniform Light lights[NUM_LIGHTS];
 
-vec3 CalcLight(Light light, vec3 normal, vec3 viewDir) {
+#if defined(INSTANCED) || defined(PARTS)
+// std140, must match MaterialEntry in uniformbuffer.h
+struct MaterialEntry {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float shininess;
+};
+
+layout(std140) uniform MaterialData {
+	MaterialEntry materials[MAX_MATERIALS];
+};
 
-	vec3 ambient = vec3(0.0);
-	vec3 diffuse = vec3(0.0);
-	vec3 specular = vec3(0.0);
+flat out int MaterialIndex;
+#define MATERIAL materials[MaterialIndex]
+#else
+#define MATERIAL material
+#endif
 
-	vec3 lightDir = vec3(0.0);
-	if (light.caster == 0) {
-		// Direction Light
-		lightDir = normalize(-light.direction);
-	} else {
-		lightDir = normalize(light.position - vs_out.FragPos);
-	}
+layout(std140) uniform FrameData {
+	Light lights[MAX_LIGHTS];
+	Fog fog;
+	float GammaValue;
+};
+
+layout(std140) uniform ViewData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+	float clusterNear;
+	float clusterFar;
+};
 
+float CalcSpecular(vec3 lightDir, vec3 normal, vec3 viewDir) {
+#ifdef BLINN_PHONG
+	vec3 halfway = normalize(lightDir + viewDir);
+	return pow(max(dot(normal, halfway), 0.0), MATERIAL.shininess);
+#else
+	vec3 reflectDir = reflect(-lightDir, normal);
+	return pow(max(dot(viewDir, reflectDir), 0.0), MATERIAL.shininess);
+#endif
+}
+
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir) {
+	vec3 lightDir = normalize(-light.direction);
 	float diff = max(dot(normal, lightDir), 0.0);
+	float spec = CalcSpecular(lightDir, normal, viewDir);
 
-	float spec = 0.0;
-	if (useBlinnPhong) {
-		vec3 halfway = normalize(lightDir + viewDir);
-		spec = pow(max(dot(normal, halfway), 0.0), material.shininess);
-	} else {
-		vec3 reflectDir = reflect(-lightDir, normal);
-		spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	}
+	return light.ambient + light.diffuse * diff + light.specular * spec;
+}
+
+vec3 CalcPointLight(Light light, vec3 normal, vec3 viewDir) {
+	vec3 lightDir = normalize(light.position - vs_out.FragPos);
+	float diff = max(dot(normal, lightDir), 0.0);
+	float spec = CalcSpecular(lightDir, normal, viewDir);
+
+	float distance = length(light.position - vs_out.FragPos);
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+
+	return (light.ambient + light.diffuse * diff + light.specular * spec) * attenuation;
+}
 
-	ambient = light.ambient;
-	diffuse = light.diffuse * diff;
-	specular = light.specular * spec;
-
-	if (light.caster == 0) {
-		// Direction Light
-		if (isCubeMap) {
-			ambient = light.diffuse;
-			diffuse = light.diffuse;
-			specular *= 0.0f;
-		}
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 viewDir) {
+	vec3 lightDir = normalize(light.position - vs_out.FragPos);
+	float theta = dot(lightDir, normalize(-light.direction));
+
+#ifdef SPOT_EXPONENT
+	float intensity = (theta >= light.cutoff) ? clamp(pow(theta, light.exponent), 0.0, 1.0) : 0.0;
+#else
+	float epsilon = light.cutoff - light.outerCutoff;
+	float intensity = clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
+#endif
+
+	return CalcPointLight(light, normal, viewDir) * intensity;
+}
+
+// Scale and move the mesh to this instance, the bobbing is evaluated here instead of on the CPU.
+vec3 InstancePosition(vec3 position) {
+	float bobbing = sin(time * 3.0 + aInstanceTransform.z) / 4.0 * aInstanceParams.x;
+	return aInstanceTransform.xyz + position * aInstanceTransform.w + vec3(0.0, bobbing, 0.0);
+}
+
+// Expand the billboard quad of this instance along the axes facing the camera.
+vec3 BillboardPosition() {
+	mat4 view_model = view * model;
+
+	vec3 billboard_x = vec3(0.0);
+	vec3 billboard_y = vec3(0.0);
+	vec3 billboard_z = vec3(0.0);
+
+#ifndef BILLBOARD_FIXED
+	billboard_z = vec3(view_model[0][2], view_model[1][2], view_model[2][2]);
+	if (aInstanceMode < 0.5) {
+		// Cylindrical: Y axis is fixed
+		billboard_x = vec3(billboard_z.z, 0.0, -billboard_z.x);
+		billboard_y = vec3(0.0, 1.0, 0.0);
 	} else {
-		// Point Light or Spot Light
-		if (isCubeMap) {
-			ambient *= 0.0f;
-			diffuse *= 0.0f;
-			specular *= 0.0f;
-		} else {
-			float distance = length(light.position - vs_out.FragPos);
-			float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-
-			ambient *= attenuation;
-			diffuse *= attenuation;
-			specular *= attenuation;
-
-			if (light.caster == 2) {
-				// Spot Light
-				float intensity = 0.0f;
-				if (useSpotExponent) {
-					float theta = dot(lightDir, normalize(-light.direction));
-					if (theta >= light.cutoff) {
-						intensity = clamp(pow(theta, light.exponent), 0.0, 1.0);
-					} else {
-						intensity = 0.0f;
-					}
-				} else {
-					float theta = dot(lightDir, normalize(-light.direction));
-					float epsilon = light.cutoff - light.outerCutoff;
-					intensity = clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
-				}
-
-				ambient *= intensity;
-				diffuse *= intensity;
-				specular *= intensity;
-			}
-		}
+		// Spherical: Y axis is not fixed
+		billboard_x = vec3(view_model[0][0], view_model[1][0], view_model[2][0]);
+		billboard_y = vec3(view_model[0][1], view_model[1][1], view_model[2][1]);
 	}
+#else
+	billboard_z = vec3(0.0, 0.0, -1.0);
+	billboard_x = vec3(billboard_z.z, 0.0, -billboard_z.x);
+	billboard_y = vec3(0.0, 1.0, 0.0);
+#endif
 
-	return ambient + diffuse + specular;
+	return aInstancePosition + aPosition.x * aInstanceSize.x * billboard_x + aPosition.y * aInstanceSize.y * billboard_y;
 }
 
 void main() {
-	vs_out.NaviePos = aPosition;
-	vs_out.FragPos =  vec3(model * vec4(aPosition, 1.0));
-	vec3 Normal = mat3(transpose(inverse(model))) * aNormal;
+	vec3 normal = aNormal;
+#if defined(BILLBOARD)
+	vec3 position = BillboardPosition();
+	// x: first layer, y: number of frames, z: phase offset in frames
+	SpriteLayer = aInstanceSprite.x + mod(floor(time * spriteFrameRate + aInstanceSprite.z), aInstanceSprite.y);
+#elif defined(INSTANCED)
+	vec3 position = InstancePosition(aPosition);
+	MaterialIndex = int(aInstanceParams.y + 0.5);
+#elif defined(PARTS)
+	// The joints are rigid, so their rotation can be applied to the normal directly
+	mat4 joint = joints[int(aPart.x + 0.5)];
+	vec3 position = vec3(joint * vec4(aPosition, 1.0));
+	normal = mat3(joint) * aNormal;
+	MaterialIndex = int(aPart.y + 0.5);
+#else
+	vec3 position = aPosition;
+#endif
+	vs_out.NaviePos = position;
+	vs_out.FragPos =  vec3(model * vec4(position, 1.0));
+	vec3 Normal = normalMatrix * normal;
 	vs_out.TexCoords = aTextureCoords;
 	
-	if (isCubeMap) {
-		// øsѪŲ
-		mat4 view_new = mat4(mat3(view));
-		vec4 pos = projection * view_new * vec4(vs_out.FragPos, 1.0);
-		gl_Position = pos.xyww;
-	} else {
-		gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
-	}
+	gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
 
 	// O_}ҥ
-	if (useLighting) {
-		// p
-		vec3 norm = normalize(Normal);
-		vec3 viewDir = normalize(viewPos - vs_out.FragPos);
-
-		vec3 illumination = vec3(0.0f);
-		for (int i = 0; i < NUM_LIGHTS; i++) {
-			if (!lights[i].enable) {
-				continue;
-			}
-			illumination += CalcLight(lights[i], norm, viewDir);
-		}
-		vs_out.Color = clamp(illumination, 0.0, 1.0);
-	} else {
-		vs_out.Color = vec3(1.0f);
+#ifdef LIGHTING
+	// p
+	vec3 norm = normalize(Normal);
+	vec3 viewDir = normalize(viewPos - vs_out.FragPos);
+
+	vec3 illumination = vec3(0.0f);
+	for (int i = 0; i < NUM_DIR_LIGHTS; i++) {
+		illumination += CalcDirLight(lights[i], norm, viewDir);
+	}
+	for (int i = 0; i < NUM_POINT_LIGHTS; i++) {
+		illumination += CalcPointLight(lights[NUM_DIR_LIGHTS + i], norm, viewDir);
+	}
+	for (int i = 0; i < NUM_SPOT_LIGHTS; i++) {
+		illumination += CalcSpotLight(lights[NUM_DIR_LIGHTS + NUM_POINT_LIGHTS + i], norm, viewDir);
 	}
+	vs_out.Color = clamp(illumination, 0.0, 1.0);
+#else
+	vs_out.Color = vec3(1.0f);
+#endif
 }
\ No newline at end of file
@@ -1,5 +1,30 @@
 #version 330 core
+#ifdef DEFERRED
+// Geometry pass of deferred shading, the LIGHTING_PASS variant lights the surface later, see gbuffer.h
+layout(location = 0) out vec4 gAlbedo;
+layout(location = 1) out vec4 gAmbient;
+layout(location = 2) out vec4 gSpecular;
+layout(location = 3) out vec4 gNormal;
+#else
 out vec4 FragColor;
+#endif
+
+// Features are injected as #define after the #version line by ShaderVariants, see shadervariants.h.
+#ifndef NUM_DIR_LIGHTS
+#define NUM_DIR_LIGHTS 0
+#endif
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+#ifndef NUM_SPOT_LIGHTS
+#define NUM_SPOT_LIGHTS 0
+#endif
+#ifndef FOG_MODE
+#define FOG_MODE 1
+#endif
+#ifndef FOG_DEPTH_TYPE
+#define FOG_DEPTH_TYPE 1
+#endif
 
 struct Material {
 	vec4 ambient;
@@ -11,250 +36,401 @@ struct Material {
 	sampler2D diffuse_texture;
 	sampler2D specular_texture;
 	sampler2D emission_texture;
-
-	bool enableColorTexture;
-    bool enableSpecularTexture;
-	bool enableEmission;
-    bool enableEmissionTexture;
 };
 
+// std140, must match LightData in light.h
 struct Light {
 	vec3 position;
-	vec3 direction;
-	
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-
 	float constant;
+	vec3 direction;
 	float linear;
+	vec3 ambient;
 	float quadratic;
-
+	vec3 diffuse;
 	float cutoff;
+	vec3 specular;
 	float outerCutoff;
 	float exponent;
-
 	bool enable;
 	int caster;
 };
 
+// std140, must match FogData in fog.h
 struct Fog {
+	vec4 color;
 	int mode;
 	int depthType;
 	float density;
 	float f_start;
 	float f_end;
 	bool enable;
-	vec4 color;
 };
 
-// 0 Direction Light; 1 ~ 5 Point Light; 6 ~ 7 Spot Light;
-#define NUM_LIGHTS 8
+// Only the enabled lights are packed: Direction Lights, then Point Lights, then Spot Lights.
+#define MAX_LIGHTS 8
+#define MAX_MATERIALS 32
+
+#ifdef LIGHTING_PASS
+// Lighting pass of deferred shading, the surface is read back from the G-buffer by ReadGBuffer()
+uniform sampler2D gbufferAlbedo;
+uniform sampler2D gbufferAmbient;
+uniform sampler2D gbufferSpecular;
+uniform sampler2D gbufferNormal;
+uniform sampler2D gbufferDepth;
+uniform mat4 inverseViewProjection;
+uniform vec4 viewportRect;
+
+struct GBufferSample {
+	vec3 FragPos;
+	vec3 Normal;
+};
 
-in VS_OUT {
+GBufferSample fs_in;
+float surfaceEmission;
+#else
+// With MULTIVIEW the vertices come through lighting.gs, which adds the monitor of the triangle
+#ifdef MULTIVIEW
+#define SURFACE_BLOCK GS_OUT
+#else
+#define SURFACE_BLOCK VS_OUT
+#endif
+
+in SURFACE_BLOCK {
 	vec3 NaviePos;
 	vec3 FragPos;
 	vec3 Normal;
 	vec2 TexCoords;
+#if defined(INSTANCED) || defined(PARTS)
+	flat int MaterialIndex;
+#endif
+#ifdef BILLBOARD
+	flat float SpriteLayer;
+#endif
+#ifdef MULTIVIEW
+	flat int ViewIndex;
+#endif
 } fs_in;
+#endif
 
-uniform vec3 viewPos;
-uniform bool useBlinnPhong;
-uniform bool useSpotExponent;
-uniform bool useLighting;
-uniform bool useDiffuseTexture;
-uniform bool useSpecularTexture;
-uniform bool useEmission;
-uniform bool useGamma;
-uniform float GammaValue;
+uniform Material material;
 
-uniform bool isCubeMap;
-uniform samplerCube skybox;
+#if defined(INSTANCED) || defined(PARTS)
+// std140, must match MaterialEntry in uniformbuffer.h
+struct MaterialEntry {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float shininess;
+};
 
-uniform Material material;
-uniform Light lights[NUM_LIGHTS];
-uniform Fog fog;
+layout(std140) uniform MaterialData {
+	MaterialEntry materials[MAX_MATERIALS];
+};
 
-vec3 CalcLight(Light light, vec3 normal, vec3 viewDir, vec4 texel_ambient, vec4 texel_diffuse, vec4 texel_specular) {
+#define MATERIAL materials[fs_in.MaterialIndex]
+#elif defined(LIGHTING_PASS)
+struct SurfaceMaterial {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float shininess;
+};
 
-	vec3 ambient = vec3(0.0);
-	vec3 diffuse = vec3(0.0);
-	vec3 specular = vec3(0.0);
+SurfaceMaterial surface;
+#define MATERIAL surface
+#else
+#define MATERIAL material
+#endif
+
+#ifdef BILLBOARD
+// Sprites are layers of one texture array, the layer is picked per instance in the vertex shader
+uniform sampler2DArray sprites;
+#define DIFFUSE_TEXEL texture(sprites, vec3(fs_in.TexCoords, fs_in.SpriteLayer))
+#else
+#define DIFFUSE_TEXEL texture(material.diffuse_texture, fs_in.TexCoords)
+#endif
+
+layout(std140) uniform FrameData {
+	Light lights[MAX_LIGHTS];
+	Fog fog;
+	float GammaValue;
+};
 
-	vec3 lightDir = vec3(0.0);
-	if (light.caster == 0) {
-		// Direction Light
-		lightDir = normalize(-light.direction);
-	} else {
-		lightDir = normalize(light.position - fs_in.FragPos);
-	}
+layout(std140) uniform ViewData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+	float clusterNear;
+	float clusterFar;
+};
 
-	float diff = max(dot(normal, lightDir), 0.0);
+#ifdef MULTIVIEW
+// Every monitor of the quad view in one pass, must match MultiViewData in uniformbuffer.h
+#define NUM_VIEWS 4
 
-	float spec = 0.0;
-	if (useBlinnPhong) {
-		vec3 halfway = normalize(lightDir + viewDir);
-		spec = pow(max(dot(normal, halfway), 0.0), material.shininess);
-	} else {
-		vec3 reflectDir = reflect(-lightDir, normal);
-		spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	}
+layout(std140) uniform MultiViewData {
+	mat4 views[NUM_VIEWS];
+	mat4 projections[NUM_VIEWS];
+	vec4 viewPositions[NUM_VIEWS];
+	vec4 viewClipPlanes[NUM_VIEWS];
+	vec4 viewports[NUM_VIEWS];
+};
 
-	ambient = light.ambient * texel_ambient.rgb;
-	diffuse = light.diffuse * diff * texel_diffuse.rgb;
-	specular = light.specular * spec * texel_specular.rgb;
+#define VIEW_POS viewPositions[fs_in.ViewIndex].xyz
+#define VIEW_MATRIX views[fs_in.ViewIndex]
+#define PROJECTION_MATRIX projections[fs_in.ViewIndex]
+#define CLUSTER_NEAR viewClipPlanes[fs_in.ViewIndex].x
+#define CLUSTER_FAR viewClipPlanes[fs_in.ViewIndex].y
+#define CLUSTER_VIEW_OFFSET (fs_in.ViewIndex * CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#else
+#define VIEW_POS viewPos
+#define VIEW_MATRIX view
+#define PROJECTION_MATRIX projection
+#define CLUSTER_NEAR clusterNear
+#define CLUSTER_FAR clusterFar
+#define CLUSTER_VIEW_OFFSET 0
+#endif
+
+float CalcSpecular(vec3 lightDir, vec3 normal, vec3 viewDir) {
+#ifdef BLINN_PHONG
+	vec3 halfway = normalize(lightDir + viewDir);
+	return pow(max(dot(normal, halfway), 0.0), MATERIAL.shininess);
+#else
+	vec3 reflectDir = reflect(-lightDir, normal);
+	return pow(max(dot(viewDir, reflectDir), 0.0), MATERIAL.shininess);
+#endif
+}
 
-	if (light.caster == 0) {
-		// Direction Light
-		if (isCubeMap) {
-			ambient = light.diffuse * texel_ambient.rgb;
-			diffuse = light.diffuse * texel_diffuse.rgb;
-			specular *= 0.0f;
-		}
-	} else {
-		// Point Light or Spot Light
-		if (isCubeMap) {
-			ambient *= 0.0f;
-			diffuse *= 0.0f;
-			specular *= 0.0f;
-		} else {
-			float distance = length(light.position - fs_in.FragPos);
-			float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-
-			ambient *= attenuation;
-			diffuse *= attenuation;
-			specular *= attenuation;
-
-			if (light.caster == 2) {
-				// Spot Light
-				float intensity = 0.0f;
-				if (useSpotExponent) {
-					float theta = dot(lightDir, normalize(-light.direction));
-					if (theta >= light.cutoff) {
-						intensity = clamp(pow(theta, light.exponent), 0.0, 1.0);
-					} else {
-						intensity = 0.0f;
-					}
-				} else {
-					float theta = dot(lightDir, normalize(-light.direction));
-					float epsilon = light.cutoff - light.outerCutoff;
-					intensity = clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
-				}
-
-				ambient *= intensity;
-				diffuse *= intensity;
-				specular *= intensity;
-			}
-		}
-	}
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir, vec4 texel_ambient, vec4 texel_diffuse, vec4 texel_specular) {
+	vec3 lightDir = normalize(-light.direction);
+	float diff = max(dot(normal, lightDir), 0.0);
+	float spec = CalcSpecular(lightDir, normal, viewDir);
 
+	vec3 ambient = light.ambient * texel_ambient.rgb;
+	vec3 diffuse = light.diffuse * diff * texel_diffuse.rgb;
+	vec3 specular = light.specular * spec * texel_specular.rgb;
 	return ambient + diffuse + specular;
 }
 
-void main() {
-	vec3 norm = normalize(fs_in.Normal);
-	vec3 viewDir = normalize(viewPos - fs_in.FragPos);
-
-	vec4 texel_ambient = vec4(0.0);
-	vec4 texel_diffuse = vec4(0.0);
-	vec4 texel_specular = vec4(0.0);
-	if (isCubeMap) {
-		// ĥ cubemap
-		texel_ambient = texture(skybox, normalize(fs_in.NaviePos));
-		texel_diffuse = texture(skybox, normalize(fs_in.NaviePos));
-		texel_specular = texture(skybox, normalize(fs_in.NaviePos));
-	} else if (useDiffuseTexture && material.enableColorTexture) {
-		// pG}ܧ B Ӫ馳KϮ => Ϥ
-		texel_ambient = texture(material.diffuse_texture, fs_in.TexCoords);
-		texel_diffuse = texture(material.diffuse_texture, fs_in.TexCoords);
-		if (useSpecularTexture && material.enableSpecularTexture) {
-			texel_specular = texture(material.specular_texture, fs_in.TexCoords);
-		} else {
-			texel_specular = texture(material.diffuse_texture, fs_in.TexCoords);
-		}
-	} else {
-		// ¦
-		texel_ambient = material.ambient;
-		texel_diffuse = material.diffuse;
-		if (useSpecularTexture && material.enableSpecularTexture) {
-			texel_specular = texture(material.specular_texture, fs_in.TexCoords);
-		} else {
-			texel_specular = material.specular;
-		}
-	}
+vec3 CalcPointLight(Light light, vec3 normal, vec3 viewDir, vec4 texel_ambient, vec4 texel_diffuse, vec4 texel_specular) {
+	vec3 lightDir = normalize(light.position - fs_in.FragPos);
+	float diff = max(dot(normal, lightDir), 0.0);
+	float spec = CalcSpecular(lightDir, normal, viewDir);
 
-	// O_}ҥ
-	if (!useLighting) {
-		// hz
-		if (texel_diffuse.a < 0.1) {
-			discard;
-		}
+	vec3 ambient = light.ambient * texel_ambient.rgb;
+	vec3 diffuse = light.diffuse * diff * texel_diffuse.rgb;
+	vec3 specular = light.specular * spec * texel_specular.rgb;
 
-		FragColor = texel_diffuse;
-	} else {
-		// p
-		vec3 illumination = vec3(0.0);
+	float distance = length(light.position - fs_in.FragPos);
+	float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
-		for (int i = 0; i < NUM_LIGHTS; i++) {
-			if (!lights[i].enable) {
-				continue;
-			}
-			illumination += CalcLight(lights[i], norm, viewDir, texel_ambient, texel_diffuse, texel_specular);
-		}
+	return (ambient + diffuse + specular) * attenuation;
+}
 
-		// }Ҧ۵o
-		if (useEmission && material.enableEmission) {
-			// }Ҧ۵oﶵ B Ӫ馳}Ҧ۵o
-			if (material.enableEmissionTexture) {
-				// ϥΦ۵o
-				illumination += texture(material.emission_texture, fs_in.TexCoords).rgb;
-			} else {
-				// ϥΦ۵oC
-				illumination += texel_diffuse.rgb * 1.5;
-			}
-		}
+vec3 CalcSpotLight(Light light, vec3 normal, vec3 viewDir, vec4 texel_ambient, vec4 texel_diffuse, vec4 texel_specular) {
+	vec3 lightDir = normalize(light.position - fs_in.FragPos);
+	float theta = dot(lightDir, normalize(-light.direction));
 
-		// hz
-		if (texel_diffuse.a < 0.1) {
-			discard;
-		}
+#ifdef SPOT_EXPONENT
+	float intensity = (theta >= light.cutoff) ? clamp(pow(theta, light.exponent), 0.0, 1.0) : 0.0;
+#else
+	float epsilon = light.cutoff - light.outerCutoff;
+	float intensity = clamp((theta - light.outerCutoff) / epsilon, 0.0, 1.0);
+#endif
 
-		// Foggy Effect
-		vec4 PreColor = vec4(clamp(illumination, 0.0, 1.0), texel_diffuse.a);
-		vec4 FinalColor = vec4(0.0);
-		float distance = 0.0;
-		float fogFactor = 0.0;
+	return CalcPointLight(light, normal, viewDir, texel_ambient, texel_diffuse, texel_specular) * intensity;
+}
 
-		if (fog.depthType == 0) {
-			// Plane Based
-			distance = abs((viewPos - fs_in.FragPos).z);
-		} else {
-			// Range Based
-			distance = length(viewPos - fs_in.FragPos);
-		}
+#ifdef CLUSTERED
+// Point and spot lights binned into a froxel grid on the CPU, must match lightclusters.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+
+uniform samplerBuffer clusterLights;	// 6 texels per light, same layout as LightData
+uniform usamplerBuffer clusterGrid;		// x: offset into the index list, y: number of lights
+uniform usamplerBuffer clusterIndices;
+
+Light FetchLight(int index) {
+	vec4 t0 = texelFetch(clusterLights, index * 6);
+	vec4 t1 = texelFetch(clusterLights, index * 6 + 1);
+	vec4 t2 = texelFetch(clusterLights, index * 6 + 2);
+	vec4 t3 = texelFetch(clusterLights, index * 6 + 3);
+	vec4 t4 = texelFetch(clusterLights, index * 6 + 4);
+	vec4 t5 = texelFetch(clusterLights, index * 6 + 5);
+
+	Light light;
+	light.position = t0.xyz;
+	light.constant = t0.w;
+	light.direction = t1.xyz;
+	light.linear = t1.w;
+	light.ambient = t2.xyz;
+	light.quadratic = t2.w;
+	light.diffuse = t3.xyz;
+	light.cutoff = t3.w;
+	light.specular = t4.xyz;
+	light.outerCutoff = t4.w;
+	light.exponent = t5.x;
+	light.enable = true;
+	light.caster = floatBitsToInt(t5.z);
+	return light;
+}
 
-		if (fog.enable) {
-			if (fog.mode == 0) {
-			// Foggy Effect Linear
-			fogFactor = clamp((fog.f_end - distance) / (fog.f_end - fog.f_start), 0.0, 1.0);
-			} else if (fog.mode == 1) {
-				// Foggy Effect EXP
-				fogFactor = clamp(1.0 / exp(fog.density * distance), 0.0, 1.0);
-			} else if (fog.mode == 2) {
-				// Foggy Effect EXP2
-				fogFactor = clamp(1.0 / exp(fog.density * distance * distance), 0.0, 1.0);
-			}
-			FinalColor = mix(fog.color, PreColor, fogFactor);
-		} else {
-			// Close Foggy Effect
-			FinalColor = PreColor;
-		}
+// Offset and count of the lights in the cluster of this fragment, sliced like LightClusters::build()
+uvec2 FetchCluster() {
+	vec4 viewPosition = VIEW_MATRIX * vec4(fs_in.FragPos, 1.0);
+	vec4 clip = PROJECTION_MATRIX * viewPosition;
+	ivec2 cell = clamp(ivec2((clip.xy / clip.w * 0.5 + 0.5) * vec2(CLUSTER_X, CLUSTER_Y)), ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	float depth = max(-viewPosition.z, CLUSTER_NEAR);
+	int slice = clamp(int(log(depth / CLUSTER_NEAR) / log(CLUSTER_FAR / CLUSTER_NEAR) * float(CLUSTER_Z)), 0, CLUSTER_Z - 1);
+	return texelFetch(clusterGrid, CLUSTER_VIEW_OFFSET + (slice * CLUSTER_Y + cell.y) * CLUSTER_X + cell.x).xy;
+}
+#endif
+
+#ifdef LIGHTING_PASS
+// Rebuild the world position from the depth, the pixels without geometry are left to the skybox
+void ReadGBuffer() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gbufferDepth, pixel, 0).r;
+	if (depth == 1.0) {
+		discard;
+	}
+	vec2 ndc = (gl_FragCoord.xy - viewportRect.xy) / viewportRect.zw * 2.0 - 1.0;
+	vec4 position = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+	vec4 normal = texelFetch(gbufferNormal, pixel, 0);
+	vec4 ambient = texelFetch(gbufferAmbient, pixel, 0);
+
+	fs_in.FragPos = position.xyz / position.w;
+	fs_in.Normal = normal.xyz;
+	surface.ambient = vec4(ambient.rgb, 1.0);
+	surface.diffuse = vec4(texelFetch(gbufferAlbedo, pixel, 0).rgb, 1.0);
+	surface.specular = vec4(texelFetch(gbufferSpecular, pixel, 0).rgb, 1.0);
+	surface.shininess = normal.w;
+	surfaceEmission = ambient.a;
+
+	// The blended objects and the skybox are drawn after this pass, so they need the depth of the scene
+	gl_FragDepth = depth;
+}
+#endif
 
-		// {ե
-		if (useGamma) {
-			FinalColor = vec4(pow(FinalColor.xyz, vec3(GammaValue)), FinalColor.w);
-		}
+void main() {
+#ifdef LIGHTING_PASS
+	ReadGBuffer();
+#endif
+	vec3 norm = normalize(fs_in.Normal);
+	vec3 viewDir = normalize(VIEW_POS - fs_in.FragPos);
+
+#if defined(LIGHTING_PASS)
+	vec4 texel_ambient = surface.ambient;
+	vec4 texel_diffuse = surface.diffuse;
+	vec4 texel_specular = surface.specular;
+#elif defined(DIFFUSE_TEXTURE) || defined(BILLBOARD)
+	// pG}ܧ B Ӫ馳KϮ => Ϥ
+	vec4 texel_ambient = DIFFUSE_TEXEL;
+	vec4 texel_diffuse = texel_ambient;
+	#ifdef SPECULAR_TEXTURE
+	vec4 texel_specular = texture(material.specular_texture, fs_in.TexCoords);
+	#else
+	vec4 texel_specular = texel_diffuse;
+	#endif
+#else
+	// ¦
+	vec4 texel_ambient = MATERIAL.ambient;
+	vec4 texel_diffuse = MATERIAL.diffuse;
+	#ifdef SPECULAR_TEXTURE
+	vec4 texel_specular = texture(material.specular_texture, fs_in.TexCoords);
+	#else
+	vec4 texel_specular = MATERIAL.specular;
+	#endif
+#endif
+
+	// hz
+	if (texel_diffuse.a < 0.1) {
+		discard;
+	}
 
-		FragColor = FinalColor;
+	// O_}ҥ
+#if defined(DEFERRED)
+	// The emission texture isn't stored, only the emission of the color
+	#ifdef EMISSION
+	float emission = 1.0;
+	#else
+	float emission = 0.0;
+	#endif
+	gAlbedo = vec4(texel_diffuse.rgb, 1.0);
+	gAmbient = vec4(texel_ambient.rgb, emission);
+	gSpecular = vec4(texel_specular.rgb, 1.0);
+	gNormal = vec4(norm, MATERIAL.shininess);
+#elif !defined(LIGHTING)
+	FragColor = texel_diffuse;
+#else
+	// p
+	vec3 illumination = vec3(0.0);
+
+	for (int i = 0; i < NUM_DIR_LIGHTS; i++) {
+		illumination += CalcDirLight(lights[i], norm, viewDir, texel_ambient, texel_diffuse, texel_specular);
+	}
+	for (int i = 0; i < NUM_POINT_LIGHTS; i++) {
+		illumination += CalcPointLight(lights[NUM_DIR_LIGHTS + i], norm, viewDir, texel_ambient, texel_diffuse, texel_specular);
+	}
+	for (int i = 0; i < NUM_SPOT_LIGHTS; i++) {
+		illumination += CalcSpotLight(lights[NUM_DIR_LIGHTS + NUM_POINT_LIGHTS + i], norm, viewDir, texel_ambient, texel_diffuse, texel_specular);
+	}
+#ifdef CLUSTERED
+	uvec2 cluster = FetchCluster();
+	for (uint i = 0u; i < cluster.y; i++) {
+		Light light = FetchLight(int(texelFetch(clusterIndices, int(cluster.x + i)).r));
+		if (light.caster == 2) {
+			illumination += CalcSpotLight(light, norm, viewDir, texel_ambient, texel_diffuse, texel_specular);
+		} else {
+			illumination += CalcPointLight(light, norm, viewDir, texel_ambient, texel_diffuse, texel_specular);
+		}
 	}
+#endif
+
+	// }Ҧ۵o
+#if defined(LIGHTING_PASS)
+	illumination += texel_diffuse.rgb * 1.5 * surfaceEmission;
+#elif defined(EMISSION) && defined(EMISSION_TEXTURE)
+	// ϥΦ۵o
+	illumination += texture(material.emission_texture, fs_in.TexCoords).rgb;
+#elif defined(EMISSION)
+	// ϥΦ۵oC
+	illumination += texel_diffuse.rgb * 1.5;
+#endif
+
+	// Foggy Effect
+	vec4 FinalColor = vec4(clamp(illumination, 0.0, 1.0), texel_diffuse.a);
+
+#ifdef FOG
+	#if FOG_DEPTH_TYPE == 0
+	// Plane Based
+	float distance = abs((VIEW_POS - fs_in.FragPos).z);
+	#else
+	// Range Based
+	float distance = length(VIEW_POS - fs_in.FragPos);
+	#endif
+
+	#if FOG_MODE == 0
+	// Foggy Effect Linear
+	float fogFactor = clamp((fog.f_end - distance) / (fog.f_end - fog.f_start), 0.0, 1.0);
+	#elif FOG_MODE == 1
+	// Foggy Effect EXP
+	float fogFactor = clamp(1.0 / exp(fog.density * distance), 0.0, 1.0);
+	#else
+	// Foggy Effect EXP2
+	float fogFactor = clamp(1.0 / exp(fog.density * distance * distance), 0.0, 1.0);
+	#endif
+
+	FinalColor = mix(fog.color, FinalColor, fogFactor);
+#endif
+
+	// {ե
+#ifdef GAMMA
+	FinalColor = vec4(pow(FinalColor.xyz, vec3(GammaValue)), FinalColor.w);
+#endif
+
+	FragColor = FinalColor;
+#endif
 }
\ No newline at end of file
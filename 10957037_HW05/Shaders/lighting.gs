@@ -0,0 +1,85 @@
+#version 330 core
+// Only attached to the MULTIVIEW variants, the four monitors of the quad view are drawn in one pass.
+// OpenGL 3.3 has no viewport array, so every triangle is emitted once per monitor, squeezed into the
+// rectangle of that monitor in the window and clipped to it with gl_ClipDistance.
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 12) out;
+
+#define NUM_VIEWS 4
+
+in VS_OUT {
+	vec3 NaviePos;
+	vec3 FragPos;
+	vec3 Normal;
+	vec2 TexCoords;
+#if defined(INSTANCED) || defined(PARTS)
+	flat int MaterialIndex;
+#endif
+#ifdef BILLBOARD
+	flat float SpriteLayer;
+#endif
+	vec4 ViewClip[NUM_VIEWS];
+} gs_in[];
+
+out GS_OUT {
+	vec3 NaviePos;
+	vec3 FragPos;
+	vec3 Normal;
+	vec2 TexCoords;
+#if defined(INSTANCED) || defined(PARTS)
+	flat int MaterialIndex;
+#endif
+#ifdef BILLBOARD
+	flat float SpriteLayer;
+#endif
+	flat int ViewIndex;
+} gs_out;
+
+out float gl_ClipDistance[4];
+
+// Must match MultiViewData in uniformbuffer.h
+layout(std140) uniform MultiViewData {
+	mat4 views[NUM_VIEWS];
+	mat4 projections[NUM_VIEWS];
+	vec4 viewPositions[NUM_VIEWS];
+	vec4 viewClipPlanes[NUM_VIEWS];
+	vec4 viewports[NUM_VIEWS];
+};
+
+// 1 for every side of the view volume (left, right, bottom, top) the vertex is outside of
+ivec4 OutsideSides(vec4 clip) {
+	return ivec4(lessThan(clip.xxyy * vec4(1.0, -1.0, 1.0, -1.0), -clip.wwww));
+}
+
+void main() {
+	for (int v = 0; v < NUM_VIEWS; v++) {
+		// Skip the monitors where the whole triangle is outside one side
+		ivec4 outside = OutsideSides(gs_in[0].ViewClip[v]) * OutsideSides(gs_in[1].ViewClip[v]) * OutsideSides(gs_in[2].ViewClip[v]);
+		if (any(notEqual(outside, ivec4(0)))) {
+			continue;
+		}
+
+		for (int i = 0; i < 3; i++) {
+			vec4 clip = gs_in[i].ViewClip[v];
+			gl_Position = vec4(clip.xy * viewports[v].xy + viewports[v].zw * clip.w, clip.z, clip.w);
+			gl_ClipDistance[0] = clip.w + clip.x;
+			gl_ClipDistance[1] = clip.w - clip.x;
+			gl_ClipDistance[2] = clip.w + clip.y;
+			gl_ClipDistance[3] = clip.w - clip.y;
+
+			gs_out.NaviePos = gs_in[i].NaviePos;
+			gs_out.FragPos = gs_in[i].FragPos;
+			gs_out.Normal = gs_in[i].Normal;
+			gs_out.TexCoords = gs_in[i].TexCoords;
+#if defined(INSTANCED) || defined(PARTS)
+			gs_out.MaterialIndex = gs_in[i].MaterialIndex;
+#endif
+#ifdef BILLBOARD
+			gs_out.SpriteLayer = gs_in[i].SpriteLayer;
+#endif
+			gs_out.ViewIndex = v;
+			EmitVertex();
+		}
+		EndPrimitive();
+	}
+}
\ No newline at end of file
@@ -2,31 +2,131 @@
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTextureCoords;
+layout(location = 3) in vec3 aInstancePosition;
+layout(location = 4) in vec2 aInstanceSize;
+layout(location = 5) in float aInstanceMode;
+layout(location = 6) in vec4 aInstanceTransform;
+layout(location = 7) in vec2 aInstanceParams;
+layout(location = 8) in vec2 aPart;
+layout(location = 9) in vec3 aInstanceSprite;
+
+#define MAX_JOINTS 4
+#define NUM_VIEWS 4
 
 out VS_OUT {
 	vec3 NaviePos;
 	vec3 FragPos;
 	vec3 Normal;
 	vec2 TexCoords;
+#if defined(INSTANCED) || defined(PARTS)
+	flat int MaterialIndex;
+#endif
+#ifdef BILLBOARD
+	flat float SpriteLayer;
+#endif
+#ifdef MULTIVIEW
+	vec4 ViewClip[NUM_VIEWS];	// position in every monitor, routed by lighting.gs
+#endif
 } vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform bool isCubeMap;
+uniform mat3 normalMatrix;	// transpose(inverse(mat3(model))), computed on the CPU, see normalmatrix.h
+uniform mat4 joints[MAX_JOINTS];
+uniform float spriteFrameRate;
+
+layout(std140) uniform ViewData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+	float clusterNear;
+	float clusterFar;
+};
+
+#ifdef MULTIVIEW
+// Must match MultiViewData in uniformbuffer.h
+layout(std140) uniform MultiViewData {
+	mat4 views[NUM_VIEWS];
+	mat4 projections[NUM_VIEWS];
+	vec4 viewPositions[NUM_VIEWS];
+	vec4 viewClipPlanes[NUM_VIEWS];
+	vec4 viewports[NUM_VIEWS];
+};
+#endif
+
+// Scale and move the mesh to this instance, the bobbing is evaluated here instead of on the CPU.
+vec3 InstancePosition(vec3 position) {
+	float bobbing = sin(time * 3.0 + aInstanceTransform.z) / 4.0 * aInstanceParams.x;
+	return aInstanceTransform.xyz + position * aInstanceTransform.w + vec3(0.0, bobbing, 0.0);
+}
+
+// Expand the billboard quad of this instance along the axes facing the camera.
+vec3 BillboardPosition(mat4 viewMatrix) {
+	mat4 view_model = viewMatrix * model;
+
+	vec3 billboard_x = vec3(0.0);
+	vec3 billboard_y = vec3(0.0);
+	vec3 billboard_z = vec3(0.0);
+
+#ifndef BILLBOARD_FIXED
+	billboard_z = vec3(view_model[0][2], view_model[1][2], view_model[2][2]);
+	if (aInstanceMode < 0.5) {
+		// Cylindrical: Y axis is fixed
+		billboard_x = vec3(billboard_z.z, 0.0, -billboard_z.x);
+		billboard_y = vec3(0.0, 1.0, 0.0);
+	} else {
+		// Spherical: Y axis is not fixed
+		billboard_x = vec3(view_model[0][0], view_model[1][0], view_model[2][0]);
+		billboard_y = vec3(view_model[0][1], view_model[1][1], view_model[2][1]);
+	}
+#else
+	billboard_z = vec3(0.0, 0.0, -1.0);
+	billboard_x = vec3(billboard_z.z, 0.0, -billboard_z.x);
+	billboard_y = vec3(0.0, 1.0, 0.0);
+#endif
+
+	return aInstancePosition + aPosition.x * aInstanceSize.x * billboard_x + aPosition.y * aInstanceSize.y * billboard_y;
+}
 
 void main() {
-	vs_out.NaviePos = aPosition;
-	vs_out.FragPos =  vec3(model * vec4(aPosition, 1.0));
-	vs_out.Normal = mat3(transpose(inverse(model))) * aNormal;
+#ifdef LIGHTING_PASS
+	// Fullscreen triangle of deferred shading, the positions are already in clip space
+	gl_Position = vec4(aPosition.xy, 0.0, 1.0);
+#else
+	vec3 normal = aNormal;
+#if defined(BILLBOARD)
+	vec3 position = BillboardPosition(view);
+	// x: first layer, y: number of frames, z: phase offset in frames
+	vs_out.SpriteLayer = aInstanceSprite.x + mod(floor(time * spriteFrameRate + aInstanceSprite.z), aInstanceSprite.y);
+#elif defined(INSTANCED)
+	vec3 position = InstancePosition(aPosition);
+	vs_out.MaterialIndex = int(aInstanceParams.y + 0.5);
+#elif defined(PARTS)
+	// The joints are rigid, so their rotation can be applied to the normal directly
+	mat4 joint = joints[int(aPart.x + 0.5)];
+	vec3 position = vec3(joint * vec4(aPosition, 1.0));
+	normal = mat3(joint) * aNormal;
+	vs_out.MaterialIndex = int(aPart.y + 0.5);
+#else
+	vec3 position = aPosition;
+#endif
+	vs_out.NaviePos = position;
+	vs_out.FragPos =  vec3(model * vec4(position, 1.0));
+	vs_out.Normal = normalMatrix * normal;
 	vs_out.TexCoords = aTextureCoords;
 
-	if (isCubeMap) {
-		// øsѪŲ
-		mat4 view_new = mat4(mat3(view));
-		vec4 pos = projection * view_new * vec4(vs_out.FragPos, 1.0);
-		gl_Position = pos.xyww;
-	} else {
-		gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+	gl_Position = projection * view * vec4(vs_out.FragPos, 1.0);
+
+#ifdef MULTIVIEW
+	// The billboards face the camera of every monitor
+	for (int v = 0; v < NUM_VIEWS; v++) {
+	#ifdef BILLBOARD
+		vec3 worldPosition = vec3(model * vec4(BillboardPosition(views[v]), 1.0));
+	#else
+		vec3 worldPosition = vs_out.FragPos;
+	#endif
+	vs_out.ViewClip[v] = projections[v] * views[v] * vec4(worldPosition, 1.0);
 	}
+#endif
+#endif
 }
\ No newline at end of file
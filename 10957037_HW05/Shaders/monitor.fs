@@ -0,0 +1,11 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// Cached image of an ortho monitor, see monitorcache.h
+uniform sampler2D monitor;
+
+void main() {
+	FragColor = vec4(texture(monitor, TexCoords).rgb, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+out vec2 TexCoords;
+
+// Triangle covering the viewport, the positions are already in clip space
+void main() {
+	TexCoords = aPos.xy * 0.5 + 0.5;
+	gl_Position = vec4(aPos.xy, 0.0, 1.0);
+}
\ No newline at end of file
@@ -19,6 +19,24 @@
 #include "../Headers/followcamera.h"
 #include "../Headers/light.h"
 #include "../Headers/fog.h"
+#include "../Headers/billboard.h"
+#include "../Headers/uniformbuffer.h"
+#include "../Headers/shadervariants.h"
+#include "../Headers/instancedmesh.h"
+#include "../Headers/partmodel.h"
+#include "../Headers/frustum.h"
+#include "../Headers/renderqueue.h"
+#include "../Headers/texturearray.h"
+#include "../Headers/lightclusters.h"
+#include "../Headers/gbuffer.h"
+#include "../Headers/monitorcache.h"
+#include "../Headers/jobsystem.h"
+#include "../Headers/normalmatrix.h"
+#include "../Headers/simulation.h"
+#include "../Headers/textureloader.h"
+#include "../Headers/assetpack.h"
+#include "../Headers/scene.h"
+#include "../Headers/worldstreamer.h"
 
 #include <vector>
 #include <iostream>
@@ -26,6 +44,7 @@
 #include <cmath>
 #include <ctime>
 #include <random>
+#include <thread>
 
 enum ROV_Movement {
 	ROV_FORWARD,
@@ -38,6 +57,20 @@ enum ROV_Movement {
 	ROV_DOWN,
 };
 
+// Index into the MaterialData block, the light balls use one material per point light (up to 8).
+enum Material_Index {
+	MATERIAL_BOX,
+	MATERIAL_PLASTIC,
+	MATERIAL_LIGHT_BALL,
+	MATERIAL_ROV_HEAD = MATERIAL_LIGHT_BALL + 8,
+	MATERIAL_ROV_BODY,
+	MATERIAL_ROV_LENS,
+	MATERIAL_ROV_JOINT,
+	MATERIAL_ROV_ARM,
+	MATERIAL_ROV_HUB,
+	MATERIAL_ROV_BLADE,
+};
+
 enum Monitor {
 	Monitor_X,
 	Monitor_Y,
@@ -45,37 +78,115 @@ enum Monitor {
 	Monitor_Result,
 };
 
+// Parts of the scene recorded in parallel, merged into the render queue in this order
+enum Scene_Region {
+	REGION_ENVIRONMENT,
+	REGION_ROV,
+	REGION_CAMERA,
+	REGION_COUNT,
+};
+
+// Keys held down, sampled by the main thread and sent to the simulation thread as one bit mask
+enum Sim_Key {
+	SIM_KEY_W		= 1 << 0,
+	SIM_KEY_S		= 1 << 1,
+	SIM_KEY_A		= 1 << 2,
+	SIM_KEY_D		= 1 << 3,
+	SIM_KEY_Q		= 1 << 4,
+	SIM_KEY_E		= 1 << 5,
+	SIM_KEY_SPACE	= 1 << 6,
+	SIM_KEY_SHIFT	= 1 << 7,
+	SIM_KEY_O		= 1 << 8,
+	SIM_KEY_P		= 1 << 9,
+};
+
+enum Input_Type {
+	INPUT_KEYS,			// Keys: the held Sim_Key bits
+	INPUT_MOUSE_MOVE,	// X, Y: offset of the cursor
+	INPUT_SCROLL,		// Y: offset of the wheel
+	INPUT_GHOST,		// Keys: 1 when the ghost camera is used
+	INPUT_SPEED,		// X: speed of the ROV, set in the panel
+};
+
+// GLFW events of the main thread, in the order they happened
+struct InputEvent {
+	Input_Type Type;
+	unsigned int Keys;
+	float X;
+	float Y;
+};
+
+// Everything moved by the input, ticked on the simulation thread. The render thread reads interpolated copies.
+struct SimState {
+	glm::vec3 ROVPosition;
+	glm::vec3 ROVFront;
+	glm::vec3 ROVRight;
+	float ROVYaw;
+	float ROVEngineAngle;
+	float ROVSpeed;
+	Camera Ghost;
+	fcamera::FollowCamera Follow;
+	bool IsGhost;
+	unsigned int Keys;
+};
+
 void showUI();
 void setViewMatrix(int type);
 void setProjectionMatrix(int type);
 void setViewport(int type);
+glm::vec4 getViewportRect(int type);
 void geneObejectData();
 void geneSphereData();
+void geneROVData();
 void updateViewVolumeData();
 void drawFloor();
 void drawCube();
-void drawPlane(Shader shader, glm::vec3 position, float size_w, float size_h, int method);
-void drawFish(Shader shader, glm::vec3 position, float size);
-void drawGrass(Shader shader, glm::vec3 position, float size);
-void drawBanana(Shader shader, glm::vec3 position, float size);
-void drawBox(Shader shader);
-void drawROV(Shader shader);
-void drawCamera(Shader shader);
-void drawAxis(Shader shader);
-void processROV(ROV_Movement direction, float deltaTime);
-void checkNoGetOut();
-void updateROVFront();
+Shader useShader(unsigned int materialFeatures);
+Shader useGeometryShader(unsigned int materialFeatures);
+Shader bindVariant(ShaderVariants& variants, uint64_t key);
+unsigned int maskMaterialFeatures(unsigned int materialFeatures);
+void drawSkybox(unsigned int cubemapTexture);
+void drawCachedMonitor(int monitor);
+unsigned int billboardFeatures();
+void recordEnvironment(CommandBuffer& commands);
+void recordROV(CommandBuffer& commands);
+void recordCamera(CommandBuffer& commands);
+void submitSprites(CommandBuffer& commands, StackArray& matrices);
+void submitBox(CommandBuffer& commands, StackArray& matrices);
+void updateMaterialData();
+void updateLightBallInstances();
+void generateScene(Scene& scene, unsigned int seed, float density);
+void applyScene(Scene& scene);
+void generateChunk(int x, int z, Scene& chunk);
+void rebuildWorld();
+void selectChunkLights(glm::vec3 focus, unsigned int slots, std::vector<const Light*>& selected);
+void buildBounds(SphereSet& bounds, const Billboard& billboard);
+void buildBounds(SphereSet& bounds, const InstancedMesh& mesh, float meshRadius);
+struct CullResult;
+template <typename T> void cullInstances(T& instances, const SphereSet& bounds, CullResult& result, int firstView, int lastView, JobCounter& counter);
+template <typename T> void uploadInstances(T& instances, const SphereSet& bounds, const CullResult& result, int firstView);
+void benchmarkJobSystem();
+void submitROV(CommandBuffer& commands, StackArray& matrices);
+void submitCamera(CommandBuffer& commands, StackArray& matrices);
+void submitAxis(CommandBuffer& commands, StackArray& matrices);
+void submitMesh(CommandBuffer& commands, StackArray& matrices, unsigned int features, glm::vec4 ambient, glm::vec4 diffuse, glm::vec4 specular, float shininess, void (*draw)());
+void processROV(SimState& state, ROV_Movement direction, float deltaTime);
+void checkNoGetOut(SimState& state);
+void updateROVFront(SimState& state);
 void drawSphere();
 void setFullScreen();
 void frameBufferSizeCallback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+SimState captureSimState();
+void sendGhost();
+bool pushInput(const InputEvent& event);
+void applySimState(const SimState& previous, const SimState& current, float alpha);
+void simulationTick(SimState& state, float step);
 void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void scrollCallback(GLFWwindow* window, double xpos, double ypos);
 void errorCallback(int error, const char* description);
-unsigned int loadTexture(char const* path);
-unsigned int loadCubemap(std::vector<std::string> faces);
 glm::mat4 GetPerspectiveProjMatrix(float fovy, float ascept, float znear, float zfar);
 glm::mat4 GetOrthoProjMatrix(float left, float right, float bottom, float top, float near, float far);
 
@@ -123,6 +234,15 @@ bool showAxis = false;
 // Follow Camera parameters
 fcamera::FollowCamera followCamera(FollowCamearaPosition, ROVPosition);
 
+// The ROV and the cameras above are the render copies, they are moved on the simulation thread at a fixed rate.
+// The GLFW callbacks only queue their input for it.
+FixedStepThread<SimState> simulation;
+SpscQueue<InputEvent, 1024> inputQueue;
+// Last values the simulation thread was sent, a change that didn't fit in the queue is sent again on the next frame
+unsigned int heldKeys = 0;
+bool sentGhost = false;
+float sentSpeed = -1.0f;
+
 // Projection parameters
 static bool isPerspective = true;
 float aspect_wh = (float)SCR_WIDTH / (float)SCR_HEIGHT;
@@ -140,21 +260,34 @@ std::vector <glm::vec4> farPlaneVertex;
 static int currentScreen = 3;
 static float distanceOrthoCamera = 5.0;
 
+// The quad view is drawn in one pass, lighting.gs sends every triangle to the four monitors
+static bool useSinglePassQuad = true;
+
+// Or the ortho monitors are redrawn round-robin into their own framebuffers at a lower rate and resolution
+MonitorCache monitorCache;
+static bool useMonitorCache = true;
+static bool monitorsCached = false;
+static float monitorScale = 0.5f;
+
 // Light Parameters
+// The directional and point lights come from the scene, the ROV light is added after them
 Light dirLight(glm::vec4(-0.2f, -1.0f, -0.3f, 0.0f), false);
-std::vector<Light> pointLights = {
-	Light(glm::vec3(10.0f, 10.0f, 35.0f), true),
-	Light(glm::vec3(-45.0f, 5.0f, 30.0f), true),
-	Light(glm::vec3(38.0f, 2.0f, -40.0f), true),
-	Light(glm::vec3(-50.0f, 15.0f, -45.0f), true),
-	Light(ROVPosition, true),
-};
+std::vector<Light> pointLights;
+static unsigned int rovPointLight = 0;
 std::vector<Light> spotLights = {
 	Light(ROVPosition, ROVFront, true),
 	Light(camera.Position, camera.Front, false),
 };
+
+// Point and spot lights are binned into clusters with Phong shading, so the work lights are not limited by MAX_LIGHTS
+LightClusters lightClusters;
+std::vector<const Light*> clusteredLights;
+std::vector<Light> workLights;
+static int numWorkLights = 0;
+static bool useClusteredLighting = true;
 static bool useBlinnPhong = true;
 static bool usePhongShading = true;
+static bool useDeferredShading = false;
 static bool useSpotExponent = false;
 static bool useLighting = true;
 static bool useDiffuseTexture = true;
@@ -168,17 +301,68 @@ static bool skyboxColorManual = false;
 Fog fog(glm::vec4(0.266f, 0.5f, 0.609f, 1.0f), true, global_near, global_far);
 static bool fogManual = false;
 
+// Uniform buffers, lights and fog are uploaded once per frame, view data once per viewport
+UniformBuffer<FrameData> frameUBO;
+UniformBuffer<ViewData> viewUBO;
+UniformBuffer<MaterialData> materialUBO;
+UniformBuffer<MultiViewData> multiViewUBO;
+
+// Shader permutations, the global options are folded into frameFeatures once per frame
+ShaderVariants phongShaders("Shaders/lighting.vs", "Shaders/lighting.fs", "Shaders/lighting.gs");
+ShaderVariants gouraudShaders("Shaders/gouraud.vs", "Shaders/gouraud.fs");
+ShaderVariants monitorShaders("Shaders/monitor.vs", "Shaders/monitor.fs");
+ShaderVariants skyboxShaders("Shaders/cubemap.vs", "Shaders/cubemap.fs", "Shaders/lighting.gs");
+uint64_t frameFeatures = 0;
+unsigned int currentProgram = 0;
+
+// Draws of one viewport are collected here, then sorted to minimize the state changes
+RenderQueue renderQueue;
+
+// Deferred shading writes the opaque objects here first, then lights every pixel once
+GBuffer gBuffer;
+
 // Object Data
 std::vector<float> cubeVertices;
 std::vector<int> cubeIndices;
 unsigned int cubeVAO, cubeVBO, cubeEBO;
 
+// The skybox only needs positions, it has a cube of its own
+std::vector<float> skyboxVertices;
+unsigned int skyboxVAO, skyboxVBO;
+
 std::vector<float> floorVertices;
 std::vector<unsigned int> floorIndices;
 unsigned int floorVAO, floorVBO, floorEBO;
 
-std::vector<float> planeVertices;
-unsigned int planeVAO, planeVBO;
+// Grass, fishes and bananas are one batch of billboards, their images are layers of one texture array
+enum Sprite_Layer {
+	SPRITE_GRASS,
+	SPRITE_FISH,
+	SPRITE_BANANA,		// first frame of the flipbook
+};
+const unsigned int BANANA_FRAMES = 8;
+Billboard spriteBillboard;
+TextureArray spriteArray;
+
+// Boxes, plastic cubes and light balls are drawn with one instanced call each
+InstancedMesh boxMeshes, plasticMeshes, lightBallMeshes;
+
+// Obstacles added in the panel around the origin, on top of the ones of the world
+std::vector<MeshInstance> obstacleBoxes;
+static int numBoxes = 0;
+
+// The instances above are the ones of the resident chunks, rebuilt by rebuildWorld() when they change.
+// Every resident chunk draws one tile of the sea surface and the sand. Its lights are all drawn with clustered lighting,
+// otherwise only the nearest ones that fit in the slots the fixed lights leave free.
+WorldStreamer world;
+std::vector<glm::vec3> terrainTiles;
+std::vector<Light> chunkLights;
+std::vector<const Light*> fixedChunkLights;
+
+// The ROV is baked into one mesh, the propeller is its only animated joint
+PartModel rovModel;
+unsigned int rovEngineJoint = 0;
+glm::mat4 ROVEngineTransform = glm::mat4(1.0f);
 
 std::vector<float> sphereVertices;
 std::vector<unsigned int> sphereIndices;
@@ -190,15 +374,116 @@ unsigned int viewVolumeVAO, viewVolumeVBO, viewVolumeEBO;
 
 static bool enableBillboard = true;
 
+// Frustum culling, the bounding spheres are in world space and follow the order of the instances
+static bool enableCulling = true;
+Frustum viewFrustums[4];
+glm::mat4 viewMatrices[4];
+glm::mat4 projectionMatrices[4];
+SphereSet spriteBounds, boxBounds, plasticBounds;
+
+// Large sets are culled in chunks of CULL_GRAIN spheres by the job system, then joined in order
+const unsigned int CULL_GRAIN = 4096;
+struct CullResult {
+	std::vector<std::vector<unsigned int>> Chunks;
+	std::vector<unsigned int> Visible;
+};
+CullResult spriteCull, boxCull, plasticCull;
+
+// Culling and the instance lists run on the workers, the OpenGL calls stay on the main thread
+JobSystem jobSystem;
+std::vector<glm::vec2> jobBenchmark;	// x: threads, y: milliseconds per run
+
+// Draws of every region, recorded once per frame and merged into the queue of every viewport
+CommandBuffer sceneCommands[Scene_Region::REGION_COUNT];
+
+// Statistics of the last frame
+static unsigned int uniformCalls = 0;
+static unsigned int uniformElided = 0;
+static unsigned int uniformInactive = 0;
+static unsigned int bufferUploads = 0;
+static unsigned int bufferSkipped = 0;
+static unsigned int shaderVariants = 0;
+static unsigned int visibleInstances[4] = { 0 };
+static unsigned int culledInstances[4] = { 0 };
+static unsigned int queuePackets = 0;
+static unsigned int textureBinds = 0;
+static unsigned int textureBindsSkipped = 0;
+static unsigned int materialChanges = 0;
+static unsigned int clusteredLightCount = 0;
+static unsigned int clusterIndexCount = 0;
+static unsigned int jobsExecuted = 0;
+static unsigned int jobsStolen = 0;
+static bool singlePassFrame = false;
+static int refreshedMonitor = -1;
+
 // Texture parameter
 static int keyFrameRate = 12;
-unsigned int rovTexture, seaTexture, sandTexture, grassTexture, boxTexture, boxSpecularTexture, fishTexture, skyTexture;
-std::vector<unsigned int> bananaTexture;
+unsigned int rovTexture, seaTexture, sandTexture, boxTexture, boxSpecularTexture, skyTexture;
 
-std::vector<glm::vec3> boxposition, plasticposition, grassposition, fishposition, bananaposition;
-std::vector<float> grassSize, fishSize, bananaSize;
+// Decodes the textures on its own threads, they show a placeholder until update() uploads them
+TextureLoader textureLoader;
+static unsigned int texturesUploaded = 0;
+static Compression_Quality textureQuality = COMPRESSION_HIGH;
 
-int main() {
+// Materials of the scene, written into the MaterialData block by updateMaterialData()
+std::vector<SceneMaterial> sceneMaterials;
+
+// Without the fixed lights the ROV light and the two spot lights need, the rest of MAX_LIGHTS is left to the scene
+const unsigned int MAX_SCENE_POINT_LIGHTS = MAX_LIGHTS - 4;
+
+int main(int argc, char** argv) {
+
+	// "--build-pack" packs Resources and Shaders into ASSET_PACK_PATH and exits
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--build-pack") {
+			return AssetPack::build({ "Resources", "Shaders" }, ASSET_PACK_PATH) ? 0 : -1;
+		}
+		// "--build-scene [density]" saves a generated scene to SCENE_PATH, the density multiplies the populations and the area
+		if (std::string(argv[i]) == "--build-scene") {
+			// The density is optional, the next argument may be another flag
+			float density = 1.0f;
+			if (i + 1 < argc) {
+				char* end = NULL;
+				float value = strtof(argv[i + 1], &end);
+				if (end != argv[i + 1] && *end == '\0' && value > 0.0f && std::isfinite(value)) {
+					density = value;
+				}
+			}
+			Scene scene;
+			generateScene(scene, (unsigned int)time(NULL), density);
+			return scene.save(SCENE_PATH) ? 0 : -1;
+		}
+		// "--build-world" moves the instances of SCENE_PATH into chunk files under WORLD_DIR, the scene keeps the rest
+		if (std::string(argv[i]) == "--build-world") {
+			Scene scene;
+			if (!scene.load(SCENE_PATH)) {
+				return -1;
+			}
+			std::map<uint64_t, Scene> chunks;
+			WorldStreamer::split(scene, chunks);
+			_mkdir(WORLD_DIR.c_str());
+			for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+				if (!it->second.save(WorldStreamer::getChunkPath((int)(int32_t)(it->first >> 32), (int)(int32_t)(it->first & 0xFFFFFFFF)))) {
+					return -1;
+				}
+			}
+			return scene.save(SCENE_PATH) ? 0 : -1;
+		}
+		// "--compression none|fast|high" picks the quality the textures are compressed with, it can be changed in the panel later
+		if (std::string(argv[i]) == "--compression" && i + 1 < argc) {
+			std::string quality = argv[++i];
+			textureQuality = (quality == "none") ? COMPRESSION_NONE : (quality == "fast") ? COMPRESSION_FAST : COMPRESSION_HIGH;
+			continue;
+		}
+		// "--dump-scene" writes SCENE_PATH as text next to it
+		if (std::string(argv[i]) == "--dump-scene") {
+			Scene scene;
+			return (scene.load(SCENE_PATH) && scene.exportText(SCENE_PATH + ".txt")) ? 0 : -1;
+		}
+	}
+	if (!AssetPack::instance().open(ASSET_PACK_PATH)) {
+		logging::loggingMessage(logging::LogType::INFO, "No asset pack, loading the loose files.");
+	}
 
 	// Initialize GLFW
 	if (!glfwInit()) {
@@ -259,69 +544,47 @@ int main() {
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Create shader program
-	Shader myShader("Shaders/lighting.vs", "Shaders/lighting.fs");
-	Shader phong("Shaders/lighting.vs", "Shaders/lighting.fs");
-	Shader gouraud("Shaders/gouraud.vs", "Shaders/gouraud.fs");
-	if (usePhongShading) {
-		myShader = phong;
-	} else {
-		myShader = gouraud;
-	}
+	// Shader programs are compiled on first use, see useShader()
 	// Shader textureShader("Shaders/texture.vs", "Shaders/texture.fs");
-	// Shader cubemapShader("Shaders/cubemap.vs", "Shaders/cubemap.fs");
+
+	// Create uniform buffers, one view slot for each monitor
+	frameUBO.setup(Uniform_Binding::FRAME_BINDING);
+	viewUBO.setup(Uniform_Binding::VIEW_BINDING, 4);
+	materialUBO.setup(Uniform_Binding::MATERIAL_BINDING);
+	multiViewUBO.setup(Uniform_Binding::MULTIVIEW_BINDING);
+	lightClusters.setup();
+	jobSystem.setup(JobSystem::defaultWorkers());
 	
 	// Create object data
 	geneObejectData();
 
-	// Setting amount of fishes, boxed and grass. 
-	std::default_random_engine generator(time(NULL));
-	std::uniform_real_distribution<float> unif_g(-80.0, 80.0);
-	std::uniform_real_distribution<float> unif_gsize(0.2, 2.0);
-	std::uniform_real_distribution<float> unif_f(-60.0, 60.0);
-	std::uniform_real_distribution<float> unif_fsize(0.5, 1.5);
-	std::uniform_real_distribution<float> unif_b(-30.0, 30.0);
-	
-	for (int i = 0; i < 20; i++) {
-		boxposition.push_back(glm::vec3(unif_b(generator), 0.0f, unif_b(generator)));
-	}
-
-	for (int i = 0; i < 10; i++) {
-		plasticposition.push_back(glm::vec3(unif_b(generator), 0.0f, unif_b(generator)));
-	}
-
-	for (int i = 0; i < 600; i++) {
-		grassposition.push_back(glm::vec3(unif_g(generator), 0.0f, unif_g(generator)));
-		grassSize.push_back(unif_gsize(generator));
-	}
-
-	for (int i = 0; i < 200; i++) {
-		fishposition.push_back(glm::vec3(unif_f(generator), 0.0f, unif_f(generator)));
-		fishSize.push_back(unif_fsize(generator));
-	}
-
-	for (int i = 0; i < 50; i++) {
-		bananaposition.push_back(glm::vec3(unif_f(generator), 0.0f, unif_b(generator)));
-		bananaSize.push_back(unif_fsize(generator));
+	// Load the scene, a random one is generated when it hasn't been built
+	Scene scene;
+	if (!scene.load(SCENE_PATH)) {
+		logging::loggingMessage(logging::LogType::INFO, "No scene at " + SCENE_PATH + ", generating a random one.");
+		generateScene(scene, (unsigned int)time(NULL), 1.0f);
 	}
+	applyScene(scene);
 
 	// Initial Light Setting
-	pointLights[4].Diffuse = glm::vec3(1.0f, 0.0f, 0.0f);
-	pointLights[4].Specular = glm::vec3(0.0f, 0.0f, 0.0f);
 	spotLights[0].Cutoff = 25.0f;
 	spotLights[0].OuterCutoff = 40.0f;
 	spotLights[1].Cutoff = 12.0f;
 	spotLights[1].OuterCutoff = 26.0f;
 
-	// Loading textures
-	rovTexture = loadTexture("Resources\\Textures\\metal.png");
-	seaTexture = loadTexture("Resources\\Textures\\sea.jpg");
-	sandTexture = loadTexture("Resources\\Textures\\sand.jpg");
-	grassTexture = loadTexture("Resources\\Textures\\grass.png");
-	boxTexture = loadTexture("Resources\\Textures\\container2.png");
-	boxSpecularTexture = loadTexture("Resources\\Textures\\container2_specular.png");
-	fishTexture = loadTexture("Resources\\Textures\\fish.png");
-	skyTexture = loadTexture("Resources\\Textures\\sky.jpg");
+	// Obstacles added in the panel
+	std::default_random_engine generator(time(NULL));
+	std::uniform_real_distribution<float> unif_g(-80.0, 80.0);
+	std::uniform_real_distribution<float> unif_b(-30.0, 30.0);
+
+	// Loading textures, the first frames are drawn while they are decoded
+	textureLoader.setup(2, textureQuality);
+	rovTexture = textureLoader.loadTexture("Resources/Textures/metal.png");
+	seaTexture = textureLoader.loadTexture("Resources/Textures/sea.jpg");
+	sandTexture = textureLoader.loadTexture("Resources/Textures/sand.jpg");
+	boxTexture = textureLoader.loadTexture("Resources/Textures/container2.png");
+	boxSpecularTexture = textureLoader.loadTexture("Resources/Textures/container2_specular.png");
+	skyTexture = textureLoader.loadTexture("Resources/Textures/sky.jpg");
 
 	// Loading Cubemap
 	std::vector<std::string> faces{
@@ -332,10 +595,12 @@ int main() {
 		"Resources/Textures/skybox/front.jpg",
 		"Resources/Textures/skybox/back.jpg",
 	};
-	unsigned int cubemapTexture = loadCubemap(faces);
+	unsigned int cubemapTexture = textureLoader.loadCubemap(faces);
 
-	// Loading Animate
-	std::vector<std::string> banana{
+	// Loading sprites, the banana flipbook takes the last BANANA_FRAMES layers
+	std::vector<std::string> sprites{
+		"Resources/Textures/grass.png",
+		"Resources/Textures/fish.png",
 		"Resources/Textures/banana/banana-0.png",
 		"Resources/Textures/banana/banana-1.png",
 		"Resources/Textures/banana/banana-2.png",
@@ -345,12 +610,15 @@ int main() {
 		"Resources/Textures/banana/banana-6.png",
 		"Resources/Textures/banana/banana-7.png",
 	};
+	textureLoader.loadArray(spriteArray, sprites, 512, 512);
 
-	for (unsigned int i = 0; i < 8; i++) {
-		bananaTexture.push_back(loadTexture(banana[i].c_str()));
-	}
+	simulation.start(captureSimState(), simulationTick);
+	world.start(generateChunk);
 
 	// The main loop
+	bool isFirstFrame = true;
+	glm::vec3 lastROVPosition = ROVPosition;
+	glm::vec3 rovVelocity = glm::vec3(0.0f);
 	while (!glfwWindowShouldClose(window)) {
 		
 		// Calculate the deltaFrame
@@ -360,8 +628,27 @@ int main() {
 
 		float daytime = sin(currentTime / 10) / 2 + 0.5;
 
-		// Process Input (Moving camera)
+		// Stream the textures decoded since the last frame
+		textureLoader.update();
+
+		// Process Input, then take the state of the ROV and the cameras between the last two ticks of the simulation
 		processInput(window);
+		float simulationAlpha;
+		const FixedStepThread<SimState>::Snapshot& snapshot = simulation.read(simulationAlpha);
+		applySimState(snapshot.Previous, snapshot.Current, simulationAlpha);
+
+		// Stream the chunks around the ROV and the ghost camera, and the ones the ROV is heading to
+		if (deltaTime > 0.0f) {
+			rovVelocity = glm::mix(rovVelocity, (ROVPosition - lastROVPosition) / deltaTime, 0.1f);
+		}
+		lastROVPosition = ROVPosition;
+		std::vector<glm::vec3> worldFocus = { ROVPosition };
+		if (isGhost) {
+			worldFocus.push_back(camera.Position);
+		}
+		if (world.update(worldFocus, ROVPosition + rovVelocity * world.PrefetchTime)) {
+			rebuildWorld();
+		}
 
 		// Clear the buffer
 		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -370,6 +657,30 @@ int main() {
 		// Update the view volume
 		updateViewVolumeData();
 
+		// Regenerate the obstacles when the amount is changed in the panel
+		if (numBoxes != (int)obstacleBoxes.size()) {
+			while ((int)obstacleBoxes.size() < numBoxes) {
+				obstacleBoxes.push_back({ glm::vec4(unif_b(generator), 0.0f, unif_b(generator), 1.0f), glm::vec2(1.0f, (float)Material_Index::MATERIAL_BOX) });
+			}
+			obstacleBoxes.resize(numBoxes);
+			rebuildWorld();
+		}
+
+		// Regenerate the work lights when the amount is changed in the panel, they hang just above the seabed
+		if (numWorkLights != (int)workLights.size()) {
+			std::uniform_real_distribution<float> unif_color(0.2f, 1.0f);
+			while ((int)workLights.size() < numWorkLights) {
+				Light light(glm::vec3(unif_g(generator), -4.0f, unif_g(generator)), true);
+				light.Ambient = glm::vec3(0.0f);
+				light.Diffuse = glm::vec3(unif_color(generator), unif_color(generator), unif_color(generator));
+				light.Specular = light.Diffuse * 0.5f;
+				light.Linear = 0.35f;
+				light.Quadratic = 0.44f;
+				workLights.push_back(light);
+			}
+			workLights.erase(workLights.begin() + numWorkLights, workLights.end());
+		}
+
 		// feed inputs to dear imgui start new frame;
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -393,254 +704,242 @@ int main() {
 			scr_end = 3;
 		}
 
-		for (int i = scr_start; i <= scr_end; i++) {
-			setViewMatrix(i);
-			setProjectionMatrix(i);
-			setViewport(i);
-
-			if (usePhongShading) {
-				myShader = phong;
+		// ==================== Update per-frame uniform data ====================
+		if (!skyboxColorManual) {
+			dirLight.Diffuse.x = sin(0.475 * currentTime) / 2 + 0.5;
+			dirLight.Diffuse.y = sin(0.495 * currentTime) / 2 + 0.5;
+			dirLight.Diffuse.z = sin(0.5 * currentTime) / 2 + 0.5;
+		}
+		pointLights[rovPointLight].Position = ROVPosition;
+		spotLights[0].Position = ROVPosition + ROVFront;
+		spotLights[0].Direction = ROVFront;
+		spotLights[1].Position = camera.Position;
+		spotLights[1].Direction = camera.Front;
+
+		if (!fogManual) {
+			if (followCamera.Position.y >= 0.0f) {
+				fog.Density = 0.01f;
 			} else {
-				myShader = gouraud;
+				fog.Density = 0.15f;
 			}
+		}
 
-			// Enable Shader and setting view & projection matrix
-			myShader.use();
-			myShader.setInt("skybox", 3);
-			
-			myShader.setMat4("view", view);
-			myShader.setMat4("projection", projection);
-			myShader.setVec3("viewPos", (isGhost) ? camera.Position : followCamera.Position);
-
-			myShader.setBool("useBlinnPhong", useBlinnPhong);
-			myShader.setBool("useSpotExponent", useSpotExponent);
-			myShader.setBool("useLighting", useLighting);
-			myShader.setBool("useDiffuseTexture", useDiffuseTexture);
-			myShader.setBool("useSpecularTexture", useSpecularTexture);
-			myShader.setBool("useEmission", useEmission);
-			myShader.setBool("useGamma", useGamma);
-			myShader.setFloat("GammaValue", GammaValue);
-			myShader.setBool("isCubeMap", false);
-
-			myShader.setInt("material.diffuse_texture", 0);
-			myShader.setInt("material.specular_texture", 1);
-			myShader.setInt("material.emission_texture", 2);
-
-			myShader.setVec4("material.ambient", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-			myShader.setVec4("material.diffuse", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-			myShader.setVec4("material.specular", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-			myShader.setFloat("material.shininess", 64.0f);
-
-			if (!skyboxColorManual) {
-				dirLight.Diffuse.x = sin(0.475 * currentTime) / 2 + 0.5;
-				dirLight.Diffuse.y = sin(0.495 * currentTime) / 2 + 0.5;
-				dirLight.Diffuse.z = sin(0.5 * currentTime) / 2 + 0.5;
+		// Pack the enabled lights, the shaders loop over a compile-time count of each caster.
+		// With clustered lighting only the direction light stays in the uniform buffer,
+		// Gouraud shading lights the vertices, so it keeps the fixed number of lights.
+		bool useClusters = useClusteredLighting && usePhongShading;
+		bool useDeferred = useDeferredShading && usePhongShading && SCR_WIDTH > 0 && SCR_HEIGHT > 0;
+		if (useDeferred) {
+			gBuffer.resize(SCR_WIDTH, SCR_HEIGHT);
+		}
+		// Only one cached monitor is redrawn per frame, the images are stale after the quad view was left
+		bool cacheMonitors = useMonitorCache && currentScreen == 4;
+		int refreshMonitor = -1;
+		if (cacheMonitors) {
+			if (!monitorsCached) {
+				monitorCache.invalidate();
 			}
-			myShader.setVec3("lights[0].direction", dirLight.Direction);
-			myShader.setVec3("lights[0].ambient", dirLight.Ambient);
-			myShader.setVec3("lights[0].diffuse", dirLight.Diffuse);
-			myShader.setVec3("lights[0].specular", dirLight.Specular);
-			myShader.setBool("lights[0].enable", dirLight.Enable);
-			myShader.setInt("lights[0].caster", dirLight.Caster);
-
-			pointLights[4].Position = ROVPosition;
+			monitorCache.resize(glm::max((int)(SCR_WIDTH / 2 * monitorScale), 1), glm::max((int)(SCR_HEIGHT / 2 * monitorScale), 1));
+			refreshMonitor = monitorCache.nextRefresh(currentTime);
+		}
+		monitorsCached = cacheMonitors;
+		refreshedMonitor = refreshMonitor;
+		bool multiView = useSinglePassQuad && currentScreen == 4 && usePhongShading && !useDeferred && !cacheMonitors;
+		FrameData frameData = FrameData();
+		unsigned int numDir = 0, numPoint = 0, numSpot = 0;
+		if (dirLight.Enable) {
+			frameData.Lights[numDir++] = dirLight.getData();
+		}
+		clusteredLights.clear();
+		if (useClusters) {
 			for (unsigned int i = 0; i < pointLights.size(); i++) {
-				myShader.setVec3("lights[" + std::to_string(i + 1) + "].position", pointLights[i].Position);
-				myShader.setVec3("lights[" + std::to_string(i + 1) + "].ambient", pointLights[i].Ambient);
-				myShader.setVec3("lights[" + std::to_string(i + 1) + "].diffuse", pointLights[i].Diffuse);
-				myShader.setVec3("lights[" + std::to_string(i + 1) + "].specular", pointLights[i].Specular);
-				myShader.setFloat("lights[" + std::to_string(i + 1) + "].constant", pointLights[i].Constant);
-				myShader.setFloat("lights[" + std::to_string(i + 1) + "].linear", pointLights[i].Linear);
-				myShader.setFloat("lights[" + std::to_string(i + 1) + "].quadratic", pointLights[i].Quadratic);
-				myShader.setFloat("lights[" + std::to_string(i + 1) + "].enable", pointLights[i].Enable);
-				myShader.setInt("lights[" + std::to_string(i + 1) + "].caster", pointLights[i].Caster);
+				if (pointLights[i].Enable) {
+					clusteredLights.push_back(&pointLights[i]);
+				}
+			}
+			for (unsigned int i = 0; i < spotLights.size(); i++) {
+				if (spotLights[i].Enable) {
+					clusteredLights.push_back(&spotLights[i]);
+				}
+			}
+			for (unsigned int i = 0; i < workLights.size(); i++) {
+				clusteredLights.push_back(&workLights[i]);
+			}
+			for (unsigned int i = 0; i < chunkLights.size(); i++) {
+				clusteredLights.push_back(&chunkLights[i]);
 			}
+		} else {
+			unsigned int used = numDir;
+			for (unsigned int i = 0; i < pointLights.size(); i++) {
+				used += pointLights[i].Enable ? 1 : 0;
+			}
+			for (unsigned int i = 0; i < spotLights.size(); i++) {
+				used += spotLights[i].Enable ? 1 : 0;
+			}
+			selectChunkLights(isGhost ? camera.Position : ROVPosition, (used < MAX_LIGHTS) ? MAX_LIGHTS - used : 0, fixedChunkLights);
 
-			spotLights[0].Position = ROVPosition + ROVFront;
-			spotLights[0].Direction = ROVFront;
-			spotLights[1].Position = camera.Position;
-			spotLights[1].Direction = camera.Front;
+			// The point lights come before the spot lights, the chunk lights after the lights of the same caster
+			for (unsigned int i = 0; i < pointLights.size(); i++) {
+				if (pointLights[i].Enable) {
+					frameData.Lights[numDir + numPoint++] = pointLights[i].getData();
+				}
+			}
+			for (unsigned int i = 0; i < fixedChunkLights.size(); i++) {
+				if (fixedChunkLights[i]->Caster == Light_Caster::POINT) {
+					frameData.Lights[numDir + numPoint++] = fixedChunkLights[i]->getData();
+				}
+			}
 			for (unsigned int i = 0; i < spotLights.size(); i++) {
-				myShader.setVec3("lights[" + std::to_string(i + 6) + "].position", spotLights[i].Position);
-				myShader.setVec3("lights[" + std::to_string(i + 6) + "].direction", spotLights[i].Direction);
-				myShader.setVec3("lights[" + std::to_string(i + 6) + "].ambient", spotLights[i].Ambient);
-				myShader.setVec3("lights[" + std::to_string(i + 6) + "].diffuse", spotLights[i].Diffuse);
-				myShader.setVec3("lights[" + std::to_string(i + 6) + "].specular", spotLights[i].Specular);
-				myShader.setFloat("lights[" + std::to_string(i + 6) + "].constant", spotLights[i].Constant);
-				myShader.setFloat("lights[" + std::to_string(i + 6) + "].linear", spotLights[i].Linear);
-				myShader.setFloat("lights[" + std::to_string(i + 6) + "].quadratic", spotLights[i].Quadratic);
-				myShader.setFloat("lights[" + std::to_string(i + 6) + "].cutoff", glm::cos(glm::radians(spotLights[i].Cutoff)));
-				myShader.setFloat("lights[" + std::to_string(i + 6) + "].outerCutoff", glm::cos(glm::radians(spotLights[i].OuterCutoff)));
-				myShader.setFloat("lights[" + std::to_string(i + 6) + "].exponent", spotLights[i].Exponent);
-				myShader.setBool("lights[" + std::to_string(i + 6) + "].enable", spotLights[i].Enable);
-				myShader.setInt("lights[" + std::to_string(i + 6) + "].caster", spotLights[i].Caster);
+				if (spotLights[i].Enable) {
+					frameData.Lights[numDir + numPoint + numSpot++] = spotLights[i].getData();
+				}
 			}
-			
-			myShader.setVec4("fog.color", fog.Color);
-			myShader.setFloat("fog.density", fog.Density);
-			myShader.setInt("fog.mode", fog.Mode);
-			myShader.setInt("fog.depthType", fog.DepthType);
-			myShader.setBool("fog.enable", fog.Enable);
-			myShader.setFloat("fog.f_start", fog.F_start);
-			myShader.setFloat("fog.f_end", fog.F_end);
-
-			// Render on the screen;
-
-			if (!fogManual) {
-				if (followCamera.Position.y >= 0.0f) {
-					fog.Density = 0.01f;
-				} else {
-					fog.Density = 0.15f;
+			for (unsigned int i = 0; i < fixedChunkLights.size(); i++) {
+				if (fixedChunkLights[i]->Caster == Light_Caster::SPOT) {
+					frameData.Lights[numDir + numPoint + numSpot++] = fixedChunkLights[i]->getData();
 				}
 			}
-			
+		}
+		frameData.Fog = fog.getData();
+		frameData.GammaValue = GammaValue;
+		frameUBO.update(frameData);
+		updateMaterialData();
+		updateLightBallInstances();
+
+		frameFeatures = ShaderVariants::lightKey(numDir, numPoint, numSpot);
+		if (useLighting) {
+			frameFeatures |= Shader_Feature::FEATURE_LIGHTING;
+		}
+		if (useBlinnPhong) {
+			frameFeatures |= Shader_Feature::FEATURE_BLINN_PHONG;
+		}
+		if (useSpotExponent) {
+			frameFeatures |= Shader_Feature::FEATURE_SPOT_EXPONENT;
+		}
+		if (useGamma) {
+			frameFeatures |= Shader_Feature::FEATURE_GAMMA;
+		}
+		if (fog.Enable) {
+			frameFeatures |= Shader_Feature::FEATURE_FOG | ShaderVariants::fogKey(fog.Mode, fog.DepthType);
+		}
+		if (useClusters) {
+			frameFeatures |= Shader_Feature::FEATURE_CLUSTERED;
+		}
+		if (multiView) {
+			frameFeatures |= Shader_Feature::FEATURE_MULTIVIEW;
+		}
+		currentProgram = 0;
+
+		// ==================== Record the draws ====================
+		// Building the packets is CPU work only, the workers record the regions while this thread updates the uniforms
+		JobCounter recordJobs;
+		jobSystem.run([]() {
+			recordEnvironment(sceneCommands[Scene_Region::REGION_ENVIRONMENT]);
+		}, recordJobs);
+		jobSystem.run([]() {
+			recordROV(sceneCommands[Scene_Region::REGION_ROV]);
+		}, recordJobs);
+		jobSystem.run([]() {
+			recordCamera(sceneCommands[Scene_Region::REGION_CAMERA]);
+		}, recordJobs);
+
+		// ==================== Update per-view uniform data ====================
+		MultiViewData multiViewData = MultiViewData();
+		for (int i = scr_start; i <= scr_end; i++) {
+			setViewMatrix(i);
+			setProjectionMatrix(i);
 
-			// ==================== Draw origin and 3 axes ====================
-			if (showAxis) {
-				drawAxis(myShader);
-			}
-			
+			ViewData viewData = ViewData();
+			viewData.View = view;
+			viewData.Projection = projection;
+			viewData.ViewPos = (isGhost) ? camera.Position : followCamera.Position;
+			viewData.Time = currentTime;
+			glm::vec2 clipPlanes = LightClusters::getClipPlanes(projection);
+			viewData.ClusterNear = clipPlanes.x;
+			viewData.ClusterFar = clipPlanes.y;
+			viewUBO.update(viewData, i);
+			viewFrustums[i] = Frustum(projection * view);
+			viewMatrices[i] = view;
+			projectionMatrices[i] = projection;
+
+			// Scale and offset of the monitor in the window, the same rectangle as setViewport()
+			glm::vec4 rect = getViewportRect(i);
+			multiViewData.Views[i] = view;
+			multiViewData.Projections[i] = projection;
+			multiViewData.ViewPositions[i] = glm::vec4(viewData.ViewPos, 1.0f);
+			multiViewData.ClipPlanes[i] = glm::vec4(clipPlanes.x, clipPlanes.y, 0.0f, 0.0f);
+			multiViewData.Viewports[i] = glm::vec4(rect.z / SCR_WIDTH, rect.w / SCR_HEIGHT, (2.0f * rect.x + rect.z) / SCR_WIDTH - 1.0f, (2.0f * rect.y + rect.w) / SCR_HEIGHT - 1.0f);
+		}
+		if (multiView) {
+			multiViewUBO.update(multiViewData);
+		}
+		singlePassFrame = multiView;
 
-			// ==================== Draw Skybox (Using Cubemap) ====================
-			glDepthFunc(GL_LEQUAL);
-			myShader.setBool("isCubeMap", true);
-			modelMatrix.push();
-				glActiveTexture(GL_TEXTURE3);
-				glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-				modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(distanceOrthoCamera * 5.34)));
-				myShader.setMat4("model", modelMatrix.top());
-				drawCube();
-			modelMatrix.pop();
-			myShader.setBool("isCubeMap", false);
-			glDepthFunc(GL_LESS);
+		for (int i = 0; i < 4; i++) {
+			visibleInstances[i] = 0;
+			culledInstances[i] = 0;
+		}
+		clusteredLightCount = 0;
+		clusterIndexCount = 0;
 
-			
-			// ==================== Draw Sea ====================
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, seaTexture);
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, NULL);
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, NULL);
-			myShader.setBool("material.enableColorTexture", true);
-			myShader.setBool("material.enableSpecularTexture", true);
-			myShader.setBool("material.enableEmission", false);
-			myShader.setBool("material.enableEmissionTexture", false);
-			myShader.setFloat("material.shininess", 64.0f);
-			myShader.setMat4("model", modelMatrix.top());
-			drawFloor();
+		// The sprite array stays on its own unit for every viewport
+		spriteArray.bind(4);
 
-			
-			// ==================== Draw Seabed ====================
-			modelMatrix.push();
-				// ==================== Draw sand ====================
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, sandTexture);
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, NULL);
-				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, NULL);
-				myShader.setBool("material.enableColorTexture", true);
-				myShader.setBool("material.enableSpecularTexture", true);
-				myShader.setBool("material.enableEmission", false);
-				myShader.setBool("material.enableEmissionTexture", false);
-				myShader.setFloat("material.shininess", 64.0f);
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -5.0f, 0.0f)));
-				myShader.setMat4("model", modelMatrix.top());
-				drawFloor();
+		jobSystem.wait(recordJobs);
 
-				// ==================== Draw grass ====================
-				for (unsigned int i = 0; i < grassposition.size(); i++) {
-					myShader.setMat4("model", modelMatrix.top());
-					drawGrass(myShader, grassposition[i], grassSize[i]);
+		for (int i = scr_start; i <= scr_end; i++) {
+			// In the single pass quad view the first iteration draws every monitor and ends the loop,
+			// the main camera is the reference for the depth sorting and the per-view uniforms
+			int firstView = i, lastView = i;
+			unsigned int renderTarget = 0;
+			bool cachedMonitor = cacheMonitors && i != Monitor::Monitor_Result;
+			if (cachedMonitor && i != refreshMonitor) {
+				drawCachedMonitor(i);
+				continue;
+			}
+			if (multiView) {
+				firstView = scr_start;
+				lastView = scr_end;
+				i = Monitor::Monitor_Result;
+				glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+				for (int plane = 0; plane < 4; plane++) {
+					glEnable(GL_CLIP_DISTANCE0 + plane);
 				}
-			modelMatrix.pop();
+			} else if (cachedMonitor) {
+				monitorCache.bindTarget(i, currentTime);
+				renderTarget = monitorCache.getFramebuffer(i);
+				glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			} else {
+				setViewport(i);
+			}
+			viewUBO.bind(i);
+
+			// Only the instances inside these viewports are uploaded and drawn.
+			// The workers cull the sets while this thread bins the lights, then it uploads the visible instances.
+			JobCounter cullJobs;
+			cullInstances(spriteBillboard, spriteBounds, spriteCull, firstView, lastView, cullJobs);
+			cullInstances(boxMeshes, boxBounds, boxCull, firstView, lastView, cullJobs);
+			cullInstances(plasticMeshes, plasticBounds, plasticCull, firstView, lastView, cullJobs);
+
+			// Only the lights reaching these viewports are binned, one grid for each of them
+			if (useClusters) {
+				lightClusters.build(clusteredLights, &viewMatrices[firstView], &projectionMatrices[firstView], lastView - firstView + 1);
+				lightClusters.bind();
+				clusteredLightCount += lightClusters.Lights;
+				clusterIndexCount += lightClusters.Indices;
+			}
 
-			
-			// ==================== Draw fishes ====================
-			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -2.5f, 0.0f)));
-				for (unsigned int i = 0; i < fishposition.size(); i++) {
-					modelMatrix.push();
-						// modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(-sin(currentTime), 0.0f, 0.0f)));
-						// modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(currentTime * 5), glm::vec3(0.0, 1.0, 0.0)));
-						// modelMatrix.save(glm::translate(modelMatrix.top(), fishposition[i]));
-						// modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(1.0f, 0.5f, 0.5f)));
-						myShader.setMat4("model", modelMatrix.top());
-						drawFish(myShader, fishposition[i], fishSize[i]);
-					modelMatrix.pop();
-				}
-			modelMatrix.pop();
-
-			// ==================== Draw banana ====================
-			modelMatrix.push();
-				for (unsigned int i = 0; i < bananaposition.size(); i++) {
-					modelMatrix.push();
-						myShader.setMat4("model", modelMatrix.top());
-						drawBanana(myShader, bananaposition[i], bananaSize[i]);
-					modelMatrix.pop();
-				}
-			modelMatrix.pop();
-
-			// ==================== Draw obstacles ====================
-			modelMatrix.push();
-				for (unsigned int i = 0; i < boxposition.size(); i++) {
-					modelMatrix.push();
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(boxposition[i].x, sin(currentTime * 3 + boxposition[i].z) / 4, boxposition[i].z)));
-						myShader.setMat4("model", modelMatrix.top());
-						drawBox(myShader);
-					modelMatrix.pop();
-				}
-			modelMatrix.pop();
-
-			// ==================== Draw Plastic Object ====================
-			myShader.setBool("material.enableColorTexture", false);
-			myShader.setBool("material.enableSpecularTexture", false);
-			myShader.setBool("material.enableEmission", false);
-			myShader.setBool("material.enableEmissionTexture", false);
-			myShader.setVec4("material.ambient", glm::vec4(0.02f, 0.02f, 0.02f, 1.0));
-			myShader.setVec4("material.diffuse", glm::vec4(0.1f, 0.35f, 0.1f, 1.0));
-			myShader.setVec4("material.specular", glm::vec4(0.45f, 0.55f, 0.45f, 1.0));
-			myShader.setFloat("material.shininess", 16.0f);
-			modelMatrix.push();
-			for (unsigned int i = 0; i < plasticposition.size(); i++) {
-				modelMatrix.push();
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(plasticposition[i].x, sin(currentTime * 3 + plasticposition[i].z) / 4, plasticposition[i].z)));
-					myShader.setMat4("model", modelMatrix.top());
-					drawCube();
-				modelMatrix.pop();
+			jobSystem.wait(cullJobs);
+			uploadInstances(spriteBillboard, spriteBounds, spriteCull, firstView);
+			uploadInstances(boxMeshes, boxBounds, boxCull, firstView);
+			uploadInstances(plasticMeshes, plasticBounds, plasticCull, firstView);
+
+			// Render on the screen, the regions recorded by the workers are merged in a fixed order
+			renderQueue.begin(viewMatrices[i], glm::max(global_far, 250.0f));
+			for (int region = 0; region < Scene_Region::REGION_COUNT; region++) {
+				renderQueue.submit(sceneCommands[region]);
 			}
-			modelMatrix.pop();
-			
-			// ==================== Draw ROV ====================
-			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), ROVPosition));
-				modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(ROVYaw), glm::vec3(0.0, 1.0, 0.0)));
-				myShader.setMat4("model", modelMatrix.top());
-				drawROV(myShader);
-				if (showAxis) {
-					drawAxis(myShader);
-				}
-			modelMatrix.pop();
-
-			// ==================== Draw Camera ====================
-			modelMatrix.push();
-				if(isGhost) {
-					glm::vec3 location = camera.Front * -1.4f + camera.Position;
-					modelMatrix.save(glm::translate(modelMatrix.top(), location));
-					modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(-camera.Yaw), glm::vec3(0.0f, 1.0f, 0.0f)));
-					modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(camera.Pitch), glm::vec3(1.0f, 0.0f, 0.0f)));
-				} else {
-					glm::vec3 location = followCamera.Front * 1.4f + followCamera.Position;
-					modelMatrix.save(glm::translate(modelMatrix.top(), location));
-					modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(-followCamera.Yaw), glm::vec3(0.0f, 1.0f, 0.0f)));
-					modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(followCamera.Pitch), glm::vec3(1.0f, 0.0f, 0.0f)));
-				}
-				drawCamera(myShader);
-				if (showAxis) {
-					drawAxis(myShader);
-				}
-			modelMatrix.pop();
 
 			// ==================== Update View Volume ====================
 			glBindVertexArray(viewVolumeVAO);
@@ -648,47 +947,69 @@ int main() {
 				glBufferData(GL_ARRAY_BUFFER, viewVolumeVertices.size() * sizeof(float), viewVolumeVertices.data(), GL_STATIC_DRAW);
 			glBindVertexArray(0);
 
-			// ==================== Draw View Volume ====================
-			modelMatrix.push();
-				myShader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 0.6f));
-				myShader.setVec4("material.diffuse", glm::vec4(0.6f, 0.6f, 0.6f, 0.6f));
-				myShader.setVec4("material.specular", glm::vec4(0.0f, 0.0, 0.0, 1.0f));
-				myShader.setFloat("material.shininess", 32.0f);
-				myShader.setMat4("model", modelMatrix.top());
-				glBindVertexArray(viewVolumeVAO);
-					glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-				glBindVertexArray(0);
-			modelMatrix.pop();
-
-			// ==================== draw light ball ====================
-			myShader.setBool("material.enableColorTexture", false);
-			myShader.setBool("material.enableSpecularTexture", false);
-			myShader.setBool("material.enableEmission", true);
-			myShader.setBool("material.enableEmissionTexture", false);
-			for (unsigned int i = 0; i < pointLights.size(); i++) {
-				if (!pointLights[i].Enable) {
-					continue;
+			// Opaque objects front-to-back, then billboards, then blended objects back-to-front
+			if (useDeferred) {
+				// Geometry pass, blending would mix the G-buffer with its clear values
+				gBuffer.bindGeometryPass();
+				glDisable(GL_BLEND);
+				renderQueue.execute(useGeometryShader, Render_Pass::PASS_OPAQUE, Render_Pass::PASS_ALPHA_TESTED);
+				glEnable(GL_BLEND);
+				glBindFramebuffer(GL_FRAMEBUFFER, renderTarget);
+
+				// Lighting pass, every pixel of this viewport is lit once and gets the depth of the G-buffer
+				GLint viewport[4];
+				glGetIntegerv(GL_VIEWPORT, viewport);
+				gBuffer.bindTextures();
+				Shader lightingShader = bindVariant(phongShaders, frameFeatures | Shader_Feature::FEATURE_LIGHTING_PASS);
+				lightingShader.setMat4("inverseViewProjection", glm::inverse(projectionMatrices[i] * viewMatrices[i]));
+				lightingShader.setVec4("viewportRect", glm::vec4((float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]));
+				glDepthFunc(GL_ALWAYS);
+				gBuffer.drawQuad();
+				glDepthFunc(GL_LESS);
+
+				// The skybox and the blended objects are drawn forward on top
+				drawSkybox(cubemapTexture);
+				renderQueue.execute(useShader, Render_Pass::PASS_BLENDED, Render_Pass::PASS_BLENDED);
+			} else {
+				// The skybox goes between the opaque and the blended objects, the covered pixels fail the depth test
+				renderQueue.execute(useShader, Render_Pass::PASS_OPAQUE, Render_Pass::PASS_ALPHA_TESTED);
+				drawSkybox(cubemapTexture);
+				renderQueue.execute(useShader, Render_Pass::PASS_BLENDED, Render_Pass::PASS_BLENDED);
+			}
+
+			if (multiView) {
+				for (int plane = 0; plane < 4; plane++) {
+					glDisable(GL_CLIP_DISTANCE0 + plane);
 				}
-				modelMatrix.push();
-					if (i == 4) {
-						// ROV light
-						modelMatrix.save(glm::translate(modelMatrix.top(), pointLights[i].Position + glm::vec3(0.0f, -0.7f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f)));
-					} else {
-						modelMatrix.save(glm::translate(modelMatrix.top(), pointLights[i].Position));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.5f)));
-					}
-					myShader.setVec4("material.ambient", glm::vec4(pointLights[i].Ambient.x, pointLights[i].Ambient.y, pointLights[i].Ambient.z, 1.0f));
-					myShader.setVec4("material.diffuse", glm::vec4(pointLights[i].Diffuse.x, pointLights[i].Diffuse.y, pointLights[i].Diffuse.z, 1.0f));
-					myShader.setVec4("material.specular", glm::vec4(pointLights[i].Specular.x, pointLights[i].Specular.y, pointLights[i].Specular.z, 1.0f));
-					myShader.setFloat("material.shininess", 32.0f);
-					myShader.setMat4("model", modelMatrix.top());
-					drawSphere();
-				modelMatrix.pop();
 			}
-			myShader.setBool("material.enableEmission", false);
+			if (cachedMonitor) {
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+				drawCachedMonitor(i);
+			}
 		}
 
+		// Collect the uniform cache statistics of this frame
+		uniformCalls = phongShaders.getUniformCalls() + gouraudShaders.getUniformCalls();
+		uniformElided = phongShaders.getElidedCalls() + gouraudShaders.getElidedCalls();
+		uniformInactive = phongShaders.getInactiveCalls() + gouraudShaders.getInactiveCalls();
+		phongShaders.resetUniformStats();
+		gouraudShaders.resetUniformStats();
+		shaderVariants = phongShaders.size() + gouraudShaders.size() + skyboxShaders.size();
+		bufferUploads = frameUBO.Uploads + viewUBO.Uploads;
+		bufferSkipped = frameUBO.Skipped + viewUBO.Skipped;
+		frameUBO.resetStats();
+		viewUBO.resetStats();
+		queuePackets = renderQueue.Packets;
+		textureBinds = renderQueue.TextureBinds;
+		textureBindsSkipped = renderQueue.TextureBindsSkipped;
+		materialChanges = renderQueue.MaterialChanges;
+		renderQueue.resetStats();
+		jobsExecuted = jobSystem.Executed;
+		jobsStolen = jobSystem.Stolen;
+		jobSystem.resetStats();
+		texturesUploaded = textureLoader.UploadedImages;
+		textureLoader.resetStats();
+
 		// render on the screen
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -696,17 +1017,45 @@ int main() {
 		// Swap Buffers and Trigger event
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+
+		if (isFirstFrame) {
+			isFirstFrame = false;
+			ProgramCacheStats& stats = Shader::getCacheStats();
+			logging::loggingMessage(logging::LogType::INFO, "Time to first frame: " + std::to_string(glfwGetTime() * 1000.0) + " ms");
+			logging::loggingMessage(logging::LogType::INFO, "Shader cache hits: " + std::to_string(stats.Hits) + " (" + std::to_string(stats.HitTime) + " ms), misses: " + std::to_string(stats.Misses) + " (" + std::to_string(stats.MissTime) + " ms)");
+		}
 	}
 	glDeleteVertexArrays(1, &cubeVAO);
 	glDeleteBuffers(1, &cubeVBO);
 	glDeleteBuffers(1, &cubeEBO);
+
+	glDeleteVertexArrays(1, &skyboxVAO);
+	glDeleteBuffers(1, &skyboxVBO);
 	
 	glDeleteVertexArrays(1, &floorVAO);
 	glDeleteBuffers(1, &floorVBO);
 	glDeleteBuffers(1, &floorEBO);
 
-	glDeleteVertexArrays(1, &planeVAO);
-	glDeleteBuffers(1, &planeVBO);
+	spriteBillboard.release();
+	spriteArray.release();
+	textureLoader.release();
+	world.stop();
+
+	boxMeshes.release();
+	plasticMeshes.release();
+	lightBallMeshes.release();
+
+	rovModel.release();
+
+	frameUBO.release();
+	lightClusters.release();
+	gBuffer.release();
+	jobSystem.release();
+	simulation.stop();
+	viewUBO.release();
+	materialUBO.release();
+	multiViewUBO.release();
+	monitorCache.release();
 
 	glDeleteVertexArrays(1, &sphereVAO);
 	glDeleteBuffers(1, &sphereVBO);
@@ -865,7 +1214,8 @@ void showUI() {
 		if (ImGui::BeginTabItem("Illumination")) {
 
 			ImGui::Text("Lighting Model: %s", useBlinnPhong ? "Blinn-Phong" : "Phong");
-			ImGui::Text("Shading Model: %s", usePhongShading ? "Phong" : "Gouraud");
+			ImGui::Text("Shading Model: %s", usePhongShading ? (useDeferredShading ? "Phong (Deferred)" : "Phong") : "Gouraud");
+			ImGui::Checkbox("Deferred Shading", &useDeferredShading);
 			ImGui::Checkbox("use Exponent", &useSpotExponent);
 			ImGui::Checkbox("Lighting", &useLighting);
 			ImGui::Checkbox("DiffuseTexture", &useDiffuseTexture);
@@ -873,6 +1223,8 @@ void showUI() {
 			ImGui::Checkbox("Emission", &useEmission);
 			ImGui::Checkbox("Gamma Correction", &useGamma);
 			ImGui::SliderFloat("Gamma Value", &GammaValue, 1.0f / 2.2f, 2.2f);
+			ImGui::Checkbox("Clustered Lighting", &useClusteredLighting);
+			ImGui::SliderInt("Work Lights", &numWorkLights, 0, 1000);
 			ImGui::Spacing();
 			
 			if (ImGui::TreeNode("Direction Light")) {
@@ -892,7 +1244,7 @@ void showUI() {
 				std::string index = ss.str();
 
 				if (ImGui::TreeNode(std::string("Point Light " + index).c_str())) {
-					if (i != 4) {
+					if (i != rovPointLight) {
 						// ROVA]mOwbROVWAҥHo䤣վ
 						ImGui::SliderFloat3(std::string("Position").c_str(), (float*)&pointLights[i].Position, -50.0f, 50.0f);
 					}
@@ -900,7 +1252,7 @@ void showUI() {
 					ImGui::SliderFloat3(std::string("Ambient").c_str(), (float*)&pointLights[i].Ambient, 0.0f, 1.0f);
 					ImGui::SliderFloat3(std::string("Diffuse").c_str(), (float*)&pointLights[i].Diffuse, 0.0f, 1.0f);
 
-					if (i != 4) {
+					if (i != rovPointLight) {
 						// ROVSpecularAվAݰ_Ӥ~|ǩǪ
 						ImGui::SliderFloat3(std::string("Specular").c_str(), (float*)&pointLights[i].Specular, 0.0f, 1.0f);
 					}
@@ -942,6 +1294,12 @@ void showUI() {
 		if (ImGui::BeginTabItem("Texture")) {
 			ImGui::Checkbox("Billboard", &enableBillboard);
 			ImGui::SliderInt(std::string("Key Frame Rate").c_str(), &keyFrameRate, 0, 24);
+			// Changing the quality loads every texture again, from the cache when it was baked with that quality before
+			const char* qualities[] = { "NONE", "FAST", "HIGH" };
+			int quality = (int)textureLoader.getQuality();
+			if (ImGui::Combo("Compression", &quality, qualities, IM_ARRAYSIZE(qualities))) {
+				textureLoader.setQuality((Compression_Quality)quality);
+			}
 			ImGui::Spacing();
 
 			ImGui::EndTabItem();
@@ -966,6 +1324,59 @@ void showUI() {
 
 			ImGui::EndTabItem();
 		}
+		if (ImGui::BeginTabItem("Statistics")) {
+			ImGui::Text("Uniform Calls: %u", uniformCalls);
+			ImGui::Text("Elided Calls: %u (%.1f%%)", uniformElided, (uniformCalls > 0) ? 100.0f * uniformElided / uniformCalls : 0.0f);
+			ImGui::Text("Uploaded Calls: %u", uniformCalls - uniformElided);
+			ImGui::Text("Inactive Uniform Calls: %u", uniformInactive);
+			ImGui::Text("Uniform Buffer Uploads: %u, Skipped: %u", bufferUploads, bufferSkipped);
+			ImGui::Text("Shader Variants: %u", shaderVariants);
+			ImGui::Text("Draw Packets: %u, Material Changes: %u", queuePackets, materialChanges);
+			ImGui::Text("Texture Binds: %u, Skipped: %u", textureBinds, textureBindsSkipped);
+			ImGui::Text("Textures Loading: %u, Uploaded: %u", textureLoader.getPending(), texturesUploaded);
+			ImGui::Text("Texture Cache Hits: %u, Baked: %u", textureLoader.CacheHits.load(), textureLoader.CacheBakes.load());
+			ImGui::Text("Texture Memory: %.2f MB", textureLoader.ResidentBytes / (1024.0f * 1024.0f));
+			ImGui::Text("World Chunks: %u resident, %u loading, %.2f / %.0f MB", (unsigned int)world.getResident().size(), world.getPending(),
+				world.getResidentBytes() / (1024.0f * 1024.0f), world.MemoryBudget / (1024.0f * 1024.0f));
+			ImGui::Text("Chunks Loaded: %u, Evicted: %u", world.Loaded.load(), world.Evicted.load());
+			if (useClusteredLighting && usePhongShading) {
+				ImGui::Text("Chunk Lights: %u", (unsigned int)chunkLights.size());
+			} else {
+				ImGui::Text("Chunk Lights: %u, %u nearest lit without clusters", (unsigned int)chunkLights.size(), (unsigned int)fixedChunkLights.size());
+			}
+			ImGui::SliderInt("Chunk Radius", &world.LoadRadius, 1, 6);
+			ImGui::Text("Clustered Lights: %u, Light Indices: %u", clusteredLightCount, clusterIndexCount);
+			ImGui::SliderInt("Obstacles", &numBoxes, 0, 50000);
+			float simulationRate = simulation.TickRate;
+			if (ImGui::SliderFloat("Simulation Rate", &simulationRate, 10.0f, 240.0f, "%.0f Hz")) {
+				simulation.TickRate = simulationRate;
+			}
+			ImGui::Checkbox("Frustum Culling", &enableCulling);
+			ImGui::Text("Jobs: %u, Stolen: %u, Workers: %u", jobsExecuted, jobsStolen, jobSystem.getWorkers());
+			if (ImGui::Button("Run Job Benchmark")) {
+				benchmarkJobSystem();
+			}
+			for (unsigned int i = 0; i < jobBenchmark.size(); i++) {
+				ImGui::Text("%.0f Threads: %.2f ms (x%.2f)", jobBenchmark[i].x, jobBenchmark[i].y, jobBenchmark[0].y / jobBenchmark[i].y);
+			}
+			for (int i = 0; i < 4; i++) {
+				if (singlePassFrame && visibleInstances[i] + culledInstances[i] > 0) {
+					ImGui::Text("All Monitors: %u visible, %u culled", visibleInstances[i], culledInstances[i]);
+				} else if (visibleInstances[i] + culledInstances[i] > 0) {
+					ImGui::Text("Monitor %d: %u visible, %u culled", i + 1, visibleInstances[i], culledInstances[i]);
+				}
+			}
+			ImGui::Checkbox("Single Pass Quad View", &useSinglePassQuad);
+			ImGui::Checkbox("Cache Ortho Monitors", &useMonitorCache);
+			ImGui::SliderFloat("Monitor Refresh Rate", &monitorCache.RefreshRate, 1.0f, 60.0f, "%.0f Hz");
+			ImGui::SliderFloat("Monitor Resolution", &monitorScale, 0.25f, 1.0f);
+			if (refreshedMonitor >= 0) {
+				ImGui::Text("Redrawn Monitor: %d", refreshedMonitor + 1);
+			}
+			ImGui::Spacing();
+
+			ImGui::EndTabItem();
+		}
 		ImGui::EndTabBar();
 	}
 	ImGui::Spacing();
@@ -1046,24 +1457,25 @@ void setProjectionMatrix(int type) {
 }
 
 void setViewport(int type) {
+	glm::vec4 rect = getViewportRect(type);
+	glViewport((int)rect.x, (int)rect.y, (int)rect.z, (int)rect.w);
+}
+
+// x, y, width and height of the monitor in the window.
+glm::vec4 getViewportRect(int type) {
 	if(currentScreen == 4) {
 		switch (type) {
 			case Monitor::Monitor_X:
-				glViewport(0, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
-				break;
+				return glm::vec4(0, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 			case Monitor::Monitor_Y:
-				glViewport(SCR_WIDTH / 2, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
-				break;
+				return glm::vec4(SCR_WIDTH / 2, SCR_HEIGHT / 2, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 			case Monitor::Monitor_Z:
-				glViewport(0, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
-				break;
+				return glm::vec4(0, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 			case Monitor::Monitor_Result:
-				glViewport(SCR_WIDTH / 2, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
-				break;
+				return glm::vec4(SCR_WIDTH / 2, 0, SCR_WIDTH / 2, SCR_HEIGHT / 2);
 		}
-	} else {
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 	}
+	return glm::vec4(0, 0, SCR_WIDTH, SCR_HEIGHT);
 }
 
 void geneObejectData() {
@@ -1137,13 +1549,47 @@ void geneObejectData() {
 	// ==================================================
 
 
+	// ========== Generate Skybox vertex data ==========
+	skyboxVertices = {
+		-0.5f,  0.5f, -0.5f,	-0.5f, -0.5f, -0.5f,	 0.5f, -0.5f, -0.5f,
+		 0.5f, -0.5f, -0.5f,	 0.5f,  0.5f, -0.5f,	-0.5f,  0.5f, -0.5f,
+
+		-0.5f, -0.5f,  0.5f,	-0.5f, -0.5f, -0.5f,	-0.5f,  0.5f, -0.5f,
+		-0.5f,  0.5f, -0.5f,	-0.5f,  0.5f,  0.5f,	-0.5f, -0.5f,  0.5f,
+
+		 0.5f, -0.5f, -0.5f,	 0.5f, -0.5f,  0.5f,	 0.5f,  0.5f,  0.5f,
+		 0.5f,  0.5f,  0.5f,	 0.5f,  0.5f, -0.5f,	 0.5f, -0.5f, -0.5f,
+
+		-0.5f, -0.5f,  0.5f,	-0.5f,  0.5f,  0.5f,	 0.5f,  0.5f,  0.5f,
+		 0.5f,  0.5f,  0.5f,	 0.5f, -0.5f,  0.5f,	-0.5f, -0.5f,  0.5f,
+
+		-0.5f,  0.5f, -0.5f,	 0.5f,  0.5f, -0.5f,	 0.5f,  0.5f,  0.5f,
+		 0.5f,  0.5f,  0.5f,	-0.5f,  0.5f,  0.5f,	-0.5f,  0.5f, -0.5f,
+
+		-0.5f, -0.5f, -0.5f,	-0.5f, -0.5f,  0.5f,	 0.5f, -0.5f, -0.5f,
+		 0.5f, -0.5f, -0.5f,	-0.5f, -0.5f,  0.5f,	 0.5f, -0.5f,  0.5f,
+	};
+	glGenVertexArrays(1, &skyboxVAO);
+	glGenBuffers(1, &skyboxVBO);
+	glBindVertexArray(skyboxVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+		glBufferData(GL_ARRAY_BUFFER, skyboxVertices.size() * sizeof(float), skyboxVertices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glBindVertexArray(0);
+	// ==================================================
+
+
 	// ========== Generate floor vertex data ==========
+	// One tile of a chunk, the texture repeats every 8 units so the tiles join without a seam
+	const float tile = WORLD_CHUNK_SIZE;
+	const float repeat = WORLD_CHUNK_SIZE / 8.0f;
 	floorVertices = {
 		// Positions			// Normals			// Texture Coords
-		-100.0,  0.0,  100.0,	0.0f, 1.0f, 0.0f,	25.0f,  0.0f,
-		 100.0,  0.0,  100.0,	0.0f, 1.0f, 0.0f,	25.0f, 25.0f,
-		 100.0,  0.0, -100.0,	0.0f, 1.0f, 0.0f,	 0.0f, 25.0f,
-		-100.0,  0.0, -100.0,	0.0f, 1.0f, 0.0f,	 0.0f,  0.0f,
+		0.0f, 0.0f, tile,		0.0f, 1.0f, 0.0f,	repeat, 0.0f,
+		tile, 0.0f, tile,		0.0f, 1.0f, 0.0f,	repeat, repeat,
+		tile, 0.0f, 0.0f,		0.0f, 1.0f, 0.0f,	0.0f, repeat,
+		0.0f, 0.0f, 0.0f,		0.0f, 1.0f, 0.0f,	0.0f, 0.0f,
 	};
 	floorIndices = {
 		0, 1, 2,
@@ -1167,29 +1613,8 @@ void geneObejectData() {
 	// ==================================================
 
 
-	// ========== Generate grass vertex data ==========
-	planeVertices = {
-		// Positions		// Normals			// Texture coords
-		 0.0,  1.0, 0.0,	0.0, 0.0, 1.0,		0.0, 0.0,
-		 0.0,  0.0, 0.0,	0.0, 0.0, 1.0,		0.0, 1.0,
-		 1.0,  0.0, 0.0,	0.0, 0.0, 1.0,		1.0, 1.0,
-
-		 0.0,  1.0, 0.0,	0.0, 0.0, 1.0,		0.0, 0.0,
-		 1.0,  0.0, 0.0,	0.0, 0.0, 1.0,		1.0, 1.0,
-		 1.0,  1.0, 0.0,	0.0, 0.0, 1.0,		1.0, 0.0,
-	};
-	glGenVertexArrays(1, &planeVAO);
-	glGenBuffers(1, &planeVBO);
-	glBindVertexArray(planeVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-		glBufferData(GL_ARRAY_BUFFER, planeVertices.size() * sizeof(float), planeVertices.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-	glBindVertexArray(0);
+	// ========== Generate billboard vertex data ==========
+	spriteBillboard.setup();
 	// ==================================================
 	
 	// ========== Generate View Volume vertex data ==========
@@ -1264,6 +1689,16 @@ void geneObejectData() {
 	// ========== Generate sphere vertex data ==========
 	geneSphereData();
 	// ==================================================
+
+	// ========== Generate ROV vertex data ==========
+	geneROVData();
+	// ==================================================
+
+	// ========== Generate instanced mesh data ==========
+	boxMeshes.setup(cubeVBO, cubeEBO, 36);
+	plasticMeshes.setup(cubeVBO, cubeEBO, 36);
+	lightBallMeshes.setup(sphereVBO, sphereEBO, sphereIndices.size());
+	// ==================================================
 }
 
 void geneSphereData() {
@@ -1335,6 +1770,66 @@ void geneSphereData() {
 	glBindVertexArray(0);
 }
 
+// Bake the ROV hierarchy into one mesh, the transforms are the same as the old per-part drawing.
+void geneROVData() {
+	std::vector<unsigned int> cube(cubeIndices.begin(), cubeIndices.end());
+	glm::mat4 root = glm::mat4(1.0f);
+
+	// Head
+	rovModel.addPart(cubeVertices, cube, glm::scale(root, glm::vec3(1.0f, 0.6f, 2.0f)), 0, Material_Index::MATERIAL_ROV_HEAD);
+
+	// Body
+	glm::mat4 body = glm::translate(root, glm::vec3(0.0f, -0.5f, 0.0f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(body, glm::vec3(0.8f, 0.4f, 1.6f)), 0, Material_Index::MATERIAL_ROV_BODY);
+
+	// Camera
+	glm::mat4 lens = glm::translate(body, glm::vec3(0.0f, 0.0f, -0.95f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(lens, glm::vec3(0.2f, 0.2f, 0.3f)), 0, Material_Index::MATERIAL_ROV_LENS);
+
+	// Hand
+	glm::mat4 hand = glm::translate(body, glm::vec3(0.0f, -0.2f, -0.4f));
+	rovModel.addPart(sphereVertices, sphereIndices, glm::scale(hand, glm::vec3(0.2f, 0.2f, 0.2f)), 0, Material_Index::MATERIAL_ROV_JOINT);
+
+	hand = glm::translate(hand, glm::vec3(0.0f, -0.3f, 0.0f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(hand, glm::vec3(0.05f, 0.6f, 0.05f)), 0, Material_Index::MATERIAL_ROV_ARM);
+
+	hand = glm::translate(hand, glm::vec3(0.0f, -0.3f, 0.0f));
+	rovModel.addPart(sphereVertices, sphereIndices, glm::scale(hand, glm::vec3(0.15f, 0.15f, 0.15f)), 0, Material_Index::MATERIAL_ROV_JOINT);
+
+	glm::mat4 arm = glm::translate(hand, glm::vec3(0.0f, 0.0f, -0.5f));
+	arm = glm::rotate(arm, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(arm, glm::vec3(0.05f, 1.0f, 0.05f)), 0, Material_Index::MATERIAL_ROV_ARM);
+
+	hand = glm::translate(hand, glm::vec3(0.0f, 0.0f, -1.0f));
+	rovModel.addPart(sphereVertices, sphereIndices, glm::scale(hand, glm::vec3(0.1f, 0.1f, 0.1f)), 0, Material_Index::MATERIAL_ROV_JOINT);
+
+	hand = glm::translate(hand, glm::vec3(0.0f, 0.0f, -0.1f));
+	glm::mat4 claw = glm::translate(hand, glm::vec3(-0.05f, 0.0f, 0.0f));
+	claw = glm::rotate(claw, glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(claw, glm::vec3(0.05f, 0.2f, 0.2f)), 0, Material_Index::MATERIAL_ROV_ARM);
+
+	claw = glm::translate(hand, glm::vec3(0.05f, 0.0f, 0.0f));
+	claw = glm::rotate(claw, glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(claw, glm::vec3(0.05f, 0.2f, 0.2f)), 0, Material_Index::MATERIAL_ROV_ARM);
+
+	// Engine
+	glm::mat4 engine = glm::translate(body, glm::vec3(0.0f, 0.0f, 1.1f));
+	rovModel.addPart(cubeVertices, cube, glm::scale(engine, glm::vec3(0.1f, 0.1f, 0.6f)), 0, Material_Index::MATERIAL_ROV_ARM);
+
+	// Propeller, rotated by ROVEngineAngle around its own joint
+	ROVEngineTransform = glm::translate(engine, glm::vec3(0.0f, 0.0f, 0.3f));
+	rovEngineJoint = rovModel.addJoint();
+	glm::mat4 propeller = glm::mat4(1.0f);
+	rovModel.addPart(sphereVertices, sphereIndices, glm::scale(propeller, glm::vec3(0.2f, 0.2f, 0.1f)), rovEngineJoint, Material_Index::MATERIAL_ROV_HUB);
+	for (int i = 0; i < 3; i++) {
+		glm::mat4 blade = glm::rotate(propeller, glm::radians(120.0f * i), glm::vec3(0.0f, 0.0f, 1.0f));
+		blade = glm::translate(blade, glm::vec3(0.0f, 0.3f, 0.0f));
+		rovModel.addPart(cubeVertices, cube, glm::scale(blade, glm::vec3(0.2f, 0.6f, 0.05f)), rovEngineJoint, Material_Index::MATERIAL_ROV_BLADE);
+	}
+
+	rovModel.setup();
+}
+
 void updateViewVolumeData() {
 
 	glm::vec4 rtnp, ltnp, rbnp, lbnp, rtfp, ltfp, rbfp, lbfp = glm::vec4(1.0f);
@@ -1479,481 +1974,700 @@ void drawCube() {
 	modelMatrix.pop();
 }
 
-void drawPlane(Shader shader, glm::vec3 position, float size_w, float size_h, int method) {
-	glm::mat4 view_model = view * modelMatrix.top();
-	
-	glm::vec3 billboard_x = glm::vec3(0.0f);
-	glm::vec3 billboard_y = glm::vec3(0.0f);
-	glm::vec3 billboard_z = glm::vec3(0.0f);
-	
+// Select the shader variant for the material features of an object, on top of the features of this frame.
+Shader useShader(unsigned int materialFeatures) {
+	return bindVariant(usePhongShading ? phongShaders : gouraudShaders, frameFeatures | maskMaterialFeatures(materialFeatures));
+}
+
+// Geometry pass of deferred shading, the G-buffer doesn't depend on the lights or the fog, so the frame features are left out.
+Shader useGeometryShader(unsigned int materialFeatures) {
+	return bindVariant(phongShaders, Shader_Feature::FEATURE_DEFERRED | maskMaterialFeatures(materialFeatures));
+}
+
+Shader bindVariant(ShaderVariants& variants, uint64_t key) {
+	Shader& shader = variants.get(key);
+	if (shader.ID != currentProgram) {
+		shader.use();
+		currentProgram = shader.ID;
+	}
+	return shader;
+}
+
+// Drop the material features turned off in the panel.
+unsigned int maskMaterialFeatures(unsigned int materialFeatures) {
+	if (!useDiffuseTexture) {
+		materialFeatures &= ~Shader_Feature::FEATURE_DIFFUSE_TEXTURE;
+	}
+	if (!useSpecularTexture) {
+		materialFeatures &= ~Shader_Feature::FEATURE_SPECULAR_TEXTURE;
+	}
+	if (!useEmission) {
+		materialFeatures &= ~(Shader_Feature::FEATURE_EMISSION | Shader_Feature::FEATURE_EMISSION_TEXTURE);
+	}
+	return materialFeatures;
+}
+
+// Stretch the cached image of an ortho monitor over its viewport, the copy is neither blended nor depth tested.
+void drawCachedMonitor(int monitor) {
+	setViewport(monitor);
+	Shader shader = bindVariant(monitorShaders, 0);
+	shader.setInt("monitor", MONITOR_CACHE_UNIT);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	monitorCache.draw(monitor, MONITOR_CACHE_UNIT);
+	glEnable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+}
+
+// The skybox is drawn at the far plane after the opaque objects, so it only fills the pixels no other object covered.
+// It has a program of its own, only the fog, the gamma and the monitors of the frame features apply to it.
+void drawSkybox(unsigned int cubemapTexture) {
+	uint64_t skyFeatures = frameFeatures & (Shader_Feature::FEATURE_FOG | Shader_Feature::FEATURE_GAMMA | Shader_Feature::FEATURE_MULTIVIEW | ShaderVariants::fogKey(0x3, 0x1));
+	Shader myShader = bindVariant(skyboxShaders, skyFeatures);
+
+	// The direction light is the only light tinting the sky, the sky is black while it is turned off
+	glm::vec3 skyTint(1.0f);
+	if (useLighting) {
+		skyTint = dirLight.Enable ? dirLight.Diffuse * 2.0f : glm::vec3(0.0f);
+	}
+	myShader.setVec3("skyTint", skyTint);
+
+	glDepthFunc(GL_LEQUAL);
+	modelMatrix.push();
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+		modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(distanceOrthoCamera * 5.34)));
+		myShader.setMat4("model", modelMatrix.top());
+		glBindVertexArray(skyboxVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 36);
+		glBindVertexArray(0);
+	modelMatrix.pop();
+	glDepthFunc(GL_LESS);
+}
+
+unsigned int billboardFeatures() {
 	if (enableBillboard) {
-		billboard_z = glm::vec3(view_model[0][2], view_model[1][2], view_model[2][2]);
-		if (method == 0) {
-			// k1GYbTw
-			billboard_x = glm::vec3(billboard_z.z, 0.0f, -billboard_z.x);
-			billboard_y = glm::vec3(0.0f, 1.0f, 0.0f);
+		return Shader_Feature::FEATURE_BILLBOARD;
+	}
+	return Shader_Feature::FEATURE_BILLBOARD | Shader_Feature::FEATURE_BILLBOARD_FIXED;
+}
+
+// The seabed, the instanced sets and the effects, nothing in this region moves with the ROV
+void recordEnvironment(CommandBuffer& commands) {
+	StackArray matrices;
+	commands.clear();
+
+	// ==================== Draw origin and 3 axes ====================
+	if (showAxis) {
+		submitAxis(commands, matrices);
+	}
+
+	// ==================== Draw Sea ====================
+	PacketMaterial floorMaterial = { glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), 64.0f };
+	// One tile of the sea surface and one of the sand for every resident chunk
+	for (unsigned int i = 0; i < terrainTiles.size(); i++) {
+		matrices.push();
+			matrices.save(glm::translate(matrices.top(), terrainTiles[i]));
+			commands.submit(Render_Pass::PASS_OPAQUE, Shader_Feature::FEATURE_DIFFUSE_TEXTURE | Shader_Feature::FEATURE_SPECULAR_TEXTURE, { seaTexture, 0, 0 }, &floorMaterial, matrices.top(), [](Shader&) {
+				drawFloor();
+			});
+
+			// ==================== Draw Seabed ====================
+			matrices.save(glm::translate(matrices.top(), glm::vec3(0.0f, -5.0f, 0.0f)));
+			commands.submit(Render_Pass::PASS_OPAQUE, Shader_Feature::FEATURE_DIFFUSE_TEXTURE | Shader_Feature::FEATURE_SPECULAR_TEXTURE, { sandTexture, 0, 0 }, &floorMaterial, matrices.top(), [](Shader&) {
+				drawFloor();
+			});
+		matrices.pop();
+	}
+
+	// ==================== Draw grass, fishes and banana ====================
+	if (spriteArray.ready()) {
+		submitSprites(commands, matrices);
+	}
+
+	// ==================== Draw obstacles ====================
+	submitBox(commands, matrices);
+
+	// ==================== Draw Plastic Object ====================
+	commands.submit(Render_Pass::PASS_OPAQUE, Shader_Feature::FEATURE_INSTANCED, { 0, 0, 0 }, NULL, matrices.top(), [](Shader&) {
+		plasticMeshes.draw();
+	});
+
+	// ==================== Draw View Volume ====================
+	PacketMaterial viewVolumeMaterial = { glm::vec4(0.2f, 0.2f, 0.2f, 0.6f), glm::vec4(0.6f, 0.6f, 0.6f, 0.6f), glm::vec4(0.0f, 0.0, 0.0, 1.0f), 32.0f };
+	commands.submit(Render_Pass::PASS_BLENDED, 0, { 0, 0, 0 }, &viewVolumeMaterial, matrices.top(), [](Shader&) {
+		glBindVertexArray(viewVolumeVAO);
+			glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+		glBindVertexArray(0);
+	});
+
+	// ==================== draw light ball ====================
+	commands.submit(Render_Pass::PASS_OPAQUE, Shader_Feature::FEATURE_EMISSION | Shader_Feature::FEATURE_INSTANCED, { 0, 0, 0 }, NULL, matrices.top(), [](Shader&) {
+		lightBallMeshes.draw();
+	});
+}
+
+// The ROV and the camera follow the simulation, each of them is a region of its own
+void recordROV(CommandBuffer& commands) {
+	StackArray matrices;
+	commands.clear();
+
+	// ==================== Draw ROV ====================
+	matrices.push();
+		matrices.save(glm::translate(matrices.top(), ROVPosition));
+		matrices.save(glm::rotate(matrices.top(), glm::radians(ROVYaw), glm::vec3(0.0, 1.0, 0.0)));
+		submitROV(commands, matrices);
+		if (showAxis) {
+			submitAxis(commands, matrices);
+		}
+	matrices.pop();
+}
+
+void recordCamera(CommandBuffer& commands) {
+	StackArray matrices;
+	commands.clear();
+
+	// ==================== Draw Camera ====================
+	matrices.push();
+		if(isGhost) {
+			glm::vec3 location = camera.Front * -1.4f + camera.Position;
+			matrices.save(glm::translate(matrices.top(), location));
+			matrices.save(glm::rotate(matrices.top(), glm::radians(-camera.Yaw), glm::vec3(0.0f, 1.0f, 0.0f)));
+			matrices.save(glm::rotate(matrices.top(), glm::radians(camera.Pitch), glm::vec3(1.0f, 0.0f, 0.0f)));
 		} else {
-			// k2GYbTw
-			billboard_x = glm::vec3(view_model[0][0], view_model[1][0], view_model[2][0]);
-			billboard_y = glm::vec3(view_model[0][1], view_model[1][1], view_model[2][1]);
+			glm::vec3 location = followCamera.Front * 1.4f + followCamera.Position;
+			matrices.save(glm::translate(matrices.top(), location));
+			matrices.save(glm::rotate(matrices.top(), glm::radians(-followCamera.Yaw), glm::vec3(0.0f, 1.0f, 0.0f)));
+			matrices.save(glm::rotate(matrices.top(), glm::radians(followCamera.Pitch), glm::vec3(1.0f, 0.0f, 0.0f)));
 		}
-	} else {
-		billboard_z = glm::vec3(0.0f, 0.0f, -1.0f);
-		billboard_x = glm::vec3(billboard_z.z, 0.0f, -billboard_z.x);
-		billboard_y = glm::vec3(0.0f, 1.0f, 0.0f);
+		submitCamera(commands, matrices);
+		if (showAxis) {
+			submitAxis(commands, matrices);
+		}
+	matrices.pop();
+}
+
+// Every sprite is drawn in one batch, the frame of the flipbook is picked per instance in the vertex shader.
+// The sprites sample their array on unit 4, the packet has no texture of its own to bind.
+void submitSprites(CommandBuffer& commands, StackArray& matrices) {
+	PacketMaterial material = { glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), 16.0f };
+	commands.submit(Render_Pass::PASS_ALPHA_TESTED, billboardFeatures(), { 0, 0, 0 }, &material, matrices.top(), [](Shader& shader) {
+		shader.setFloat("spriteFrameRate", (float)keyFrameRate);
+		spriteBillboard.draw();
+	});
+}
+
+void submitBox(CommandBuffer& commands, StackArray& matrices) {
+	commands.submit(Render_Pass::PASS_OPAQUE, Shader_Feature::FEATURE_DIFFUSE_TEXTURE | Shader_Feature::FEATURE_SPECULAR_TEXTURE | Shader_Feature::FEATURE_INSTANCED, { boxTexture, boxSpecularTexture, 0 }, NULL, matrices.top(), [](Shader&) {
+		boxMeshes.draw();
+	});
+}
+
+// The populations used to be placed at startup, now they are the scene used when none was built.
+// "density" multiplies the number of entities, the area grows with it so they are as far apart as before.
+void generateScene(Scene& scene, unsigned int seed, float density) {
+	scene.clear();
+	density = std::max(density, 0.01f);
+	float spread = sqrt(density);
+
+	std::default_random_engine generator(seed);
+	std::uniform_real_distribution<float> unif_g(-80.0f * spread, 80.0f * spread);
+	std::uniform_real_distribution<float> unif_gsize(0.2f, 2.0f);
+	std::uniform_real_distribution<float> unif_f(-60.0f * spread, 60.0f * spread);
+	std::uniform_real_distribution<float> unif_fsize(0.5f, 1.5f);
+	std::uniform_real_distribution<float> unif_b(-30.0f * spread, 30.0f * spread);
+	std::uniform_real_distribution<float> unif_phase(0.0f, (float)BANANA_FRAMES);
+
+	// The bobbing of the boxes and plastic cubes is animated in the vertex shader.
+	unsigned int boxes = (unsigned int)(20 * density);
+	for (unsigned int i = 0; i < boxes; i++) {
+		scene.Boxes.push_back({ glm::vec4(unif_b(generator), 0.0f, unif_b(generator), 1.0f), glm::vec2(1.0f, (float)Material_Index::MATERIAL_BOX) });
 	}
-	
-	// p⳻I
-	glm::vec3 v0 = position - (size_w * billboard_x / 2.0f);
-	glm::vec3 v1 = position + (size_w * billboard_x / 2.0f);
-	glm::vec3 v2 = v1 + (size_h * billboard_y);
-	glm::vec3 v3 = v0 + (size_h * billboard_y);
-
-	// oyЪybOonWUA
-	planeVertices = {
-		// Positions		// Normals			// Texture coords
-		 v0.x, v0.y, v0.z,	0.0, 0.0, 1.0,		0.0, 1.0,
-		 v3.x, v3.y, v3.z,	0.0, 0.0, 1.0,		0.0, 0.0,
-		 v2.x, v2.y, v2.z,	0.0, 0.0, 1.0,		1.0, 0.0,
-
-		 v0.x, v0.y, v0.z,	0.0, 0.0, 1.0,		0.0, 1.0,
-		 v2.x, v2.y, v2.z,	0.0, 0.0, 1.0,		1.0, 0.0,
-		 v1.x, v1.y, v1.z,	0.0, 0.0, 1.0,		1.0, 1.0,
+	unsigned int plastics = (unsigned int)(10 * density);
+	for (unsigned int i = 0; i < plastics; i++) {
+		scene.Plastics.push_back({ glm::vec4(unif_b(generator), 0.0f, unif_b(generator), 1.0f), glm::vec2(1.0f, (float)Material_Index::MATERIAL_PLASTIC) });
+	}
+
+	// The grass stands on the seabed and the fishes swim above it, the bananas animate out of step.
+	unsigned int grass = (unsigned int)(600 * density);
+	unsigned int fishes = (unsigned int)(200 * density);
+	unsigned int bananas = (unsigned int)(50 * density);
+	scene.Sprites.reserve(grass + fishes + bananas);
+	for (unsigned int i = 0; i < grass; i++) {
+		glm::vec3 position(unif_g(generator), -5.0f, unif_g(generator));
+		float size = unif_gsize(generator);
+		scene.Sprites.push_back({ position, glm::vec2(size, size), (float)Billboard_Mode::CYLINDRICAL, glm::vec3((float)Sprite_Layer::SPRITE_GRASS, 1.0f, 0.0f) });
+	}
+	for (unsigned int i = 0; i < fishes; i++) {
+		glm::vec3 position(unif_f(generator), -2.5f, unif_f(generator));
+		float size = unif_fsize(generator);
+		scene.Sprites.push_back({ position, glm::vec2(size, size * 0.5f), (float)Billboard_Mode::SPHERICAL, glm::vec3((float)Sprite_Layer::SPRITE_FISH, 1.0f, 0.0f) });
+	}
+	for (unsigned int i = 0; i < bananas; i++) {
+		glm::vec3 position(unif_f(generator), 0.0f, unif_b(generator));
+		float size = unif_fsize(generator);
+		scene.Sprites.push_back({ position, glm::vec2(size, size), (float)Billboard_Mode::CYLINDRICAL, glm::vec3((float)Sprite_Layer::SPRITE_BANANA, (float)BANANA_FRAMES, unif_phase(generator)) });
+	}
+
+	scene.Lights.push_back(Scene::fromLight(Light(glm::vec4(-0.2f, -1.0f, -0.3f, 0.0f), false)));
+	scene.Lights.push_back(Scene::fromLight(Light(glm::vec3(10.0f, 10.0f, 35.0f), true)));
+	scene.Lights.push_back(Scene::fromLight(Light(glm::vec3(-45.0f, 5.0f, 30.0f), true)));
+	scene.Lights.push_back(Scene::fromLight(Light(glm::vec3(38.0f, 2.0f, -40.0f), true)));
+	scene.Lights.push_back(Scene::fromLight(Light(glm::vec3(-50.0f, 15.0f, -45.0f), true)));
+
+	SceneMaterial box = SceneMaterial();
+	box.Index = Material_Index::MATERIAL_BOX;
+	box.Material.Ambient = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	box.Material.Diffuse = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	box.Material.Specular = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	box.Material.Shininess = 64.0f;
+	scene.Materials.push_back(box);
+
+	SceneMaterial plastic = SceneMaterial();
+	plastic.Index = Material_Index::MATERIAL_PLASTIC;
+	plastic.Material.Ambient = glm::vec4(0.02f, 0.02f, 0.02f, 1.0);
+	plastic.Material.Diffuse = glm::vec4(0.1f, 0.35f, 0.1f, 1.0);
+	plastic.Material.Specular = glm::vec4(0.45f, 0.55f, 0.45f, 1.0);
+	plastic.Material.Shininess = 16.0f;
+	scene.Materials.push_back(plastic);
+
+	scene.Fog = fog.getData();
+	scene.HasFog = true;
+}
+
+// The instance tables are moved out of the scene into the chunks of the world, the scene is left without them.
+void applyScene(Scene& scene) {
+	world.setAuthored(scene);
+
+	// The last directional light wins, point lights past what the uniform block has room for are dropped
+	pointLights.clear();
+	unsigned int dropped = 0;
+	for (unsigned int i = 0; i < scene.Lights.size(); i++) {
+		Light light = Scene::toLight(scene.Lights[i]);
+		if (light.Caster == Light_Caster::DIRECTION) {
+			dirLight = light;
+		} else if (light.Caster == Light_Caster::POINT && pointLights.size() < MAX_SCENE_POINT_LIGHTS) {
+			pointLights.push_back(light);
+		} else {
+			dropped++;
+		}
+	}
+	if (dropped > 0) {
+		logging::loggingMessage(logging::LogType::WARNING, "Dropped " + std::to_string(dropped) + " lights of the scene, only " +
+			std::to_string(MAX_SCENE_POINT_LIGHTS) + " point lights and one directional light are supported.");
+	}
+	rovPointLight = (unsigned int)pointLights.size();
+	pointLights.push_back(Light(ROVPosition, true));
+	pointLights[rovPointLight].Diffuse = glm::vec3(1.0f, 0.0f, 0.0f);
+	pointLights[rovPointLight].Specular = glm::vec3(0.0f, 0.0f, 0.0f);
+
+	sceneMaterials = scene.Materials;
+	if (scene.HasFog) {
+		Scene::applyFog(scene.Fog, fog);
+	}
+}
+
+// Content of a chunk that was neither built nor part of the startup scene, about as dense as the startup scene.
+// The seed only depends on the chunk, so an evicted chunk comes back the same.
+void generateChunk(int x, int z, Scene& chunk) {
+	std::default_random_engine generator(((unsigned int)x * 73856093u) ^ ((unsigned int)z * 19349663u));
+	std::uniform_real_distribution<float> unif_p(0.0f, WORLD_CHUNK_SIZE);
+	std::uniform_real_distribution<float> unif_gsize(0.2f, 2.0f);
+	std::uniform_real_distribution<float> unif_fsize(0.5f, 1.5f);
+	std::uniform_real_distribution<float> unif_phase(0.0f, (float)BANANA_FRAMES);
+	std::uniform_real_distribution<float> unif_color(0.2f, 1.0f);
+	glm::vec3 origin = WorldStreamer::getOrigin(x, z);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		chunk.Boxes.push_back({ glm::vec4(origin.x + unif_p(generator), 0.0f, origin.z + unif_p(generator), 1.0f), glm::vec2(1.0f, (float)Material_Index::MATERIAL_BOX) });
+	}
+	for (unsigned int i = 0; i < 2; i++) {
+		chunk.Plastics.push_back({ glm::vec4(origin.x + unif_p(generator), 0.0f, origin.z + unif_p(generator), 1.0f), glm::vec2(1.0f, (float)Material_Index::MATERIAL_PLASTIC) });
+	}
+	for (unsigned int i = 0; i < 96; i++) {
+		float size = unif_gsize(generator);
+		chunk.Sprites.push_back({ origin + glm::vec3(unif_p(generator), -5.0f, unif_p(generator)), glm::vec2(size, size), (float)Billboard_Mode::CYLINDRICAL, glm::vec3((float)Sprite_Layer::SPRITE_GRASS, 1.0f, 0.0f) });
+	}
+	for (unsigned int i = 0; i < 56; i++) {
+		float size = unif_fsize(generator);
+		chunk.Sprites.push_back({ origin + glm::vec3(unif_p(generator), -2.5f, unif_p(generator)), glm::vec2(size, size * 0.5f), (float)Billboard_Mode::SPHERICAL, glm::vec3((float)Sprite_Layer::SPRITE_FISH, 1.0f, 0.0f) });
+	}
+	for (unsigned int i = 0; i < 28; i++) {
+		float size = unif_fsize(generator);
+		chunk.Sprites.push_back({ origin + glm::vec3(unif_p(generator), 0.0f, unif_p(generator)), glm::vec2(size, size), (float)Billboard_Mode::CYLINDRICAL, glm::vec3((float)Sprite_Layer::SPRITE_BANANA, (float)BANANA_FRAMES, unif_phase(generator)) });
+	}
+
+	// A work light hangs above the seabed of every other chunk
+	if (generator() % 2 == 0) {
+		Light light(origin + glm::vec3(unif_p(generator), -4.0f, unif_p(generator)), true);
+		light.Ambient = glm::vec3(0.0f);
+		light.Diffuse = glm::vec3(unif_color(generator), unif_color(generator), unif_color(generator));
+		light.Specular = light.Diffuse * 0.5f;
+		light.Linear = 0.35f;
+		light.Quadratic = 0.44f;
+		chunk.Lights.push_back(Scene::fromLight(light));
+	}
+}
+
+// Join the instances, the lights and the terrain of the resident chunks, only called when they changed.
+// Enabled point and spot lights of the chunks, the nearest to "focus" first, at most "slots" of them.
+void selectChunkLights(glm::vec3 focus, unsigned int slots, std::vector<const Light*>& selected) {
+	selected.clear();
+	for (unsigned int i = 0; i < chunkLights.size(); i++) {
+		if (chunkLights[i].Enable && (chunkLights[i].Caster == Light_Caster::POINT || chunkLights[i].Caster == Light_Caster::SPOT)) {
+			selected.push_back(&chunkLights[i]);
+		}
+	}
+	if (selected.size() > slots) {
+		std::partial_sort(selected.begin(), selected.begin() + slots, selected.end(), [focus](const Light* a, const Light* b) {
+			glm::vec3 da = a->Position - focus, db = b->Position - focus;
+			return glm::dot(da, da) < glm::dot(db, db);
+		});
+		selected.resize(slots);
+	}
+}
+
+// The cost depends on the resident chunks, which the memory budget of the streamer bounds.
+void rebuildWorld() {
+	boxMeshes.clear();
+	plasticMeshes.clear();
+	spriteBillboard.Instances.clear();
+	chunkLights.clear();
+	terrainTiles.clear();
+	const std::map<uint64_t, std::unique_ptr<WorldChunk>>& chunks = world.getResident();
+	for (auto it = chunks.begin(); it != chunks.end(); ++it) {
+		const WorldChunk& chunk = *it->second;
+		boxMeshes.Instances.insert(boxMeshes.Instances.end(), chunk.Content.Boxes.begin(), chunk.Content.Boxes.end());
+		plasticMeshes.Instances.insert(plasticMeshes.Instances.end(), chunk.Content.Plastics.begin(), chunk.Content.Plastics.end());
+		spriteBillboard.Instances.insert(spriteBillboard.Instances.end(), chunk.Content.Sprites.begin(), chunk.Content.Sprites.end());
+		for (unsigned int i = 0; i < chunk.Content.Lights.size(); i++) {
+			chunkLights.push_back(Scene::toLight(chunk.Content.Lights[i]));
+		}
+		terrainTiles.push_back(WorldStreamer::getOrigin(chunk.X, chunk.Z));
+	}
+	boxMeshes.Instances.insert(boxMeshes.Instances.end(), obstacleBoxes.begin(), obstacleBoxes.end());
+
+	boxMeshes.upload();
+	plasticMeshes.upload();
+	spriteBillboard.upload();
+	buildBounds(boxBounds, boxMeshes, 0.87f);
+	buildBounds(plasticBounds, plasticMeshes, 0.87f);
+	buildBounds(spriteBounds, spriteBillboard);
+}
+
+// Materials of the instanced meshes, only uploaded when one of them changed.
+void updateMaterialData() {
+	MaterialData materialData = MaterialData();
+
+	for (unsigned int i = 0; i < sceneMaterials.size(); i++) {
+		if (sceneMaterials[i].Index < MAX_MATERIALS) {
+			materialData.Materials[sceneMaterials[i].Index] = sceneMaterials[i].Material;
+		}
+	}
+
+	for (unsigned int i = 0; i < pointLights.size(); i++) {
+		MaterialEntry& ball = materialData.Materials[Material_Index::MATERIAL_LIGHT_BALL + i];
+		ball.Ambient = glm::vec4(pointLights[i].Ambient, 1.0f);
+		ball.Diffuse = glm::vec4(pointLights[i].Diffuse, 1.0f);
+		ball.Specular = glm::vec4(pointLights[i].Specular, 1.0f);
+		ball.Shininess = 32.0f;
+	}
+
+	// ROV, the ambient is the same as the diffuse for every part
+	const glm::vec4 rovColors[] = {
+		glm::vec4(1.0f, 0.956862745f, 0.580392157f, 1.0f),
+		glm::vec4(0.611764706f, 0.611764706f, 0.611764706f, 1.0f),
+		glm::vec4(0.1f, 0.1f, 0.1f, 1.0f),
+		glm::vec4(0.4f, 0.4f, 0.4f, 1.0f),
+		glm::vec4(0.2f, 0.2f, 0.2f, 1.0f),
+		glm::vec4(0.4f, 0.4f, 0.4f, 1.0f),
+		glm::vec4(0.2f, 0.2f, 0.2f, 1.0f),
+	};
+	const glm::vec4 rovSpeculars[] = {
+		glm::vec4(0.893548f, 0.771906f, 0.866721f, 1.0f),
+		glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f),
+		glm::vec4(0.50f, 0.50f, 0.50f, 1.0f),
+		glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f),
+		glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f),
+		glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f),
+		glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f),
 	};
+	const float rovShininess[] = { 256.0f, 16.0f, 16.0f, 64.0f, 64.0f, 16.0f, 16.0f };
+	for (unsigned int i = 0; i < 7; i++) {
+		MaterialEntry& part = materialData.Materials[Material_Index::MATERIAL_ROV_HEAD + i];
+		part.Ambient = rovColors[i];
+		part.Diffuse = rovColors[i];
+		part.Specular = rovSpeculars[i];
+		part.Shininess = rovShininess[i];
+	}
 
-	glBindVertexArray(planeVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
-	glBufferData(GL_ARRAY_BUFFER, planeVertices.size() * sizeof(float), planeVertices.data(), GL_STATIC_DRAW);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glBindVertexArray(0);
+	materialUBO.update(materialData);
 }
 
-void drawFish(Shader shader, glm::vec3 position, float size) {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, fishTexture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	shader.setBool("material.enableColorTexture", true);
-	shader.setBool("material.enableSpecularTexture", false);
-	shader.setBool("material.enableEmission", false);
-	shader.setBool("material.enableEmissionTexture", false);
-	shader.setFloat("material.shininess", 16.0f);
-	drawPlane(shader, position, size, size * 0.5, 1);
+// The quad may turn around its bottom center, so the sphere covers every facing.
+void buildBounds(SphereSet& bounds, const Billboard& billboard) {
+	bounds.clear();
+	for (unsigned int i = 0; i < billboard.Instances.size(); i++) {
+		const BillboardInstance& instance = billboard.Instances[i];
+		bounds.add(instance.Position, glm::length(glm::vec2(instance.Size.x * 0.5f, instance.Size.y)));
+	}
 }
 
-void drawGrass(Shader shader, glm::vec3 position, float size) {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, grassTexture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	shader.setBool("material.enableColorTexture", true);
-	shader.setBool("material.enableSpecularTexture", false);
-	shader.setBool("material.enableEmission", false);
-	shader.setBool("material.enableEmissionTexture", false);
-	shader.setFloat("material.shininess", 16.0f);
-	drawPlane(shader, position, size, size, 0);
+// "meshRadius" bounds the mesh at scale 1, the bobbing adds at most a quarter of its amplitude.
+void buildBounds(SphereSet& bounds, const InstancedMesh& mesh, float meshRadius) {
+	bounds.clear();
+	for (unsigned int i = 0; i < mesh.Instances.size(); i++) {
+		const MeshInstance& instance = mesh.Instances[i];
+		bounds.add(glm::vec3(instance.Transform), meshRadius * instance.Transform.w + 0.25f * instance.Params.x);
+	}
 }
 
-void drawBanana(Shader shader, glm::vec3 position, float size) {
-	float c_time = (float)glfwGetTime();
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, bananaTexture[((int)(c_time * keyFrameRate) % 8)]);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	shader.setBool("material.enableColorTexture", true);
-	shader.setBool("material.enableSpecularTexture", false);
-	shader.setBool("material.enableEmission", false);
-	shader.setBool("material.enableEmissionTexture", false);
-	shader.setFloat("material.shininess", 16.0f);
-	drawPlane(shader, position, size, size, 0);
+// The views firstView ~ lastView are drawn in one pass, an instance is kept when any of them sees it.
+// The culling and the gathering of the visible instances are queued on the job system, see uploadInstances().
+template <typename T>
+void cullInstances(T& instances, const SphereSet& bounds, CullResult& result, int firstView, int lastView, JobCounter& counter) {
+	if (!enableCulling) {
+		if (instances.DrawCount != instances.Instances.size()) {
+			instances.upload();
+		}
+		visibleInstances[firstView] += instances.DrawCount;
+		return;
+	}
+
+	jobSystem.run([&instances, &bounds, &result, firstView, lastView]() {
+		unsigned int count = bounds.size();
+		result.Chunks.resize((count + CULL_GRAIN - 1) / CULL_GRAIN);
+		jobSystem.parallelFor((unsigned int)result.Chunks.size(), 1, [&](unsigned int begin, unsigned int end) {
+			for (unsigned int c = begin; c < end; c++) {
+				result.Chunks[c].clear();
+				bounds.cull(&viewFrustums[firstView], lastView - firstView + 1, c * CULL_GRAIN, glm::min((c + 1) * CULL_GRAIN, count), result.Chunks[c]);
+			}
+		});
+
+		result.Visible.clear();
+		for (unsigned int c = 0; c < result.Chunks.size(); c++) {
+			result.Visible.insert(result.Visible.end(), result.Chunks[c].begin(), result.Chunks[c].end());
+		}
+		instances.gather(result.Visible);
+	}, counter);
 }
 
-void drawBox(Shader shader) {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, boxTexture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, boxSpecularTexture);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	shader.setBool("material.enableColorTexture", true);
-	shader.setBool("material.enableSpecularTexture", true);
-	shader.setBool("material.enableEmission", false);
-	shader.setBool("material.enableEmissionTexture", false);
-	shader.setFloat("material.shininess", 64.0f);
-	drawCube();
+// Upload the instances gathered by cullInstances(), once its jobs are done.
+template <typename T>
+void uploadInstances(T& instances, const SphereSet& bounds, const CullResult& result, int firstView) {
+	if (!enableCulling) {
+		return;
+	}
+	instances.uploadGathered();
+	visibleInstances[firstView] += (unsigned int)result.Visible.size();
+	culledInstances[firstView] += bounds.size() - (unsigned int)result.Visible.size();
 }
 
-void drawROV(Shader shader) {
-	modelMatrix.push();
-		// Head
-		modelMatrix.push();
-			modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(1.0f, 0.6f, 2.0f)));
-			shader.setVec4("material.ambient", glm::vec4(1.0f, 0.956862745f, 0.580392157f, 1.0f));
-			shader.setVec4("material.diffuse", glm::vec4(1.0f, 0.956862745f, 0.580392157f, 1.0f));
-			shader.setVec4("material.specular", glm::vec4(0.893548f, 0.771906f, 0.866721f, 1.0f));
-			shader.setFloat("material.shininess", 256.0f);
-			shader.setMat4("model", modelMatrix.top());
-			drawCube();
-		modelMatrix.pop();
-
-		// Body
-		modelMatrix.push();
-			modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.5f, 0.0f)));
-			modelMatrix.push();
-				modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.8f, 0.4f, 1.6f)));
-				shader.setVec4("material.ambient", glm::vec4(0.611764706f, 0.611764706f, 0.611764706f, 1.0f));
-				shader.setVec4("material.diffuse", glm::vec4(0.611764706f, 0.611764706f, 0.611764706f, 1.0f));
-				shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-				shader.setFloat("material.shininess", 16.0f);
-				shader.setMat4("model", modelMatrix.top());
-				drawCube();
-			modelMatrix.pop();
-
-			// Camera
-			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.95f)));
-				modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.3f)));
-				shader.setVec4("material.ambient", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
-				shader.setVec4("material.diffuse", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
-				shader.setVec4("material.specular", glm::vec4(0.50,0.50,	0.50,1.0f));
-				shader.setFloat("material.shininess", 16.0f);
-				shader.setMat4("model", modelMatrix.top());
-				drawCube();
-			modelMatrix.pop();
-
-			// Hand
-			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.2f, -0.4f)));
-				modelMatrix.push();
-					modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.2f)));
-					shader.setVec4("material.ambient", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-					shader.setVec4("material.diffuse", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-					shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-					shader.setFloat("material.shininess", 64.0f);
-					shader.setMat4("model", modelMatrix.top());
-					drawSphere();
-				modelMatrix.pop();
-
-				modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.3f, 0.0f)));
-					modelMatrix.push();
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 0.6f, 0.05f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 64.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, -0.3f, 0.0f)));
-					modelMatrix.push();
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.15f, 0.15f, 0.15f)));
-						shader.setVec4("material.ambient", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 64.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawSphere();
-					modelMatrix.pop();
-
-					modelMatrix.push();
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.5f)));
-						modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 1.0f, 0.05f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 64.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -1.0f)));
-					modelMatrix.push();
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 0.1f, 0.1f)));
-						shader.setVec4("material.ambient", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 64.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawSphere();
-					modelMatrix.pop();
-
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.1f)));
-					modelMatrix.push();
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(-0.05f, 0.0f, 0.0f)));
-						modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 0.2f, 0.2f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 64.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-
-					modelMatrix.push();
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.05f, 0.0f, 0.0f)));
-						modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.05f, 0.2f, 0.2f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 64.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-	
-				modelMatrix.pop();
-			modelMatrix.pop();
-
-			// Engine
-			modelMatrix.push();
-				modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, 1.1f)));
-				//modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(-45.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
-				modelMatrix.push();
-					modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 0.1f, 0.6f)));
-					shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-					shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-					shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-					shader.setFloat("material.shininess", 64.0f);
-					shader.setMat4("model", modelMatrix.top());
-					drawCube();
-				modelMatrix.pop();
-
-				modelMatrix.push();
-					modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, 0.3f)));
-					modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(ROVEngineAngle), glm::vec3(0.0f, 0.0f, 1.0f)));
-					modelMatrix.push();
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.1f)));
-						shader.setVec4("material.ambient", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 16.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawSphere();
-					modelMatrix.pop();
-
-					modelMatrix.push();
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.3f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.6f, 0.05f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 16.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-
-					modelMatrix.push();
-						modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(120.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.3f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.6f, 0.05f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 16.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-
-					modelMatrix.push();
-						modelMatrix.save(glm::rotate(modelMatrix.top(), glm::radians(240.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
-						modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.3f, 0.0f)));
-						modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.6f, 0.05f)));
-						shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-						shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-						shader.setFloat("material.shininess", 16.0f);
-						shader.setMat4("model", modelMatrix.top());
-						drawCube();
-					modelMatrix.pop();
-
-				modelMatrix.pop();
-
-			modelMatrix.pop();
-
-		modelMatrix.pop();
+// Scaling of the job system with the number of threads, from the main thread alone to one thread per core.
+// The work is the per-frame work of a much larger scene: a field of spheres culled against the four monitors
+// and the normal matrices of as many objects. The time of one run is logged and listed in the panel.
+void benchmarkJobSystem() {
+	const unsigned int numSpheres = 1 << 20;
+	const unsigned int numMatrices = 1 << 18;
+	const unsigned int repeats = 10;
+
+	std::default_random_engine generator(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.2f, 2.0f);
+	SphereSet spheres;
+	for (unsigned int i = 0; i < numSpheres; i++) {
+		spheres.add(glm::vec3(position(generator), position(generator) * 0.1f, position(generator)), size(generator));
+	}
+	// Half of the objects are stretched, so half of the normal matrices need the inverse
+	std::vector<glm::mat4> models(numMatrices);
+	std::vector<glm::mat3> normals(numMatrices);
+	for (unsigned int i = 0; i < numMatrices; i++) {
+		float scale = size(generator);
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(position(generator), 0.0f, position(generator)));
+		model = glm::rotate(model, glm::radians(position(generator)), glm::vec3(0.0f, 1.0f, 0.0f));
+		models[i] = glm::scale(model, glm::vec3(scale, (i % 2 == 0) ? scale : scale * 2.0f, scale));
+	}
+	std::vector<std::vector<unsigned int>> chunks((numSpheres + CULL_GRAIN - 1) / CULL_GRAIN);
+
+	jobBenchmark.clear();
+	unsigned int cores = glm::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int threads = 1; threads <= cores; threads = (threads == cores) ? cores + 1 : glm::min(threads * 2, cores)) {
+		JobSystem jobs;
+		jobs.setup(threads - 1);
+		double start = glfwGetTime();
+		for (unsigned int r = 0; r < repeats; r++) {
+			jobs.parallelFor((unsigned int)chunks.size(), 1, [&](unsigned int begin, unsigned int end) {
+				for (unsigned int c = begin; c < end; c++) {
+					chunks[c].clear();
+					spheres.cull(viewFrustums, 4, c * CULL_GRAIN, glm::min((c + 1) * CULL_GRAIN, numSpheres), chunks[c]);
+				}
+			});
+			jobs.parallelFor(numMatrices, 4096, [&](unsigned int begin, unsigned int end) {
+				computeNormalMatrices(&models[begin], &normals[begin], end - begin);
+			});
+		}
+		float time = (float)((glfwGetTime() - start) * 1000.0 / repeats);
+		jobs.release();
 
-	modelMatrix.pop();
+		jobBenchmark.push_back(glm::vec2((float)threads, time));
+		logging::loggingMessage(logging::LogType::INFO, "Job benchmark: " + std::to_string(threads) + " threads, " + std::to_string(time) + " ms, x" + std::to_string(jobBenchmark[0].y / time));
+	}
 }
 
-void drawCamera(Shader shader) {
-	modelMatrix.push();
-		modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(1.0f, 0.8f, 1.8f)));
-		shader.setVec4("material.ambient", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-		shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-		shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-		shader.setFloat("material.shininess", 32.0f);
-		shader.setMat4("model", modelMatrix.top());
-		drawCube();
-
-		modelMatrix.push();
-			modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, -0.2f)));
-			modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.6f, 0.6f, 1.2f)));
-			shader.setVec4("material.ambient", glm::vec4(0.25f, 0.25f, 0.25f, 1.0f));
-			shader.setVec4("material.diffuse", glm::vec4(0.25f, 0.25f, 0.25f, 1.0f));
-			shader.setVec4("material.specular", glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f));
-			shader.setFloat("material.shininess", 32.0f);
-			shader.setMat4("model", modelMatrix.top());
-			drawCube();
-		modelMatrix.pop();
-	modelMatrix.pop();
+// The point lights can move (ROV light) or be turned off, so the light balls are rebuilt every frame.
+void updateLightBallInstances() {
+	lightBallMeshes.clear();
+	for (unsigned int i = 0; i < pointLights.size(); i++) {
+		if (!pointLights[i].Enable) {
+			continue;
+		}
+		if (i == rovPointLight) {
+			// ROV light
+			lightBallMeshes.addInstance(pointLights[i].Position + glm::vec3(0.0f, -0.7f, 0.0f), 0.1f, 0.0f, Material_Index::MATERIAL_LIGHT_BALL + i);
+		} else {
+			lightBallMeshes.addInstance(pointLights[i].Position, 0.5f, 0.0f, Material_Index::MATERIAL_LIGHT_BALL + i);
+		}
+	}
+	lightBallMeshes.upload();
 }
 
-void drawAxis(Shader shader) {
+void submitROV(CommandBuffer& commands, StackArray& matrices) {
+	// Only the propeller is animated, every other part was baked in geneROVData()
+	rovModel.Joints[rovEngineJoint] = glm::rotate(ROVEngineTransform, glm::radians(ROVEngineAngle), glm::vec3(0.0f, 0.0f, 1.0f));
+	commands.submit(Render_Pass::PASS_OPAQUE, Shader_Feature::FEATURE_PARTS, { 0, 0, 0 }, NULL, matrices.top(), [](Shader& shader) {
+		for (unsigned int i = 0; i < rovModel.Joints.size(); i++) {
+			shader.setMat4("joints[" + std::to_string(i) + "]", rovModel.Joints[i]);
+		}
+		rovModel.draw();
+	});
+}
 
-	shader.setBool("material.enableColorTexture", false);
-	shader.setBool("material.enableSpecularTexture", false);
-	shader.setBool("material.enableEmission", true);
-	shader.setBool("material.enableEmissionTexture", false);
+void submitCamera(CommandBuffer& commands, StackArray& matrices) {
+	matrices.push();
+		matrices.save(glm::scale(matrices.top(), glm::vec3(1.0f, 0.8f, 1.8f)));
+		submitMesh(commands, matrices, 0, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f), glm::vec4(0.2f, 0.2f, 0.2f, 1.0f), glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f), 32.0f, drawCube);
+
+		matrices.push();
+			matrices.save(glm::translate(matrices.top(), glm::vec3(0.0f, 0.0f, -0.2f)));
+			matrices.save(glm::scale(matrices.top(), glm::vec3(0.6f, 0.6f, 1.2f)));
+			submitMesh(commands, matrices, 0, glm::vec4(0.25f, 0.25f, 0.25f, 1.0f), glm::vec4(0.25f, 0.25f, 0.25f, 1.0f), glm::vec4(0.774597f, 0.774597f, 0.774597f, 1.0f), 32.0f, drawCube);
+		matrices.pop();
+	matrices.pop();
+}
 
+void submitAxis(CommandBuffer& commands, StackArray& matrices) {
 	// øs@ɧШtI]0, 0, 0^
-	modelMatrix.push();
-		modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.2f, 0.2f, 0.2f)));
-		shader.setVec4("material.ambient", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
-		shader.setVec4("material.diffuse", glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
-		shader.setVec4("material.specular", glm::vec4(0.4f, 0.4f, 0.4f, 1.0f));
-		shader.setFloat("material.shininess", 64.0f);
-		shader.setMat4("model", modelMatrix.top());
-		drawSphere();
-	modelMatrix.pop();
+	matrices.push();
+		matrices.save(glm::scale(matrices.top(), glm::vec3(0.2f, 0.2f, 0.2f)));
+		submitMesh(commands, matrices, Shader_Feature::FEATURE_EMISSION, glm::vec4(0.1f, 0.1f, 0.1f, 1.0f), glm::vec4(0.2f, 0.2f, 0.2f, 1.0f), glm::vec4(0.4f, 0.4f, 0.4f, 1.0f), 64.0f, drawSphere);
+	matrices.pop();
 
 	// øsTӶb
-	modelMatrix.push();
-		modelMatrix.push();
-			modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(1.5f, 0.0f, 0.0f)));
-			modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(3.0f, 0.1f, 0.1f)));
-			shader.setVec4("material.ambient", glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
-			shader.setVec4("material.diffuse", glm::vec4(1.0f, 0.0f, 0.0f, 1.0));
-			shader.setVec4("material.specular", glm::vec4(1.0f, 0.0f, 0.0f, 1.0));
-			shader.setFloat("material.shininess", 64.0f);
-			shader.setMat4("model", modelMatrix.top());
-			drawCube();
-		modelMatrix.pop();
-
-
-		modelMatrix.push();
-			modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 1.5f, 0.0f)));
-			modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 3.0f, 0.1f)));
-			shader.setVec4("material.ambient", glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-			shader.setVec4("material.diffuse", glm::vec4(0.0f, 1.0f, 0.0f, 1.0));
-			shader.setVec4("material.specular", glm::vec4(0.0f, 1.0f, 0.0f, 1.0));
-			shader.setFloat("material.shininess", 64.0f);
-			shader.setMat4("model", modelMatrix.top());
-			drawCube();
-		modelMatrix.pop();
-
-		modelMatrix.push();
-			modelMatrix.save(glm::translate(modelMatrix.top(), glm::vec3(0.0f, 0.0f, 1.5f)));
-			modelMatrix.save(glm::scale(modelMatrix.top(), glm::vec3(0.1f, 0.1f, 3.0f)));
-			shader.setVec4("material.ambient", glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
-			shader.setVec4("material.diffuse", glm::vec4(0.0f, 0.0f, 1.0f, 1.0));
-			shader.setVec4("material.specular", glm::vec4(0.0f, 0.0f, 1.0f, 1.0));
-			shader.setFloat("material.shininess", 64.0f);
-			shader.setMat4("model", modelMatrix.top());
-			drawCube();
-		modelMatrix.pop();
-	modelMatrix.pop();
+	matrices.push();
+		matrices.push();
+			matrices.save(glm::translate(matrices.top(), glm::vec3(1.5f, 0.0f, 0.0f)));
+			matrices.save(glm::scale(matrices.top(), glm::vec3(3.0f, 0.1f, 0.1f)));
+			submitMesh(commands, matrices, Shader_Feature::FEATURE_EMISSION, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f), glm::vec4(1.0f, 0.0f, 0.0f, 1.0), glm::vec4(1.0f, 0.0f, 0.0f, 1.0), 64.0f, drawCube);
+		matrices.pop();
+
+
+		matrices.push();
+			matrices.save(glm::translate(matrices.top(), glm::vec3(0.0f, 1.5f, 0.0f)));
+			matrices.save(glm::scale(matrices.top(), glm::vec3(0.1f, 3.0f, 0.1f)));
+			submitMesh(commands, matrices, Shader_Feature::FEATURE_EMISSION, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), glm::vec4(0.0f, 1.0f, 0.0f, 1.0), glm::vec4(0.0f, 1.0f, 0.0f, 1.0), 64.0f, drawCube);
+		matrices.pop();
+
+		matrices.push();
+			matrices.save(glm::translate(matrices.top(), glm::vec3(0.0f, 0.0f, 1.5f)));
+			matrices.save(glm::scale(matrices.top(), glm::vec3(0.1f, 0.1f, 3.0f)));
+			submitMesh(commands, matrices, Shader_Feature::FEATURE_EMISSION, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), glm::vec4(0.0f, 0.0f, 1.0f, 1.0), glm::vec4(0.0f, 0.0f, 1.0f, 1.0), 64.0f, drawCube);
+		matrices.pop();
+	matrices.pop();
+}
 
-	shader.setBool("material.enableEmission", false);
+// Submit one untextured mesh with its material set through the "material" uniform.
+void submitMesh(CommandBuffer& commands, StackArray& matrices, unsigned int features, glm::vec4 ambient, glm::vec4 diffuse, glm::vec4 specular, float shininess, void (*draw)()) {
+	PacketMaterial material = { ambient, diffuse, specular, shininess };
+	commands.submit(Render_Pass::PASS_OPAQUE, features, { 0, 0, 0 }, &material, matrices.top(), [draw](Shader&) {
+		draw();
+	});
 }
 
-void processROV(ROV_Movement direction, float deltaTime) {
-	float velocity = ROVMovementSpeed * deltaTime;
+void processROV(SimState& state, ROV_Movement direction, float deltaTime) {
+	float velocity = state.ROVSpeed * deltaTime;
 	if (direction == ROV_Movement::ROV_FORWARD) {
-		ROVPosition += ROVFront * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
-		ROVEngineAngle += ROVMovementSpeed * 40 * velocity;
-		if (ROVEngineAngle > 360) {
-			ROVEngineAngle -= 360;
+		state.ROVPosition += state.ROVFront * velocity;
+		checkNoGetOut(state);
+		state.Follow.updateTargetPosition(state.ROVPosition);
+		state.ROVEngineAngle += state.ROVSpeed * 40 * velocity;
+		if (state.ROVEngineAngle > 360) {
+			state.ROVEngineAngle -= 360;
 		}
 	}
 	if (direction == ROV_Movement::ROV_BACKWARD) {
-		ROVPosition -= ROVFront * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
-		ROVEngineAngle -= ROVMovementSpeed * 40 * velocity;
-		if (ROVEngineAngle < -360) {
-			ROVEngineAngle += 360;
+		state.ROVPosition -= state.ROVFront * velocity;
+		checkNoGetOut(state);
+		state.Follow.updateTargetPosition(state.ROVPosition);
+		state.ROVEngineAngle -= state.ROVSpeed * 40 * velocity;
+		if (state.ROVEngineAngle < -360) {
+			state.ROVEngineAngle += 360;
 		}
 	}
 	if (direction == ROV_Movement::ROV_LEFT) {
-		ROVPosition -= ROVRight * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
+		state.ROVPosition -= state.ROVRight * velocity;
+		checkNoGetOut(state);
+		state.Follow.updateTargetPosition(state.ROVPosition);
 	}
 	if (direction == ROV_Movement::ROV_RIGHT) {
-		ROVPosition += ROVRight * velocity;
-		checkNoGetOut();
-		followCamera.updateTargetPosition(ROVPosition);
+		state.ROVPosition += state.ROVRight * velocity;
+		checkNoGetOut(state);
+		state.Follow.updateTargetPosition(state.ROVPosition);
 	}
 	if (direction == ROV_Movement::ROV_TURNLEFT) {
-		ROVYaw += 8 * velocity;
-		if (ROVYaw > 360) {
-			ROVYaw -= 360;
+		state.ROVYaw += 8 * velocity;
+		if (state.ROVYaw > 360) {
+			state.ROVYaw -= 360;
 		}
-		updateROVFront();
+		updateROVFront(state);
 	}
 	if (direction == ROV_Movement::ROV_TURNRIGHT) {
-		ROVYaw -= 8 * velocity;
-		if (ROVYaw < -360) {
-			ROVYaw += 360;
+		state.ROVYaw -= 8 * velocity;
+		if (state.ROVYaw < -360) {
+			state.ROVYaw += 360;
 		}
-		updateROVFront();
+		updateROVFront(state);
 	}
 	if (direction == ROV_Movement::ROV_UP) {
-		if (ROVPosition.y >= -3.0f && ROVPosition.y <= 0.7f) {
-			ROVPosition += glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
-			followCamera.updateTargetPosition(ROVPosition);
+		if (state.ROVPosition.y >= -3.0f && state.ROVPosition.y <= 0.7f) {
+			state.ROVPosition += glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
+			state.Follow.updateTargetPosition(state.ROVPosition);
 		}
-		if (ROVPosition.y > 0.7f) {
-			ROVPosition.y = 0.7f;
+		if (state.ROVPosition.y > 0.7f) {
+			state.ROVPosition.y = 0.7f;
 		}
 	}
 	if (direction == ROV_Movement::ROV_DOWN) {
-		if (ROVPosition.y >= -3.0f && ROVPosition.y <= 0.7f) {
-			ROVPosition -= glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
-			followCamera.updateTargetPosition(ROVPosition);
+		if (state.ROVPosition.y >= -3.0f && state.ROVPosition.y <= 0.7f) {
+			state.ROVPosition -= glm::vec3(0.0f, 1.0f, 0.0f) * velocity;
+			state.Follow.updateTargetPosition(state.ROVPosition);
 		}
-		if (ROVPosition.y < -3.0f) {
-			ROVPosition.y = -3.0f;
+		if (state.ROVPosition.y < -3.0f) {
+			state.ROVPosition.y = -3.0f;
 		}
 	}
 }
 
-void checkNoGetOut() {
-	if (ROVPosition.x > 98.0f) {
-		ROVPosition.x = 98.0f;
-	}
-
-	if (ROVPosition.x < -98.0f) {
-		ROVPosition.x = -98.0f;
-	}
-
-	if (ROVPosition.z > 98.0f) {
-		ROVPosition.z = 98.0f;
-	}
-
-	if (ROVPosition.z < -98.0f) {
-		ROVPosition.z = -98.0f;
-	}
+void checkNoGetOut(SimState& state) {
+	state.ROVPosition.x = glm::clamp(state.ROVPosition.x, -WORLD_LIMIT, WORLD_LIMIT);
+	state.ROVPosition.z = glm::clamp(state.ROVPosition.z, -WORLD_LIMIT, WORLD_LIMIT);
 }
 
-void updateROVFront() {
-	glm::mat4 rotatematrix = glm::rotate(glm::mat4(1.0f), glm::radians(ROVYaw), glm::vec3(0.0f, 1.0f, 0.0f));
+void updateROVFront(SimState& state) {
+	glm::mat4 rotatematrix = glm::rotate(glm::mat4(1.0f), glm::radians(state.ROVYaw), glm::vec3(0.0f, 1.0f, 0.0f));
 	glm::vec4 front = rotatematrix * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
-	ROVFront = glm::vec3(front.x, front.y, front.z);
+	state.ROVFront = glm::vec3(front.x, front.y, front.z);
 
-	ROVRight = glm::normalize(glm::cross(ROVFront, glm::vec3(0.0f, 1.0f, 0.0f)));
+	state.ROVRight = glm::normalize(glm::cross(state.ROVFront, glm::vec3(0.0f, 1.0f, 0.0f)));
 }
 
 void drawSphere() {
@@ -1994,59 +2708,175 @@ void frameBufferSizeCallback(GLFWwindow* window, int width, int height) {
 	glViewport(0, 0, width, height);
 }
 
-// Handle the input which in the main loop
+// Handle the input which in the main loop, the keys held down and the speed of the ROV are sent to the simulation thread when they change
 void processInput(GLFWwindow* window) {
-	if (isGhost) {
-		// like ghost, u can go any where.
-		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::FORWARD, deltaTime);
+	const int keys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E, GLFW_KEY_SPACE, GLFW_KEY_LEFT_SHIFT, GLFW_KEY_O, GLFW_KEY_P };
+	unsigned int held = 0;
+	for (unsigned int i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		if (glfwGetKey(window, keys[i]) == GLFW_PRESS) {
+			held |= 1u << i;
 		}
-		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::BACKWARD, deltaTime);
+	}
+	if (held != heldKeys && inputQueue.push({ Input_Type::INPUT_KEYS, held, 0.0f, 0.0f })) {
+		heldKeys = held;
+	}
+	if (ROVMovementSpeed != sentSpeed && inputQueue.push({ Input_Type::INPUT_SPEED, 0, ROVMovementSpeed, 0.0f })) {
+		sentSpeed = ROVMovementSpeed;
+	}
+	sendGhost();
+}
+
+// Also called from the key callback, so the mouse events queued after the toggle already move the right camera
+void sendGhost() {
+	if (isGhost != sentGhost && pushInput({ Input_Type::INPUT_GHOST, isGhost ? 1u : 0u, 0.0f, 0.0f })) {
+		sentGhost = isGhost;
+	}
+}
+
+// The mouse and wheel offsets are dropped when the simulation thread falls this far behind, logged once until a push succeeds again
+bool pushInput(const InputEvent& event) {
+	static bool full = false;
+	bool pushed = inputQueue.push(event);
+	if (!pushed && !full) {
+		logging::loggingMessage(logging::LogType::WARNING, "The input queue is full, input events are dropped.");
+	}
+	full = !pushed;
+	return pushed;
+}
+
+SimState captureSimState() {
+	SimState state;
+	state.ROVPosition = ROVPosition;
+	state.ROVFront = ROVFront;
+	state.ROVRight = ROVRight;
+	state.ROVYaw = ROVYaw;
+	state.ROVEngineAngle = ROVEngineAngle;
+	state.ROVSpeed = ROVMovementSpeed;
+	state.Ghost = camera;
+	state.Follow = followCamera;
+	state.IsGhost = isGhost;
+	state.Keys = 0;
+	return state;
+}
+
+// Angle "alpha" of the way from a to b in degrees, turning the shorter way around
+float lerpAngle(float a, float b, float alpha) {
+	float delta = fmodf(b - a + 540.0f, 360.0f) - 180.0f;
+	return a + delta * alpha;
+}
+
+glm::vec3 lerpDirection(const glm::vec3& a, const glm::vec3& b, float alpha) {
+	glm::vec3 direction = glm::mix(a, b, alpha);
+	return (glm::dot(direction, direction) > 1e-8f) ? glm::normalize(direction) : b;
+}
+
+// Render copies of the ROV and the cameras, "alpha" of the way from the previous to the current tick
+void applySimState(const SimState& previous, const SimState& current, float alpha) {
+	ROVPosition = glm::mix(previous.ROVPosition, current.ROVPosition, alpha);
+	ROVFront = lerpDirection(previous.ROVFront, current.ROVFront, alpha);
+	ROVRight = lerpDirection(previous.ROVRight, current.ROVRight, alpha);
+	ROVYaw = lerpAngle(previous.ROVYaw, current.ROVYaw, alpha);
+	ROVEngineAngle = lerpAngle(previous.ROVEngineAngle, current.ROVEngineAngle, alpha);
+
+	camera = current.Ghost;
+	camera.Position = glm::mix(previous.Ghost.Position, current.Ghost.Position, alpha);
+	camera.Front = lerpDirection(previous.Ghost.Front, current.Ghost.Front, alpha);
+	camera.Right = lerpDirection(previous.Ghost.Right, current.Ghost.Right, alpha);
+	camera.Up = lerpDirection(previous.Ghost.Up, current.Ghost.Up, alpha);
+	camera.Yaw = lerpAngle(previous.Ghost.Yaw, current.Ghost.Yaw, alpha);
+	camera.Pitch = glm::mix(previous.Ghost.Pitch, current.Ghost.Pitch, alpha);
+	camera.Zoom = glm::mix(previous.Ghost.Zoom, current.Ghost.Zoom, alpha);
+
+	followCamera = current.Follow;
+	followCamera.Position = glm::mix(previous.Follow.Position, current.Follow.Position, alpha);
+	followCamera.Target = glm::mix(previous.Follow.Target, current.Follow.Target, alpha);
+	followCamera.Front = lerpDirection(previous.Follow.Front, current.Follow.Front, alpha);
+	followCamera.Right = lerpDirection(previous.Follow.Right, current.Follow.Right, alpha);
+	followCamera.Up = lerpDirection(previous.Follow.Up, current.Follow.Up, alpha);
+	followCamera.Yaw = lerpAngle(previous.Follow.Yaw, current.Follow.Yaw, alpha);
+	followCamera.Pitch = glm::mix(previous.Follow.Pitch, current.Follow.Pitch, alpha);
+	followCamera.Zoom = glm::mix(previous.Follow.Zoom, current.Follow.Zoom, alpha);
+	followCamera.Distance = glm::mix(previous.Follow.Distance, current.Follow.Distance, alpha);
+}
+
+// One fixed step of the simulation thread: apply the queued input, then move the ghost camera or the ROV.
+void simulationTick(SimState& state, float step) {
+	InputEvent event;
+	while (inputQueue.pop(event)) {
+		switch (event.Type) {
+		case Input_Type::INPUT_KEYS:
+			state.Keys = event.Keys;
+			break;
+		case Input_Type::INPUT_GHOST:
+			state.IsGhost = (event.Keys != 0);
+			break;
+		case Input_Type::INPUT_SPEED:
+			state.ROVSpeed = event.X;
+			break;
+		case Input_Type::INPUT_MOUSE_MOVE:
+			if (state.IsGhost) {
+				state.Ghost.ProcessMouseMovement(event.X, event.Y);
+			} else {
+				state.Follow.ProcessMouseMovement(event.X, event.Y);
+			}
+			break;
+		case Input_Type::INPUT_SCROLL:
+			if (state.IsGhost) {
+				state.Ghost.ProcessMouseScroll(event.Y);
+			} else {
+				state.Follow.ProcessMouseScroll(event.Y);
+			}
+			break;
 		}
-		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::LEFT, deltaTime);
+	}
+
+	unsigned int keys = state.Keys;
+	if (state.IsGhost) {
+		// like ghost, u can go any where.
+		state.Ghost.MovementSpeed = (keys & SIM_KEY_SHIFT) ? 25.0f : 10.0f;
+		if (keys & SIM_KEY_W) {
+			state.Ghost.ProcessKeyboard(Camera_Movement::FORWARD, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-			camera.ProcessKeyboard(Camera_Movement::RIGHT, deltaTime);
+		if (keys & SIM_KEY_S) {
+			state.Ghost.ProcessKeyboard(Camera_Movement::BACKWARD, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
-			camera.MovementSpeed = 25.0f;
+		if (keys & SIM_KEY_A) {
+			state.Ghost.ProcessKeyboard(Camera_Movement::LEFT, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_RELEASE) {
-			camera.MovementSpeed = 10.0f;
+		if (keys & SIM_KEY_D) {
+			state.Ghost.ProcessKeyboard(Camera_Movement::RIGHT, step);
 		}
 	} else {
 		// Oh~ poor guy, u only can move the ROV.
-		if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_FORWARD, deltaTime);
+		if (keys & SIM_KEY_W) {
+			processROV(state, ROV_Movement::ROV_FORWARD, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_BACKWARD, deltaTime);
+		if (keys & SIM_KEY_S) {
+			processROV(state, ROV_Movement::ROV_BACKWARD, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_LEFT, deltaTime);
+		if (keys & SIM_KEY_A) {
+			processROV(state, ROV_Movement::ROV_LEFT, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_RIGHT, deltaTime);
+		if (keys & SIM_KEY_D) {
+			processROV(state, ROV_Movement::ROV_RIGHT, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_TURNLEFT, deltaTime);
+		if (keys & SIM_KEY_Q) {
+			processROV(state, ROV_Movement::ROV_TURNLEFT, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_TURNRIGHT, deltaTime);
+		if (keys & SIM_KEY_E) {
+			processROV(state, ROV_Movement::ROV_TURNRIGHT, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_UP, deltaTime);
+		if (keys & SIM_KEY_SPACE) {
+			processROV(state, ROV_Movement::ROV_UP, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
-			processROV(ROV_Movement::ROV_DOWN, deltaTime);
+		if (keys & SIM_KEY_SHIFT) {
+			processROV(state, ROV_Movement::ROV_DOWN, step);
 		}
-		if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
-			followCamera.AdjustDistance(-0.5);
+		if (keys & SIM_KEY_O) {
+			state.Follow.AdjustDistance(-0.5);
 		}
-		if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
-			followCamera.AdjustDistance(0.5);
+		if (keys & SIM_KEY_P) {
+			state.Follow.AdjustDistance(0.5);
 		}
 	}
 }
@@ -2097,6 +2927,7 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 			spotLights[1].Enable = true;
 			logging::loggingMessage(logging::LogType::INFO, "You're a ghost!");
 		}
+		sendGhost();
 	}
 	
 	if (key == GLFW_KEY_Y) {
@@ -2189,12 +3020,7 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
 	// Allow u to move the direction of camera
 	if (moveCameraDirection) {
-		if (isGhost) {
-			camera.ProcessMouseMovement(xoffset, yoffset);
-		}
-		else {
-			followCamera.ProcessMouseMovement(xoffset, yoffset);
-		}
+		pushInput({ Input_Type::INPUT_MOUSE_MOVE, 0, xoffset, yoffset });
 	}
 }
 
@@ -2212,11 +3038,7 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
 
 // Handle mouse scroll
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
-	if (isGhost) {
-		camera.ProcessMouseScroll(yoffset);
-	} else {
-		followCamera.ProcessMouseScroll(yoffset);
-	}
+	pushInput({ Input_Type::INPUT_SCROLL, 0, (float)xoffset, (float)yoffset });
 }
 
 // Handle GLFW Error Callback
@@ -2224,72 +3046,6 @@ void errorCallback(int error, const char* description) {
 	logging::loggingMessage(logging::LogType::ERROR, description);
 }
 
-// Loading Texture
-unsigned int loadTexture(char const* path) {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data) {
-		GLenum format;
-		if (nrComponents == 1) {
-			format = GL_RED;
-		}
-		else if (nrComponents == 3) {
-			format = GL_RGB;
-		}
-		else if (nrComponents == 4) {
-			format = GL_RGBA;
-		}
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_MIRRORED_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else {
-		std::cout << "Failed to load texture at path:" << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
-
-// Loading Cubemap
-unsigned int loadCubemap(std::vector<std::string> faces) {
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++) {
-		unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else {
-			std::cout << "Failed to load Cubemap texture at path:" << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
-}
-
 glm::mat4 GetPerspectiveProjMatrix(float fovy, float ascept, float znear, float zfar) {
 
 	glm::mat4 proj = glm::mat4(1.0f);